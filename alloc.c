@@ -0,0 +1,212 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include <buchstabensuppe.h>
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_MIN_BLOCK_SIZE 4096
+
+#define ALIGN_UP(x) (((x) + (ARENA_ALIGNMENT - 1)) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+// default allocator
+
+static void *libc_malloc(void *user, size_t size) {
+  (void) user;
+  return malloc(size);
+}
+
+static void *libc_realloc(void *user, void *ptr, size_t size) {
+  (void) user;
+  return realloc(ptr, size);
+}
+
+static void libc_free(void *user, void *ptr) {
+  (void) user;
+  free(ptr);
+}
+
+bs_allocator_t bs_allocator_default(void) {
+  bs_allocator_t allocator = { libc_malloc, libc_realloc, libc_free, NULL };
+  return allocator;
+}
+
+// allocator for fixed memory, every request fails
+
+static void *none_malloc(void *user, size_t size) {
+  (void) user;
+  (void) size;
+  errno = ENOMEM;
+  return NULL;
+}
+
+static void *none_realloc(void *user, void *ptr, size_t size) {
+  (void) user;
+  (void) ptr;
+  (void) size;
+  errno = ENOMEM;
+  return NULL;
+}
+
+static void none_free(void *user, void *ptr) {
+  (void) user;
+  (void) ptr;
+}
+
+bs_allocator_t bs_allocator_none(void) {
+  bs_allocator_t allocator = { none_malloc, none_realloc, none_free, NULL };
+  return allocator;
+}
+
+// arena
+
+struct bs_arena_block {
+  struct bs_arena_block *next;
+  size_t                 size;
+  size_t                 used;
+};
+
+void bs_arena_init(bs_arena_t *arena, bs_allocator_t allocator) {
+  arena->bs_arena_allocator = allocator;
+  arena->bs_arena_buffer = NULL;
+  arena->bs_arena_used = 0;
+  arena->bs_arena_cap = 0;
+  arena->bs_arena_overflow = NULL;
+  arena->bs_arena_overflow_size = 0;
+}
+
+void bs_arena_init_buffer(bs_arena_t *arena, void *buffer, size_t size) {
+  // overflow blocks are requested from an allocator which never has any,
+  // bs_arena_reset() therefore always keeps using buffer
+  bs_arena_init(arena, bs_allocator_none());
+  arena->bs_arena_buffer = buffer;
+  arena->bs_arena_cap = buffer == NULL ? 0 : size;
+}
+
+void bs_arena_free(bs_arena_t *arena) {
+  bs_allocator_t *a = &arena->bs_arena_allocator;
+
+  while(arena->bs_arena_overflow != NULL) {
+    struct bs_arena_block *next = arena->bs_arena_overflow->next;
+    a->bs_allocator_free(a->bs_allocator_user, arena->bs_arena_overflow);
+    arena->bs_arena_overflow = next;
+  }
+
+  if(arena->bs_arena_buffer != NULL) {
+    a->bs_allocator_free(a->bs_allocator_user, arena->bs_arena_buffer);
+  }
+
+  arena->bs_arena_buffer = NULL;
+  arena->bs_arena_used = 0;
+  arena->bs_arena_cap = 0;
+  arena->bs_arena_overflow_size = 0;
+}
+
+void *bs_arena_alloc(bs_arena_t *arena, size_t size) {
+  size = ALIGN_UP(size);
+
+  if(size == 0) {
+    size = ARENA_ALIGNMENT;
+  }
+
+  size_t header_size = ALIGN_UP(sizeof(struct bs_arena_block));
+  struct bs_arena_block *head = arena->bs_arena_overflow;
+
+  if(head == NULL && arena->bs_arena_cap - arena->bs_arena_used >= size) {
+    void *ptr = arena->bs_arena_buffer + arena->bs_arena_used;
+    arena->bs_arena_used += size;
+    return ptr;
+  }
+
+  if(head != NULL && head->size - head->used >= size) {
+    void *ptr = (unsigned char *) head + header_size + head->used;
+    head->used += size;
+    return ptr;
+  }
+
+  // The main buffer can't be grown without invalidating pointers
+  // handed out already, so allocate an overflow block which is
+  // merged into the main buffer on the next reset. Doubling the
+  // total size keeps the number of blocks logarithmic.
+  size_t block_size = arena->bs_arena_cap + arena->bs_arena_overflow_size;
+  if(block_size < size) {
+    block_size = size;
+  }
+  if(block_size < ARENA_MIN_BLOCK_SIZE) {
+    block_size = ARENA_MIN_BLOCK_SIZE;
+  }
+
+  if(block_size > SIZE_MAX - header_size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  bs_allocator_t *a = &arena->bs_arena_allocator;
+  struct bs_arena_block *block =
+    a->bs_allocator_malloc(a->bs_allocator_user, header_size + block_size);
+
+  if(block == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  block->next = arena->bs_arena_overflow;
+  block->size = block_size;
+  block->used = size;
+
+  arena->bs_arena_overflow = block;
+  arena->bs_arena_overflow_size += block_size;
+
+  return (unsigned char *) block + header_size;
+}
+
+bs_arena_mark_t bs_arena_mark(bs_arena_t *arena) {
+  bs_arena_mark_t mark;
+
+  mark.bs_mark_block = arena->bs_arena_overflow;
+  mark.bs_mark_used = mark.bs_mark_block == NULL
+    ? arena->bs_arena_used : mark.bs_mark_block->used;
+
+  return mark;
+}
+
+void bs_arena_rollback(bs_arena_t *arena, bs_arena_mark_t mark) {
+  // if a new block has been started since, we can't roll back
+  // past its beginning, but it will be reused until it is full
+  if(mark.bs_mark_block != arena->bs_arena_overflow) {
+    return;
+  }
+
+  if(mark.bs_mark_block == NULL) {
+    arena->bs_arena_used = mark.bs_mark_used;
+  } else {
+    mark.bs_mark_block->used = mark.bs_mark_used;
+  }
+}
+
+void bs_arena_reset(bs_arena_t *arena) {
+  arena->bs_arena_used = 0;
+
+  if(arena->bs_arena_overflow == NULL) {
+    return;
+  }
+
+  // Grow the main buffer, so the next round of allocations of the same
+  // size fits into it entirely. Its contents need not be preserved.
+  size_t new_cap = arena->bs_arena_cap + arena->bs_arena_overflow_size;
+  bs_allocator_t *a = &arena->bs_arena_allocator;
+
+  while(arena->bs_arena_overflow != NULL) {
+    struct bs_arena_block *next = arena->bs_arena_overflow->next;
+    a->bs_allocator_free(a->bs_allocator_user, arena->bs_arena_overflow);
+    arena->bs_arena_overflow = next;
+  }
+
+  arena->bs_arena_overflow_size = 0;
+
+  if(arena->bs_arena_buffer != NULL) {
+    a->bs_allocator_free(a->bs_allocator_user, arena->bs_arena_buffer);
+  }
+
+  arena->bs_arena_buffer = a->bs_allocator_malloc(a->bs_allocator_user, new_cap);
+  arena->bs_arena_cap = arena->bs_arena_buffer == NULL ? 0 : new_cap;
+}
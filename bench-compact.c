@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200112L /* getenv, ... */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// meson treats this exit code as a skipped test or benchmark
+#define EXIT_SKIP 77
+
+#define DEFAULT_FONT_SIZE 16
+#define DISPLAY_WIDTH 80
+#define FRAME_ROW_SIZE (DISPLAY_WIDTH / 8)
+#define MAX_MESSAGES 1024
+#define MAX_MESSAGE_LEN 1024
+
+static const char *const default_corpus[] = {
+  "Hauptbahnhof",
+  "S1 Flughafen über Ostbahnhof",
+  "U3 Moosach – Fürstenried West",
+  "Bus 100 Museumslinie, Abfahrt in 3 min",
+  "Zug fällt heute aus. Wir bitten um Entschuldigung.",
+  "Next train: 12:47 platform 4 — delayed by approx. 15 minutes",
+  "Betriebsstörung zwischen Marienplatz und Sendlinger Tor",
+  "Welcome! Free Wi-Fi is available on all trains.",
+  "Ersatzverkehr mit Bussen ab Haltestelle Rosenheimer Platz",
+  "Please mind the gap between the train and the platform edge",
+};
+
+// average time in ns of packing every frame of a scroll through each bitmap
+static double measure(const bs_bitmap_t *bitmaps, const bs_compact_bitmap_t *compact,
+  size_t count, int height, bool use_compact, size_t *frames) {
+  size_t frame_size = FRAME_ROW_SIZE * (size_t) height;
+  uint8_t *frame = malloc(frame_size);
+
+  *frames = 0;
+
+  if(frame == NULL) {
+    return 0;
+  }
+
+  uint64_t start = bs_clock_now();
+
+  for(size_t i = 0; i < count; i++) {
+    for(int x = -DISPLAY_WIDTH; x < bitmaps[i].bs_bitmap_width; x++) {
+      if(use_compact) {
+        bs_rect_t view = { x, 0, DISPLAY_WIDTH, height };
+        bs_compact_view_pack(compact + i, view, frame, frame_size, 0);
+      } else {
+        bs_view_t view = { bitmaps[i], x, 0, DISPLAY_WIDTH, height };
+        bs_view_bitarray_pack(view, frame, frame_size, 0);
+      }
+
+      (*frames)++;
+    }
+  }
+
+  uint64_t end = bs_clock_now();
+  free(frame);
+
+  return *frames > 0 ? (double) (end - start) / *frames : 0;
+}
+
+// checks that both representations produce the same frames
+static bool frames_identical(bs_bitmap_t bitmap, const bs_compact_bitmap_t *compact) {
+  size_t frame_size = FRAME_ROW_SIZE * (size_t) bitmap.bs_bitmap_height;
+  uint8_t *expected = malloc(frame_size);
+  uint8_t *actual = malloc(frame_size);
+  bool identical = expected != NULL && actual != NULL;
+
+  for(int x = -DISPLAY_WIDTH; identical && x < bitmap.bs_bitmap_width; x++) {
+    bs_view_t view = { bitmap, x, 0, DISPLAY_WIDTH, bitmap.bs_bitmap_height };
+    bs_rect_t rect = { x, 0, DISPLAY_WIDTH, bitmap.bs_bitmap_height };
+
+    size_t size = bs_view_bitarray_pack(view, expected, frame_size, 0);
+
+    identical = size > 0 &&
+      bs_compact_view_pack(compact, rect, actual, frame_size, 0) == size &&
+      memcmp(expected, actual, size) == 0;
+  }
+
+  free(expected);
+  free(actual);
+
+  return identical;
+}
+
+static void free_messages(bs_bitmap_t *bitmaps, bs_compact_bitmap_t *compact, size_t count) {
+  for(size_t i = 0; i < count; i++) {
+    bs_bitmap_free(bitmaps + i);
+    bs_compact_bitmap_free(compact + i);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *font = argc > 1 ? argv[1] : getenv("BS_BENCH_FONT");
+  const char *corpus_path = argc > 2 ? argv[2] : getenv("BS_BENCH_CORPUS");
+
+  if(font == NULL) {
+    fputs("usage: bench-compact FONT [CORPUS] or BS_BENCH_FONT=FONT bench-compact\n",
+      stderr);
+    return EXIT_SKIP;
+  }
+
+  bs_context_t ctx;
+  bs_context_init(&ctx);
+  ctx.bs_rendering_flags = BS_RENDER_BINARY;
+
+  if(!bs_add_font(&ctx, font, 0, DEFAULT_FONT_SIZE)) {
+    fprintf(stderr, "bench-compact: could not load %s\n", font);
+    bs_context_free(&ctx);
+    return 1;
+  }
+
+  static bs_bitmap_t bitmaps[MAX_MESSAGES];
+  static bs_compact_bitmap_t compact[MAX_MESSAGES];
+  size_t count = 0;
+
+  // one message per line, rendered like they would be kept in memory
+  FILE *corpus = corpus_path == NULL ? NULL : fopen(corpus_path, "r");
+  char line[MAX_MESSAGE_LEN];
+
+  if(corpus_path != NULL && corpus == NULL) {
+    fprintf(stderr, "bench-compact: could not open %s\n", corpus_path);
+    bs_context_free(&ctx);
+    return 1;
+  }
+
+  for(size_t i = 0; count < MAX_MESSAGES; i++) {
+    const char *message;
+
+    if(corpus != NULL) {
+      if(fgets(line, sizeof(line), corpus) == NULL) {
+        break;
+      }
+
+      line[strcspn(line, "\n")] = '\0';
+      message = line;
+    } else if(i < sizeof(default_corpus) / sizeof(default_corpus[0])) {
+      message = default_corpus[i];
+    } else {
+      break;
+    }
+
+    bitmaps[count] = bs_render_utf8_string(&ctx, message, strlen(message));
+
+    if(bitmaps[count].bs_bitmap_width > 0) {
+      count++;
+    }
+  }
+
+  if(corpus != NULL) {
+    fclose(corpus);
+  }
+
+  size_t raw_size = 0;
+  size_t compact_size = 0;
+  int height = 0;
+  bool identical = true;
+
+  for(size_t i = 0; i < count; i++) {
+    if(!bs_compact_bitmap_encode(bitmaps[i], compact + i)) {
+      fputs("bench-compact: could not encode bitmap\n", stderr);
+      free_messages(bitmaps, compact, count);
+      bs_context_free(&ctx);
+      return 1;
+    }
+
+    raw_size += sizeof(bs_bitmap_t)
+      + (size_t) bitmaps[i].bs_bitmap_width * bitmaps[i].bs_bitmap_height;
+    compact_size += bs_compact_bitmap_size(compact + i);
+
+    if(bitmaps[i].bs_bitmap_height > height) {
+      height = bitmaps[i].bs_bitmap_height;
+    }
+
+    identical = identical && frames_identical(bitmaps[i], compact + i);
+  }
+
+  size_t frames;
+  double raw_ns = measure(bitmaps, compact, count, height, false, &frames);
+  double compact_ns = measure(bitmaps, compact, count, height, true, &frames);
+
+  printf("%zu messages, %zu scroll frames of %dx%d\n", count, frames,
+    DISPLAY_WIDTH, height);
+  printf("  bitmaps:  %8zu bytes, %8.0f ns per frame\n", raw_size, raw_ns);
+  printf("  compact:  %8zu bytes, %8.0f ns per frame (%.1fx smaller)\n",
+    compact_size, compact_ns, compact_size > 0 ? (double) raw_size / compact_size : 0);
+  printf("  frames %s\n", identical ? "identical" : "DIFFER");
+
+  free_messages(bitmaps, compact, count);
+  bs_context_free(&ctx);
+
+  return identical ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#define _POSIX_C_SOURCE 200112L /* getenv, ... */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// meson treats this exit code as a skipped test or benchmark
+#define EXIT_SKIP 77
+
+#define DEFAULT_FONT_SIZE 16
+#define ROUNDS 200
+
+static const char sample[] =
+  "The quick brown fox jumps over the lazy dog. 0123456789 "
+  "Größenordnung: 12,5 °C, façade, naïve, Ærøskøbing & Ñandú!";
+
+// average time in ns per grapheme of rendering the sample with the given flags
+static double measure(bs_context_t *ctx, int flags, size_t graphemes) {
+  ctx->bs_rendering_flags = flags;
+
+  // first render allocates the context's scratch memory
+  bs_bitmap_t b = bs_render_utf8_string(ctx, sample, sizeof(sample) - 1);
+  bs_bitmap_free(&b);
+
+  uint64_t start = bs_clock_now();
+
+  for(int i = 0; i < ROUNDS; i++) {
+    b = bs_render_utf8_string(ctx, sample, sizeof(sample) - 1);
+    bs_bitmap_free(&b);
+  }
+
+  return (double) (bs_clock_now() - start) / ROUNDS / graphemes;
+}
+
+int main(int argc, char **argv) {
+  const char *font = argc > 1 ? argv[1] : getenv("BS_BENCH_FONT");
+  int size = argc > 2 ? atoi(argv[2]) : DEFAULT_FONT_SIZE;
+
+  if(font == NULL) {
+    fputs("usage: bench FONT [SIZE] or BS_BENCH_FONT=FONT bench\n", stderr);
+    return EXIT_SKIP;
+  }
+
+  bs_context_t ctx;
+  bs_context_init(&ctx);
+
+  if(size <= 0 || !bs_add_font(&ctx, font, 0, size)) {
+    fprintf(stderr, "bench: could not load %s\n", font);
+    bs_context_free(&ctx);
+    return 1;
+  }
+
+  bs_utf32_buffer_t str = bs_decode_utf8(sample, sizeof(sample) - 1);
+  size_t graphemes = 0;
+
+  for(size_t offset = 0; offset < str.bs_utf32_buffer_len; graphemes++) {
+    offset += bs_utf32_grapheme_length(str, offset);
+  }
+
+  bs_utf32_buffer_free(&str);
+
+  // that both produce the same output is checked by the unit tests
+  double fast_ns = measure(&ctx, BS_RENDER_BINARY, graphemes);
+  double shaped_ns = measure(&ctx, BS_RENDER_BINARY | BS_RENDER_ALWAYS_SHAPE, graphemes);
+
+  const bs_font_t *f = ctx.bs_fonts;
+  size_t simple = 0;
+
+  for(size_t c = 0; c < BS_SIMPLE_CODEPOINTS; c++) {
+    simple += f->bs_font_simple_glyphs[c] != 0;
+  }
+
+  printf("%s: %zu of %d Latin-1 codepoints without shaping", font, simple,
+    BS_SIMPLE_CODEPOINTS);
+
+  if(f->bs_font_monospace_advance != 0) {
+    printf(", monospace advance %d", (int) f->bs_font_monospace_advance);
+  }
+
+  printf("\n  shaped:       %8.0f ns per grapheme\n", shaped_ns);
+  printf("  fast path:    %8.0f ns per grapheme (%.2fx)\n", fast_ns,
+    shaped_ns / fast_ns);
+
+  bs_context_free(&ctx);
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <buchstabensuppe.h>
 
@@ -24,11 +25,20 @@ bool bs_bitmap_extend(bs_bitmap_t *b, int new_w, int new_h, unsigned char init)
     return true;
   }
 
+  // the products of two ints overflow an int long before the bitmap
+  // stops fitting into memory, so sizes are computed as size_t
+  if((size_t) new_h > SIZE_MAX / (size_t) new_w) {
+    errno = EOVERFLOW;
+    return false;
+  }
+
+  size_t old_size = (size_t) b->bs_bitmap_height * b->bs_bitmap_width;
+  size_t new_size = (size_t) new_h * new_w;
+
   // perform y only resize if possible because it doesn't require copying
   // since the bitmap consists of rows we can just use realloc
-
   if(diff_y > 0 && diff_x == 0) {
-    unsigned char *tmp = realloc(b->bs_bitmap, new_h * b->bs_bitmap_width);
+    unsigned char *tmp = realloc(b->bs_bitmap, new_size);
 
     if(tmp == NULL) {
       errno = ENOMEM;
@@ -37,8 +47,7 @@ bool bs_bitmap_extend(bs_bitmap_t *b, int new_w, int new_h, unsigned char init)
 
     b->bs_bitmap = tmp;
 
-    memset(b->bs_bitmap + (b->bs_bitmap_height * b->bs_bitmap_width), init,
-      diff_y * b->bs_bitmap_width);
+    memset(b->bs_bitmap + old_size, init, new_size - old_size);
 
     b->bs_bitmap_height = new_h;
 
@@ -46,17 +55,17 @@ bool bs_bitmap_extend(bs_bitmap_t *b, int new_w, int new_h, unsigned char init)
   }
 
   if(diff_y >= 0 && diff_x > 0) {
-    unsigned char *tmp = malloc(new_h * new_w);
+    unsigned char *tmp = malloc(new_size);
 
     if(tmp == NULL) {
       errno = ENOMEM;
       return false;
     }
 
-    memset(tmp, init, new_h * new_w);
+    memset(tmp, init, new_size);
 
     for(int y = 0; y < b->bs_bitmap_height; y++) {
-      memcpy(tmp + y * new_w, b->bs_bitmap + y * b->bs_bitmap_width,
+      memcpy(tmp + (size_t) y * new_w, b->bs_bitmap + (size_t) y * b->bs_bitmap_width,
         b->bs_bitmap_width);
     }
 
@@ -89,7 +98,7 @@ void bs_bitmap_set(bs_bitmap_t b, int x, int y, unsigned char p) {
     return;
   }
 
-  b.bs_bitmap[y * b.bs_bitmap_width + x] = p;
+  b.bs_bitmap[(size_t) y * b.bs_bitmap_width + x] = p;
 }
 
 void bs_bitmap_free(bs_bitmap_t *b) {
@@ -108,7 +117,7 @@ unsigned char bs_bitmap_get(bs_bitmap_t b, int x, int y, unsigned char def) {
     return def;
   }
 
-  return b.bs_bitmap[y * b.bs_bitmap_width + x];
+  return b.bs_bitmap[(size_t) y * b.bs_bitmap_width + x];
 }
 
 void bs_bitmap_copy(bs_bitmap_t dst, int offset_x, int offset_y, bs_bitmap_t src) {
@@ -121,68 +130,121 @@ void bs_bitmap_copy(bs_bitmap_t dst, int offset_x, int offset_y, bs_bitmap_t src
   int src_min_x = fmax(0, (-1) * offset_x);
   int src_max_x = fmin(dst.bs_bitmap_width - offset_x, src.bs_bitmap_width);
 
+  // src lies entirely left or right of dst
+  if(src_min_x >= src_max_x) {
+    return;
+  }
+
   for(int y = src_min_y; y < src_max_y; y++) {
     int dst_y = y + offset_y;
 
-    unsigned char *dst_ptr = dst.bs_bitmap + (dst.bs_bitmap_width * dst_y)
+    unsigned char *dst_ptr = dst.bs_bitmap + ((size_t) dst.bs_bitmap_width * dst_y)
       + src_min_x + offset_x;
 
-    memcpy(dst_ptr, src.bs_bitmap + (src.bs_bitmap_width * y) + src_min_x,
+    memcpy(dst_ptr, src.bs_bitmap + ((size_t) src.bs_bitmap_width * y) + src_min_x,
       src_max_x - src_min_x);
   }
 }
 
 void bs_bitmap_print(bs_bitmap_t bitmap, bool binary) {
-  int h = bitmap.bs_bitmap_height;
-  int w = bitmap.bs_bitmap_width;
+  // anything still buffered by stdio needs to come first
+  fflush(stdout);
+
+  (void) bs_bitmap_export(STDOUT_FILENO, bitmap, binary, BS_EXPORT_BLOCKS, NULL);
+}
+
+size_t bs_view_bitarray_size(bs_view_t view) {
+  if(view.bs_view_width <= 0 || view.bs_view_height <= 0) {
+    return 0;
+  }
+
+  return (size_t) view.bs_view_height * ((view.bs_view_width + 7) / 8);
+}
+
+size_t bs_view_bitarray_pack(bs_view_t view, uint8_t *array, size_t size, unsigned char def) {
+  size_t needed = bs_view_bitarray_size(view);
+
+  if(needed == 0 || size < needed) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  bs_bitmap_t b = view.bs_view_bitmap;
+  size_t row_bytes = (view.bs_view_width + 7) / 8;
+
+  // part of the view's columns that is covered by the bitmap
+  int min_i = fmax(0, -view.bs_view_offset_x);
+  int max_i = fmin(view.bs_view_width, b.bs_bitmap_width - view.bs_view_offset_x);
+
+  uint8_t def_byte = def > 0 ? 0xff : 0x00;
+
+  for(int i = 0; i < view.bs_view_height; i++) {
+    int y = view.bs_view_offset_y + i;
+    uint8_t *row = array + i * row_bytes;
 
-  for(int y = 0; y < h; y++) {
-    for(int x = 0; x < w; x++) {
-      unsigned char pixel = bitmap.bs_bitmap[y * w + x];
+    memset(row, def_byte, row_bytes);
 
-      bool white = binary ? pixel : pixel > 0x80;
+    if(y >= 0 && y < b.bs_bitmap_height && min_i < max_i) {
+      const unsigned char *pixels = b.bs_bitmap + (size_t) y * b.bs_bitmap_width
+        + view.bs_view_offset_x + min_i;
 
-      fputs(white ? "█" : " ", stdout);
+      for(int j = min_i; j < max_i; j++, pixels++) {
+        // reduce pixel to a single bit works regardless of monospace and
+        // grayscale bitmaps -- however grayscale bitmaps are not converted
+        // on the fly TODO
+        uint8_t mask = 0x80 >> (j & 7);
+
+        if(*pixels > 0) {
+          row[j >> 3] |= mask;
+        } else {
+          row[j >> 3] &= ~mask;
+        }
+      }
+    }
+
+    // keep the padding bits of each row zero
+    if(view.bs_view_width % 8 != 0) {
+      row[row_bytes - 1] &= 0xff << (8 - view.bs_view_width % 8);
     }
-    putchar('\n');
   }
+
+  return needed;
 }
 
 uint8_t *bs_view_bitarray(bs_view_t view, size_t *size, unsigned char def) {
-  int view_max_y = view.bs_view_offset_y + view.bs_view_height;
-  int view_max_x = view.bs_view_offset_x + view.bs_view_width;
-
-  *size = ceil((view.bs_view_height * view.bs_view_width) / 8);
+  *size = bs_view_bitarray_size(view);
   uint8_t *array = malloc(sizeof(uint8_t) * (*size));
-  size_t array_pos = 0;
 
-  if(array == NULL) {
+  if(array == NULL || bs_view_bitarray_pack(view, array, *size, def) == 0) {
+    free(array);
     *size = 0;
     return NULL;
   }
 
-  for(int y = view.bs_view_offset_y; y < view_max_y; y++) {
-    for(int x = view.bs_view_offset_x; x < view_max_x; x = x + 8) {
-      uint8_t byte = 0;
-      int max_i = fmin(8, view_max_x - x);
+  return array;
+}
 
-      for(int i = 0; i < max_i; i++) {
-        // reduce pixel to a single bit works regardless of monospace and
-        // grayscale bitmaps -- however grayscale bitmaps are not converted
-        // on the fly TODO
-        uint8_t pixel_val = bs_bitmap_get(view.bs_view_bitmap, x + i, y, def) > 0;
-        byte |= pixel_val << (7 - i);
-      }
+bool bs_bitarray_unpack(bs_bitmap_t bitmap, const uint8_t *array, size_t size) {
+  bs_view_t view = { bitmap, 0, 0, bitmap.bs_bitmap_width, bitmap.bs_bitmap_height };
+  size_t needed = bs_view_bitarray_size(view);
+
+  if(needed == 0 || size != needed) {
+    errno = EINVAL;
+    return false;
+  }
 
-      array[array_pos++] = byte;
+  size_t row_bytes = (bitmap.bs_bitmap_width + 7) / 8;
 
-      if(array_pos >= *size) {
-        return array;
-      }
+  for(int i = 0; i < bitmap.bs_bitmap_height; i++) {
+    const uint8_t *row = array + i * row_bytes;
+    unsigned char *pixels = bitmap.bs_bitmap + (size_t) i * bitmap.bs_bitmap_width;
+
+    for(int j = 0; j < bitmap.bs_bitmap_width; j++) {
+      pixels[j] = (row[j >> 3] >> (7 - (j & 7))) & 1;
     }
   }
 
-  return array;
+  return true;
 }
 
 unsigned char bs_pixel_invert_binary(unsigned char p) {
@@ -204,8 +266,8 @@ unsigned char bs_pixel_to_grayscale(unsigned char p) {
 void bs_bitmap_map(bs_bitmap_t bitmap, unsigned char (*fun)(unsigned char)) {
   for(int y = 0; y < bitmap.bs_bitmap_height; y++) {
     for(int x = 0; x < bitmap.bs_bitmap_width; x++) {
-      bitmap.bs_bitmap[y * bitmap.bs_bitmap_width + x] =
-        (*fun)(bitmap.bs_bitmap[y * bitmap.bs_bitmap_width + x]);
+      bitmap.bs_bitmap[(size_t) y * bitmap.bs_bitmap_width + x] =
+        (*fun)(bitmap.bs_bitmap[(size_t) y * bitmap.bs_bitmap_width + x]);
     }
   }
 }
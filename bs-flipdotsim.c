@@ -0,0 +1,468 @@
+#define _POSIX_C_SOURCE 200112L /* getopt, getaddrinfo, sigaction, ... */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <buchstabensuppe.h>
+
+#define DEFAULT_FLIPDOT_WIDTH 80
+#define DEFAULT_FLIPDOT_HEIGHT 16
+#define DEFAULT_PORT "2323"
+
+// bigger than any sensible frame, so oversized packets can be detected
+#define MAX_PACKET_SIZE 65536
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void handle_interrupt(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+void print_error(const char *name, const char *err) {
+  fputs(name, stderr);
+  fputs(": ", stderr);
+  fputs(err, stderr);
+  fputc('\n', stderr);
+}
+
+void print_usage(const char *name) {
+  size_t name_len = strlen(name);
+
+  fputs(name, stderr);
+  fputs(" [-4|-6] [-h HOST] [-p PORT] [-W WIDTH] [-H HEIGHT] [-q]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" [-o PREFIX] [-r FPS] [-c COUNT] [-t SECONDS]\n", stderr);
+
+  fputs(name, stderr);
+  fputs(" -?\n", stderr);
+
+  fprintf(stderr,
+    "\n"
+    "  -h    address to listen on (default: any)\n"
+    "  -p    port to listen on (default: %s)\n"
+    "  -W    width of the simulated flipdot display (default: %d)\n"
+    "  -H    height of the simulated flipdot display (default: %d)\n"
+    "  -q    quiet: don't print received frames\n"
+    "  -o    write every frame to PREFIX-NNNNNN.pbm\n"
+    "  -r    expected frames per second, used to detect missing frames\n"
+    "  -c    exit after receiving the given number of frames\n"
+    "  -t    exit if no frame is received for the given number of seconds\n"
+    "  -4    only listen on IPv4\n"
+    "  -6    only listen on IPv6\n"
+    "  -?    display this help screen\n",
+    DEFAULT_PORT, DEFAULT_FLIPDOT_WIDTH, DEFAULT_FLIPDOT_HEIGHT);
+}
+
+struct receiver_stats {
+  uint64_t  packets;
+  uint64_t  frames;
+  uint64_t  malformed;
+  uint64_t  duplicates;
+  uint64_t  missing;
+  uint64_t  dropped;
+
+  size_t    size_min;
+  size_t    size_max;
+  uint64_t  size_sum;
+
+  uint64_t  first;
+  uint64_t  last;
+  uint64_t  last_interval;
+  uint64_t  last_hash;
+
+  uint64_t  jitter_sum;
+  uint64_t  jitter_max;
+  uint64_t  jitter_histogram[BS_SCHEDULE_HISTOGRAM_BUCKETS];
+};
+
+void stats_packet(struct receiver_stats *stats, size_t size, uint64_t now) {
+  if(stats->packets == 0 || size < stats->size_min) {
+    stats->size_min = size;
+  }
+  if(size > stats->size_max) {
+    stats->size_max = size;
+  }
+
+  stats->size_sum += size;
+  stats->packets++;
+
+  if(stats->packets == 1) {
+    stats->first = now;
+  }
+}
+
+void stats_frame(struct receiver_stats *stats, const uint8_t *frame, size_t size, uint64_t now, uint64_t period) {
+  uint64_t hash = bs_frame_hash(frame, size);
+
+  // senders are free to resend frames, but it is worth knowing about
+  if(stats->frames > 0 && hash == stats->last_hash) {
+    stats->duplicates++;
+  }
+
+  if(stats->frames > 0) {
+    uint64_t interval = now - stats->last;
+
+    // Inter-arrival jitter is the difference between consecutive
+    // intervals, unless the expected frame interval is known.
+    uint64_t reference = period > 0 ? period : stats->last_interval;
+
+    if(period > 0 || stats->frames > 1) {
+      uint64_t jitter = interval > reference
+        ? interval - reference : reference - interval;
+
+      stats->jitter_sum += jitter;
+      if(jitter > stats->jitter_max) {
+        stats->jitter_max = jitter;
+      }
+      stats->jitter_histogram[bs_schedule_histogram_bucket(jitter)]++;
+    }
+
+    // a gap of more than one and a half periods means frames went missing
+    if(period > 0 && interval > period + period / 2) {
+      stats->missing += (interval + period / 2) / period - 1;
+    }
+
+    stats->last_interval = interval;
+  }
+
+  stats->last_hash = hash;
+  stats->last = now;
+  stats->frames++;
+}
+
+void print_stats(const struct receiver_stats *stats, uint64_t period) {
+  printf("Received %llu packets, %llu frames, %llu malformed\n",
+    (unsigned long long) stats->packets, (unsigned long long) stats->frames,
+    (unsigned long long) stats->malformed);
+
+  if(stats->packets == 0) {
+    return;
+  }
+
+  printf("  packet size: min %zu max %zu avg %llu bytes\n",
+    stats->size_min, stats->size_max,
+    (unsigned long long) (stats->size_sum / stats->packets));
+
+  printf("  %llu duplicate frames, %llu dropped by the kernel",
+    (unsigned long long) stats->duplicates, (unsigned long long) stats->dropped);
+  if(period > 0) {
+    printf(", %llu missing", (unsigned long long) stats->missing);
+  }
+  putchar('\n');
+
+  if(stats->frames > 1) {
+    double duration = (stats->last - stats->first) / 1e9;
+    uint64_t intervals = period > 0 ? stats->frames - 1 : stats->frames - 2;
+
+    printf("  frame rate: %.2f fps over %.3fs\n",
+      (stats->frames - 1) / duration, duration);
+
+    if(intervals > 0) {
+      printf("  jitter: avg %lluus max %lluus\n",
+        (unsigned long long) (stats->jitter_sum / intervals / 1000),
+        (unsigned long long) (stats->jitter_max / 1000));
+      bs_schedule_histogram_print(stdout, "jitter", stats->jitter_histogram, "us");
+    }
+  }
+}
+
+bool write_pbm(const char *prefix, uint64_t index, bs_bitmap_t bitmap) {
+  char path[4096];
+
+  if(snprintf(path, sizeof(path), "%s-%06llu.pbm", prefix,
+      (unsigned long long) index) >= (int) sizeof(path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  FILE *out = fopen(path, "w");
+
+  if(out == NULL) {
+    return false;
+  }
+
+  // plain PBM, where 1 is black, so set dots are written as 0
+  fprintf(out, "P1\n%d %d\n", bitmap.bs_bitmap_width, bitmap.bs_bitmap_height);
+
+  for(int y = 0; y < bitmap.bs_bitmap_height; y++) {
+    for(int x = 0; x < bitmap.bs_bitmap_width; x++) {
+      fputc(bs_bitmap_get(bitmap, x, y, 0) ? '0' : '1', out);
+    }
+    fputc('\n', out);
+  }
+
+  bool success = !ferror(out);
+
+  if(fclose(out) != 0) {
+    success = false;
+  }
+
+  return success;
+}
+
+int listen_socket(const char *host, const char *port, int family) {
+  struct addrinfo hints;
+  struct addrinfo *res;
+  int sockfd = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = family;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+  if(getaddrinfo(host, port, &hints, &res) != 0) {
+    return -1;
+  }
+
+  // Prefer IPv6, which also accepts IPv4 unless -6 is given, so
+  // senders resolving localhost to either address reach us.
+  for(int pass = 0; pass < 2 && sockfd < 0; pass++) {
+    for(struct addrinfo *ai = res; ai != NULL && sockfd < 0; ai = ai->ai_next) {
+      if((ai->ai_family == AF_INET6) != (pass == 0)) {
+        continue;
+      }
+
+      sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+      if(sockfd < 0) {
+        continue;
+      }
+
+      if(ai->ai_family == AF_INET6) {
+        int v6only = family == AF_INET6;
+        setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+      }
+
+      if(bind(sockfd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(sockfd);
+        sockfd = -1;
+      }
+    }
+  }
+
+  freeaddrinfo(res);
+
+  return sockfd;
+}
+
+int main(int argc, char **argv) {
+  const char *host = NULL;
+  const char *port = DEFAULT_PORT;
+  const char *pbm_prefix = NULL;
+  int width = DEFAULT_FLIPDOT_WIDTH;
+  int height = DEFAULT_FLIPDOT_HEIGHT;
+  int family = AF_UNSPEC;
+  bool quiet = false;
+  double fps = 0;
+  double timeout = 0;
+  long max_frames = 0;
+
+  int opt;
+  bool parse_error = false;
+
+  while(!parse_error && (opt = getopt(argc, argv, "46qh:p:W:H:o:r:c:t:?")) != -1) {
+    switch(opt) {
+      case '4':
+        family = AF_INET;
+        break;
+      case '6':
+        family = AF_INET6;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = optarg;
+        break;
+      case 'o':
+        pbm_prefix = optarg;
+        break;
+      case 'W':
+        errno = 0;
+        width = atoi(optarg);
+        if(errno != 0 || width <= 0) {
+          print_error(argv[0], "flipdot width passed is not an integer");
+          parse_error = true;
+        }
+        break;
+      case 'H':
+        errno = 0;
+        height = atoi(optarg);
+        if(errno != 0 || height <= 0) {
+          print_error(argv[0], "flipdot height passed is not an integer");
+          parse_error = true;
+        }
+        break;
+      case 'r':
+        errno = 0;
+        fps = strtod(optarg, NULL);
+        if(errno != 0 || fps <= 0) {
+          print_error(argv[0], "frame rate passed is not a positive number");
+          parse_error = true;
+        }
+        break;
+      case 'c':
+        errno = 0;
+        max_frames = atol(optarg);
+        if(errno != 0 || max_frames <= 0) {
+          print_error(argv[0], "frame count passed is not an integer");
+          parse_error = true;
+        }
+        break;
+      case 't':
+        errno = 0;
+        timeout = strtod(optarg, NULL);
+        if(errno != 0 || timeout <= 0) {
+          print_error(argv[0], "timeout passed is not a positive number");
+          parse_error = true;
+        }
+        break;
+      case '?':
+        print_usage(argv[0]);
+        return 0;
+        break;
+      default:
+        parse_error = true;
+        break;
+    }
+  }
+
+  if(parse_error || optind < argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  int sockfd = listen_socket(host, port, family);
+
+  if(sockfd < 0) {
+    print_error(argv[0], "could not listen on given address");
+    return 1;
+  }
+
+  if(timeout > 0) {
+    struct timeval tv;
+    tv.tv_sec = (time_t) timeout;
+    tv.tv_usec = (suseconds_t) ((timeout - tv.tv_sec) * 1e6);
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+
+#ifdef SO_RXQ_OVFL
+  // let the kernel report how many packets it dropped for a full queue
+  int enable = 1;
+  setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+#endif
+
+  // no SA_RESTART, so the blocking receive is interrupted as well
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_interrupt;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  bs_bitmap_t bitmap = bs_bitmap_new(width, height, 0);
+  uint8_t *packet = malloc(MAX_PACKET_SIZE);
+
+  if(bitmap.bs_bitmap == NULL || packet == NULL) {
+    print_error(argv[0], "could not allocate memory");
+    free(packet);
+    bs_bitmap_free(&bitmap);
+    close(sockfd);
+    return 1;
+  }
+
+  bool tty = isatty(STDOUT_FILENO);
+  uint64_t period = fps > 0 ? 1e9 / fps : 0;
+  struct receiver_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  int status = 0;
+
+  while(!interrupted && (max_frames == 0 || stats.frames < (uint64_t) max_frames)) {
+    union {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(uint32_t))];
+    } control;
+    struct iovec iov = { packet, MAX_PACKET_SIZE };
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t len = recvmsg(sockfd, &msg, 0);
+    uint64_t now = bs_clock_now();
+
+    if(len < 0) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        break; // timeout
+      } else if(errno != EINTR) {
+        print_error(argv[0], "could not receive frame");
+        status = 1;
+        break;
+      }
+
+      continue;
+    }
+
+#ifdef SO_RXQ_OVFL
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+      if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL) {
+        uint32_t dropped;
+        memcpy(&dropped, CMSG_DATA(c), sizeof(dropped));
+        stats.dropped = dropped;
+      }
+    }
+#endif
+
+    stats_packet(&stats, len, now);
+
+    // the display ignores packets which don't fit its size
+    if(!bs_bitarray_unpack(bitmap, packet, len)) {
+      stats.malformed++;
+      continue;
+    }
+
+    stats_frame(&stats, packet, len, now, period);
+
+    if(!quiet) {
+      if(tty) {
+        fputs("\033[H\033[2J", stdout);
+      }
+
+      printf("Frame %llu (%zd bytes)\n", (unsigned long long) stats.frames, len);
+      bs_bitmap_print(bitmap, true);
+      fflush(stdout);
+    }
+
+    if(pbm_prefix != NULL && !write_pbm(pbm_prefix, stats.frames - 1, bitmap)) {
+      print_error(argv[0], "could not write PBM file");
+      status = 1;
+      break;
+    }
+  }
+
+  print_stats(&stats, period);
+
+  free(packet);
+  bs_bitmap_free(&bitmap);
+  close(sockfd);
+
+  return status;
+}
@@ -1,13 +1,16 @@
-#define _POSIX_C_SOURCE 200112L /* getopt, getaddrinfo, ... */
+#define _POSIX_C_SOURCE 200112L /* getopt, getaddrinfo, sigaction, ... */
 #include <errno.h>
-#include <netdb.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <buchstabensuppe.h>
@@ -18,8 +21,22 @@
 #define DEFAULT_HOST "localhost"
 #define DEFAULT_PORT "2323"
 
-#define SCROLL_DELAY_MICROSECONDS 125000 // 8 FPS
-#define PAGE_DELAY_SECONDS 2
+#define DEFAULT_SCROLL_FPS 8
+#define DEFAULT_PAGE_FPS 0.5
+#define DEFAULT_SCROLL_STEP 1
+#define DEFAULT_UPDATE_FPS 8
+#define DEFAULT_TRANSITION_STEPS 8
+
+#define TRACE_CAPACITY (1 << 18)
+
+#define MAX_HEADER_SIZE 16
+
+// columns passed from the rendering to the sending thread at once
+#define STRIP_WIDTH 8
+#define STRIP_SLOTS 64
+
+// frames kept in the shared memory ring for local readers
+#define SHM_SLOTS 64
 
 enum render_mode {
   RENDER_NORMAL,
@@ -27,6 +44,16 @@ enum render_mode {
   RENDER_SCROLL,
 };
 
+static volatile sig_atomic_t interrupted = 0;
+
+static void handle_interrupt(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+// where messages about sending go, stderr if stdout carries a picture
+static FILE *status_out;
+
 void print_error(const char *name, const char *err) {
   fputs(name, stderr);
   fputs(": ", stderr);
@@ -43,7 +70,32 @@ void print_usage(const char *name) {
   for(size_t i = 0; i < name_len; i++) {
     fputc(' ', stderr);
   }
-  fputs(" [-4|-6] [-S|-P] [-h HOST] [-p PORT] [-W WIDTH] [-H HEIGHT] TEXT\n", stderr);
+  fputs(" [-4|-6] [-S|-P] [-h HOST] [-p PORT] [-W WIDTH] [-H HEIGHT]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" [-w WALLFILE] [-r FPS] [-x STEP] [-k SECONDS]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" [-b FLIPS] [-c] [-u RATE] [-F FORMAT] [-l] [-T TRACEFILE]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" [-o PREVIEW] [-O PREVIEWFILE] [-m SHMNAME] [-t TRANSITION]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" [-R STREAMFILE]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" TEXT\n", stderr);
 
   fputs(name, stderr);
   fputs(" -?\n", stderr);
@@ -56,105 +108,1282 @@ void print_usage(const char *name) {
     "  -i    invert the bitmap (so text is black on white)\n"
     "  -S    scroll text through the screen\n"
     "  -P    page text if it overflows\n"
+    "  -r    frames per second for -S and -P (default: %d and %.1f)\n"
+    "  -x    pixels to move per frame when scrolling (default: %d)\n"
+    "  -l    start scrolling while the text is still being rendered\n"
+    "  -k    resend unchanged frames after the given number of seconds\n"
+    "  -b    maximum number of dots to flip per update of a panel\n"
+    "  -c    flip dots in checkerboard instead of row order with -b\n"
+    "  -u    updates per second with -b or -t (default: %d or FPS if higher)\n"
     "  -h    hostname of the flipdots to use (default: %s)\n"
     "  -p    port of the flipdots to use (default: %s)\n"
     "  -W    width of the target flipdot display (default: %d)\n"
     "  -H    height of the target flipdot display (default: %d)\n"
+    "  -w    send to a wall of panels listed in the given file instead\n"
+    "  -F    wire format, e. g. columns,lsb,depth=2,band=8,header=a55a\n"
     "  -4    only use IPv4 for connecting\n"
     "  -6    only use IPv6 for connecting\n"
+    "  -T    record a trace of the rendering pipeline to the given file\n"
+    "  -o    format of the printed picture: blocks, half, pbm, pgm, raw or none\n"
+    "  -O    write the picture to the given file instead of stdout\n"
+    "  -m    publish sent frames in the given POSIX shared memory object\n"
+    "  -t    change frames using wipe, push, dissolve or blinds, e. g. wipe:%d\n"
+    "  -R    record the sent frames to a stream file or a directory of them,\n"
+    "        with -n as fast as possible without sending\n"
     "  -?    display this help screen\n",
-    DEFAULT_FONT_SIZE, DEFAULT_HOST, DEFAULT_PORT,
-    DEFAULT_FLIPDOT_WIDTH, DEFAULT_FLIPDOT_HEIGHT);
+    DEFAULT_FONT_SIZE, DEFAULT_SCROLL_FPS, DEFAULT_PAGE_FPS,
+    DEFAULT_SCROLL_STEP, DEFAULT_UPDATE_FPS, DEFAULT_HOST, DEFAULT_PORT,
+    DEFAULT_FLIPDOT_WIDTH, DEFAULT_FLIPDOT_HEIGHT, DEFAULT_TRANSITION_STEPS);
 }
 
-void ignore_signal(int signum) {
-  (void) signum;
+// parses a decimal integer in [1, INT_MAX] without trailing garbage
+bool parse_positive_int(const char *s, int *n) {
+  char *end;
+
+  errno = 0;
+  long l = strtol(s, &end, 10);
+
+  if(errno != 0 || end == s || *end != '\0' || l <= 0 || l > INT_MAX) {
+    return false;
+  }
+
+  *n = l;
+  return true;
 }
 
-bool render_flipdot(const char *host, const char *port, int family, const char *progname, bs_bitmap_t *bitmap, enum render_mode mode, struct itimerval delay, int flipdot_width, int flipdot_height, bool invert) {
-  if(mode == RENDER_NORMAL && (bitmap->bs_bitmap_width < flipdot_width ||
-      bitmap->bs_bitmap_height < flipdot_height)) {
-    bs_bitmap_extend(bitmap, flipdot_width, flipdot_height, invert);
-  } else {
-    bs_bitmap_extend(bitmap, bitmap->bs_bitmap_width, flipdot_height, invert);
+// parses a finite positive number without trailing garbage
+bool parse_positive_double(const char *s, double *d) {
+  char *end;
+
+  errno = 0;
+  double x = strtod(s, &end);
+
+  if(errno != 0 || end == s || *end != '\0' || !(x > 0) || x > 1e9) {
+    return false;
   }
 
-  bs_view_t view;
+  *d = x;
+  return true;
+}
 
-  // initial state
-  view.bs_view_bitmap = *bitmap;
-  view.bs_view_width = flipdot_width;
-  view.bs_view_height = flipdot_height;
-  view.bs_view_offset_y = 0;
+struct panel {
+  struct sockaddr_storage  addr;
+  socklen_t                addrlen;
+
+  // position and size within the virtual canvas of the display
+  int                      x;
+  int                      y;
+  int                      width;
+  int                      height;
+
+  bs_frame_format_t        format;
+  uint8_t                  header[MAX_HEADER_SIZE];
+
+  uint8_t                 *frame;
+  size_t                   frame_size;
+  bs_frames_t              scroll;
+
+  // frame the panel should show and frame it is assumed to show,
+  // which is only known once the first frame has been sent in full
+  const uint8_t           *next;
+  uint8_t                 *shown;
+  bool                     known;
+
+  // dots flipped first with a checkerboard flip order, in the panel's format
+  uint8_t                 *checkerboard;
+
+  // frame shown when the panel's current transition started
+  uint8_t                 *from;
+  bool                     transitioning;
+
+  // destination of the panel's frames, bs_frame_data is filled in per tick
+  bs_flipdot_frame_t       dest;
+  bs_frame_filter_t        filter;
+};
+
+struct playback {
+  enum render_mode    mode;
+  double              fps;
+  int                 scroll_step;
+  bool                invert;
+  double              keepalive;
+
+  size_t              flip_budget;
+  enum bs_flip_order  flip_order;
+  double              update_fps;
+
+  enum bs_transition  transition;
+  int                 transition_steps;  // 0 for none
+
+  // time rendering started, for measuring the latency of the first frame
+  uint64_t            start;
+
+  // shared memory object to publish frames in or NULL
+  const char         *shm_name;
+
+  // stream file or directory to record frames to or NULL
+  const char         *record_path;
+
+  // record only, without waiting for deadlines or sending anything
+  bool                offline;
+};
+
+struct flip_stats {
+  uint64_t  updates;
+  uint64_t  intermediate;
+  uint64_t  held;
+  uint64_t  flips_sum;
+  uint64_t  flips_max;
+  uint64_t  histogram[BS_SCHEDULE_HISTOGRAM_BUCKETS];
+};
+
+enum pipeline_state {
+  PIPELINE_RENDERING,
+  PIPELINE_DONE,
+};
+
+struct strip {
+  int            width;
+  unsigned char  pixels[];  // STRIP_WIDTH columns, row by row
+};
+
+// Pipelined rendering: a separate thread renders the text one grapheme
+// at a time and passes finished columns as strips through a ring buffer.
+// The sending side only keeps a window of the canvas' width plus one
+// strip, so the first frame can be sent once the first screenful has
+// been rendered, regardless of the length of the text.
+struct pipeline {
+  bs_context_t         *ctx;
+  bs_utf32_buffer_t     str;
+  int                   height;
+
+  bs_ring_t             ring;
+  pthread_t             thread;
+  enum pipeline_state   state;
+  bool                  cancel;
+
+  // only used by the sending side
+  bs_bitmap_t           window;
+  int                   window_x;
+  int                   window_len;
+  unsigned char         on;
+  unsigned char         off;
+  uint64_t              underruns;
+};
+
+struct display {
+  int                 sockfd;
+  enum render_mode    mode;
+  bs_view_t           view;
+  int                 scroll_step;
+  struct pipeline    *pipeline;
+  unsigned char       def;
+  uint64_t            keepalive;
+  size_t              flip_budget;
+
+  enum bs_transition  transition;
+  int                 transition_steps;
+  int                 transition_step;
+
+  struct panel       *panels;
+  size_t              panels_len;
+  bs_flipdot_frame_t *batch;
+  uint32_t           *batch_panels;
+  bs_shm_ring_t      *shm;
+
+  bs_stream_writer_t *recorder;
+  const uint8_t     **record_frames;
+  uint64_t            update_period;
+
+  size_t              scroll_index;
+  size_t              scroll_count;
+
+  bool                animation_done;
+  bool                converged;
+
+  // keep sending a static text until interrupted, so keep-alive applies
+  bool                hold;
+  struct flip_stats   flips;
+
+  uint64_t            start;
+  uint64_t            first_frame;
+};
+
+bs_view_t panel_view(bs_view_t canvas, struct panel *p) {
+  bs_view_t view = canvas;
+
+  view.bs_view_offset_x += p->x;
+  view.bs_view_offset_y += p->y;
+  view.bs_view_width = p->width;
+  view.bs_view_height = p->height;
+
+  return view;
+}
+
+void flip_stats_record(struct flip_stats *stats, size_t flips, bool intermediate) {
+  int bucket = 0;
+
+  for(size_t n = flips; n > 0 && bucket < BS_SCHEDULE_HISTOGRAM_BUCKETS - 1; n >>= 1) {
+    bucket++;
+  }
+
+  stats->updates++;
+  stats->flips_sum += flips;
+  if(flips > stats->flips_max) {
+    stats->flips_max = flips;
+  }
+  stats->histogram[bucket]++;
+
+  if(intermediate) {
+    stats->intermediate++;
+  }
+}
+
+// removes the first n columns of a bitmap in place
+void bitmap_drop_columns(bs_bitmap_t *b, int n) {
+  int width = b->bs_bitmap_width - n;
+
+  for(int y = 0; y < b->bs_bitmap_height; y++) {
+    memmove(b->bs_bitmap + (size_t) y * width,
+      b->bs_bitmap + (size_t) y * b->bs_bitmap_width + n, width);
+  }
+
+  b->bs_bitmap_width = width;
+}
+
+// copies columns [x, x + columns) of the rendered bitmap into the ring
+bool pipeline_emit(struct pipeline *pl, bs_bitmap_t work, int x, int columns) {
+  struct strip *strip;
+
+  while((strip = bs_ring_write_begin(&pl->ring)) == NULL) {
+    if(__atomic_load_n(&pl->cancel, __ATOMIC_RELAXED)) {
+      return false;
+    }
+
+    // the sender is a whole ring behind, so there is no need to hurry
+    struct timespec ts = { 0, 1000000 };
+    nanosleep(&ts, NULL);
+  }
+
+  strip->width = columns;
+
+  for(int y = 0; y < pl->height; y++) {
+    unsigned char *row = strip->pixels + y * STRIP_WIDTH;
+
+    if(y < work.bs_bitmap_height) {
+      memcpy(row, work.bs_bitmap + (size_t) y * work.bs_bitmap_width + x, columns);
+    } else {
+      memset(row, 0, columns);
+    }
+  }
+
+  bs_ring_write_commit(&pl->ring);
+
+  return true;
+}
+
+void *pipeline_render(void *user) {
+  struct pipeline *pl = user;
+  bs_bitmap_t work = { NULL, 0, 0 };
+  bs_cursor_t cursor = { 0, 0 };
+  bool success = true;
+  size_t len;
+
+  // columns of work that have already been passed on
+  int emitted = 0;
+
+  // Glyphs may reach left of the cursor, e. g. combining marks or
+  // glyphs with a negative bearing, but not by more than the font is
+  // high, so columns only become final once they are that far behind.
+  int overhang = 0;
+  for(size_t i = 0; i < pl->ctx->bs_fonts_len; i++) {
+    int height = pl->ctx->bs_fonts[i].bs_font_pixel_height;
+    overhang = height > overhang ? height : overhang;
+  }
+
+  // like bs_render_utf8_string(), rendering stops at the first grapheme
+  // that can't be rendered, everything before it is still sent
+  for(size_t offset = 0; success && offset < pl->str.bs_utf32_buffer_len; offset += len) {
+    len = bs_utf32_grapheme_length(pl->str, offset);
+
+    if(!bs_render_grapheme_append(pl->ctx, &work, &cursor, pl->str, offset, len)) {
+      break;
+    }
+
+    int final = cursor.bs_cursor_x - overhang < work.bs_bitmap_width
+      ? cursor.bs_cursor_x - overhang : work.bs_bitmap_width;
+
+    for(; success && final - emitted >= STRIP_WIDTH; emitted += STRIP_WIDTH) {
+      success = pipeline_emit(pl, work, emitted, STRIP_WIDTH);
+    }
+
+    // only once they make up half of the bitmap, so on average
+    // every column is moved a constant number of times
+    if(emitted > 0 && emitted >= work.bs_bitmap_width / 2) {
+      bitmap_drop_columns(&work, emitted);
+      cursor.bs_cursor_x -= emitted;
+      emitted = 0;
+    }
+  }
+
+  while(success && emitted < work.bs_bitmap_width) {
+    int columns = work.bs_bitmap_width - emitted < STRIP_WIDTH
+      ? work.bs_bitmap_width - emitted : STRIP_WIDTH;
+
+    success = pipeline_emit(pl, work, emitted, columns);
+    emitted += columns;
+  }
+
+  bs_bitmap_free(&work);
+
+  __atomic_store_n(&pl->state, PIPELINE_DONE, __ATOMIC_RELEASE);
+
+  return NULL;
+}
+
+// Makes columns [x, x + width) available in the window if they have been
+// rendered. If the whole text has been received, its width is stored in
+// total, otherwise total is -1.
+bool pipeline_fill(struct pipeline *pl, int x, int width, int *total) {
+  bs_bitmap_t w = pl->window;
+  bool done = __atomic_load_n(&pl->state, __ATOMIC_ACQUIRE) == PIPELINE_DONE;
+  bool pulled = true;
+
+  while(pulled) {
+    // columns left of the view are no longer needed
+    int drop = x - pl->window_x;
+    if(drop > pl->window_len) {
+      drop = pl->window_len;
+    }
+
+    if(drop > 0) {
+      for(int y = 0; y < w.bs_bitmap_height; y++) {
+        unsigned char *row = w.bs_bitmap + (size_t) y * w.bs_bitmap_width;
+        memmove(row, row + drop, pl->window_len - drop);
+        memset(row + pl->window_len - drop, pl->off, drop);
+      }
+
+      pl->window_x += drop;
+      pl->window_len -= drop;
+    }
+
+    const struct strip *strip = NULL;
+    pulled = pl->window_len + STRIP_WIDTH <= w.bs_bitmap_width
+      && (strip = bs_ring_read_begin(&pl->ring)) != NULL;
+
+    if(pulled) {
+      for(int y = 0; y < w.bs_bitmap_height; y++) {
+        unsigned char *row = w.bs_bitmap + (size_t) y * w.bs_bitmap_width + pl->window_len;
+
+        for(int i = 0; i < strip->width; i++) {
+          row[i] = strip->pixels[y * STRIP_WIDTH + i] > 0 ? pl->on : pl->off;
+        }
+      }
+
+      pl->window_len += strip->width;
+      bs_ring_read_commit(&pl->ring);
+    }
+  }
+
+  // the renderer only finishes after committing its last strip, so
+  // an empty ring afterwards means everything has been received
+  *total = done && bs_ring_read_begin(&pl->ring) == NULL
+    ? pl->window_x + pl->window_len : -1;
+
+  return *total >= 0 || pl->window_x + pl->window_len >= x + width;
+}
+
+// advances the animation and sets the frames the panels should show next
+enum bs_tick_result display_animate(void *user) {
+  struct display *d = user;
+  bool finished = true;
+
+  // With a flip budget, showing a frame may take several updates.
+  // Hold the animation until it has been shown completely.
+  if(!d->converged) {
+    d->flips.held++;
+    return BS_TICK_CONTINUE;
+  }
+
+  bs_view_t view = d->view;
+  int total = -1;
+
+  if(d->pipeline != NULL) {
+    if(!pipeline_fill(d->pipeline, view.bs_view_offset_x, view.bs_view_width, &total)) {
+      d->pipeline->underruns++;
+      return BS_TICK_CONTINUE;
+    }
+
+    view.bs_view_bitmap = d->pipeline->window;
+    view.bs_view_offset_x -= d->pipeline->window_x;
+  }
+
+  for(size_t i = 0; i < d->panels_len; i++) {
+    struct panel *p = d->panels + i;
+
+    if(d->mode == RENDER_SCROLL && d->pipeline == NULL) {
+      p->next = p->scroll.bs_frames + d->scroll_index * p->scroll.bs_frame_size;
+    } else {
+      bs_view_pack(panel_view(view, p), &p->format, p->frame,
+        p->frame_size, d->def);
+      p->next = p->frame;
+    }
+  }
+
+  d->converged = false;
+
+  if(d->pipeline != NULL) {
+    // same frames as bs_scroll_next_view() would produce
+    finished = total >= 0 && d->view.bs_view_offset_x >= total;
+    d->view.bs_view_offset_x += d->scroll_step;
+  } else if(d->mode == RENDER_SCROLL) {
+    finished = ++d->scroll_index >= d->scroll_count;
+  } else if(d->mode == RENDER_PAGE) {
+    finished = bs_page_next_view(&d->view, 1, BS_DIMENSION_X);
+  }
+
+  d->animation_done = finished;
+
+  return finished ? BS_TICK_FINISHED : BS_TICK_CONTINUE;
+}
+
+// moves the panels towards their next frame within the flip budget
+enum bs_tick_result display_update(void *user) {
+  struct display *d = user;
+  uint64_t now = bs_clock_now();
+  size_t batch_len = 0;
+  bool converged = true;
+
+  // transitions step all panels in lockstep, each from the frame it
+  // was showing when it received a new frame
+  bool transitioning = d->transition_steps > 0;
+
+  if(transitioning) {
+    d->transition_step++;
+  }
+
+  // frames for all panels are sent in one go, so they stay in lockstep
+  for(size_t i = 0; i < d->panels_len; i++) {
+    struct panel *p = d->panels + i;
+
+    if(p->next == NULL) {
+      continue;
+    }
+
+    // the header never changes, so only the pixel data is compared
+    size_t header_size = p->format.bs_format_header_size;
+    size_t remaining = bs_frame_flip_count(p->shown + header_size,
+      p->next + header_size, p->frame_size - header_size);
+
+    if(remaining == 0) {
+      p->transitioning = false;
+    }
+
+    if(!p->known) {
+      // whatever the panel showed before, there is nothing to ease into
+      memcpy(p->shown + header_size, p->next + header_size,
+        p->frame_size - header_size);
+      p->known = true;
+    } else if(remaining > 0 && transitioning) {
+      // panels whose frame only changes later join the running transition
+      if(!p->transitioning) {
+        memcpy(p->from, p->shown, p->frame_size);
+        p->transitioning = true;
+      }
+
+      bs_frame_transition(d->transition, d->transition_step, d->transition_steps,
+        &p->format, p->width, p->height, p->from, p->next, p->shown);
+
+      size_t left = bs_frame_flip_count(p->shown + header_size,
+        p->next + header_size, p->frame_size - header_size);
+
+      flip_stats_record(&d->flips, remaining - left, left > 0);
+      converged = converged && left == 0;
+      p->transitioning = left > 0;
+    } else if(remaining > 0) {
+      size_t flips = p->checkerboard != NULL
+        ? bs_frame_flip_step_masked(p->shown + header_size, p->next + header_size,
+            p->checkerboard + header_size, p->frame_size - header_size, d->flip_budget)
+        : bs_frame_flip_step(p->shown + header_size, p->next + header_size,
+            p->frame_size - header_size, 0, d->flip_budget, BS_FLIP_ORDER_ROWS);
+
+      flip_stats_record(&d->flips, flips, flips < remaining);
+      converged = converged && flips == remaining;
+    }
+
+    // panels keep showing the last frame, so unchanged ones can be skipped
+    if(bs_frame_filter_check(&p->filter, p->shown, p->frame_size, now, d->keepalive)) {
+      d->batch[batch_len] = p->dest;
+      d->batch[batch_len].bs_frame_data = p->shown;
+      d->batch_panels[batch_len] = i;
+      batch_len++;
+    }
+  }
+
+  if(batch_len > 0 && d->sockfd >= 0 &&
+      bs_flipdot_send_frames(d->sockfd, d->batch, batch_len) != (ssize_t) batch_len) {
+    return BS_TICK_ERROR;
+  }
+
+  // every update is recorded, the writer merges unchanged ones
+  if(d->recorder != NULL) {
+    for(size_t i = 0; i < d->panels_len; i++) {
+      d->record_frames[i] = d->panels[i].shown;
+    }
+
+    if(!bs_stream_writer_append(d->recorder, d->record_frames, d->update_period)) {
+      return BS_TICK_ERROR;
+    }
+  }
+
+  if(batch_len > 0 && d->first_frame == 0) {
+    d->first_frame = bs_clock_now();
+  }
+
+  // local readers get exactly the frames the panels got, tagged with the panel
+  for(size_t i = 0; d->shm != NULL && i < batch_len; i++) {
+    bs_shm_ring_publish(d->shm, d->batch[i].bs_frame_data,
+      d->batch[i].bs_frame_size, d->batch_panels[i], now);
+  }
+
+  d->converged = converged;
+
+  if(converged) {
+    d->transition_step = 0;
+  }
+
+  return d->animation_done && converged && !d->hold
+    ? BS_TICK_FINISHED : BS_TICK_CONTINUE;
+}
+
+void print_stats(const bs_schedule_stats_t *stats) {
+  uint64_t frames = stats->bs_stats_frames;
+
+  fprintf(status_out, "Played %llu frames, %llu deadlines missed\n",
+    (unsigned long long) frames, (unsigned long long) stats->bs_stats_missed);
+
+  if(frames == 0) {
+    return;
+  }
+
+  fprintf(status_out, "  lateness: avg %lluus max %lluus\n",
+    (unsigned long long) (stats->bs_stats_lateness_sum / frames / 1000),
+    (unsigned long long) (stats->bs_stats_lateness_max / 1000));
+  bs_schedule_histogram_print(status_out, "lateness",
+    stats->bs_stats_lateness_histogram, "us");
+
+  if(frames > 1) {
+    fprintf(status_out, "  jitter: avg %lluus max %lluus\n",
+      (unsigned long long) (stats->bs_stats_jitter_sum / (frames - 1) / 1000),
+      (unsigned long long) (stats->bs_stats_jitter_max / 1000));
+    bs_schedule_histogram_print(status_out, "jitter",
+      stats->bs_stats_jitter_histogram, "us");
+  }
+}
+
+void print_filter_stats(const struct panel *panels, size_t panels_len) {
+  uint64_t sent = 0;
+  uint64_t skipped = 0;
+
+  for(size_t i = 0; i < panels_len; i++) {
+    sent += panels[i].filter.bs_filter_sent;
+    skipped += panels[i].filter.bs_filter_skipped;
+  }
+
+  fprintf(status_out, "  panel updates: %llu sent, %llu unchanged and skipped\n",
+    (unsigned long long) sent, (unsigned long long) skipped);
+}
+
+void print_flip_stats(const struct flip_stats *stats) {
+  fprintf(status_out, "  dot flips: %llu panel updates, %llu intermediate, %llu frames held\n",
+    (unsigned long long) stats->updates, (unsigned long long) stats->intermediate,
+    (unsigned long long) stats->held);
+
+  if(stats->updates == 0) {
+    return;
+  }
+
+  fprintf(status_out, "  flips per update: avg %llu max %llu\n",
+    (unsigned long long) (stats->flips_sum / stats->updates),
+    (unsigned long long) stats->flips_max);
+  bs_schedule_histogram_print(status_out, "flips", stats->histogram, "");
+}
+
+struct preview_format {
+  const char *name;
+  enum bs_export_format format;
+};
+
+static const struct preview_format preview_formats[] = {
+  { "blocks", BS_EXPORT_BLOCKS },
+  { "half",   BS_EXPORT_HALF_BLOCKS },
+  { "pbm",    BS_EXPORT_PBM },
+  { "pgm",    BS_EXPORT_PGM },
+  { "raw",    BS_EXPORT_RAW },
+};
+
+// "none" disables the preview, returns false for unknown names
+bool parse_preview(const char *name, bool *enabled, enum bs_export_format *format) {
+  *enabled = strcmp(name, "none") != 0;
+
+  if(!*enabled) {
+    return true;
+  }
+
+  for(size_t i = 0; i < sizeof(preview_formats) / sizeof(preview_formats[0]); i++) {
+    if(strcmp(name, preview_formats[i].name) == 0) {
+      *format = preview_formats[i].format;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+struct transition_name {
+  const char *name;
+  enum bs_transition transition;
+};
+
+static const struct transition_name transitions[] = {
+  { "wipe",     BS_TRANSITION_WIPE },
+  { "push",     BS_TRANSITION_PUSH },
+  { "dissolve", BS_TRANSITION_DISSOLVE },
+  { "blinds",   BS_TRANSITION_BLINDS },
+};
+
+// parses NAME or NAME:STEPS
+bool parse_transition(const char *spec, enum bs_transition *transition, int *steps) {
+  const char *colon = strchr(spec, ':');
+  size_t name_len = colon == NULL ? strlen(spec) : (size_t) (colon - spec);
+
+  *steps = DEFAULT_TRANSITION_STEPS;
+
+  if(colon != NULL) {
+    char *end;
+    long n = strtol(colon + 1, &end, 10);
+
+    if(*end != '\0' || end == colon + 1 || n <= 0 || n > 1000) {
+      return false;
+    }
+
+    *steps = n;
+  }
+
+  for(size_t i = 0; i < sizeof(transitions) / sizeof(transitions[0]); i++) {
+    if(strlen(transitions[i].name) == name_len &&
+        strncmp(spec, transitions[i].name, name_len) == 0) {
+      *transition = transitions[i].transition;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// writes the picture to path or stdout if it is NULL
+bool write_preview(const char *path, bs_bitmap_t bitmap,
+  enum bs_export_format preview_format, const bs_frame_format_t *format) {
+  int fd = STDOUT_FILENO;
+
+  if(path == NULL) {
+    fflush(stdout);
+  } else if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+    return false;
+  }
+
+  bool success = bs_bitmap_export(fd, bitmap, true, preview_format, format);
+
+  if(path != NULL && close(fd) != 0) {
+    success = false;
+  }
+
+  return success;
+}
+
+bool parse_format(const char *spec, bs_frame_format_t *format, uint8_t *header) {
+  char buf[256];
+
+  if(strlen(spec) >= sizeof(buf)) {
+    return false;
+  }
+
+  strcpy(buf, spec);
+
+  *format = bs_frame_format_flipdot();
+
+  for(char *save, *tok = strtok_r(buf, ",", &save); tok != NULL;
+      tok = strtok_r(NULL, ",", &save)) {
+    if(strcmp(tok, "rows") == 0) {
+      format->bs_format_scan = BS_SCAN_ROWS;
+    } else if(strcmp(tok, "columns") == 0) {
+      format->bs_format_scan = BS_SCAN_COLUMNS;
+    } else if(strcmp(tok, "msb") == 0) {
+      format->bs_format_bit_order = BS_BIT_ORDER_MSB_FIRST;
+    } else if(strcmp(tok, "lsb") == 0) {
+      format->bs_format_bit_order = BS_BIT_ORDER_LSB_FIRST;
+    } else if(strncmp(tok, "depth=", 6) == 0) {
+      format->bs_format_depth = atoi(tok + 6);
+    } else if(strncmp(tok, "band=", 5) == 0) {
+      format->bs_format_band_height = atoi(tok + 5);
+    } else if(strncmp(tok, "header=", 7) == 0) {
+      const char *hex = tok + 7;
+      size_t len = strlen(hex);
+
+      if(len % 2 != 0 || len / 2 > MAX_HEADER_SIZE) {
+        return false;
+      }
+
+      for(size_t i = 0; i < len / 2; i++) {
+        unsigned int byte;
+
+        if(sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+          return false;
+        }
+
+        header[i] = byte;
+      }
+
+      format->bs_format_header_size = len / 2;
+    } else {
+      return false;
+    }
+  }
+
+  // header is only set to a valid pointer once the panel has its final address
+  format->bs_format_header = format->bs_format_header_size > 0 ? header : NULL;
+
+  return bs_frame_format_size(format, 1, 1) > 0;
+}
+
+bool load_wall(const char *path, int family, const bs_frame_format_t *format, const uint8_t *header, const char *progname, struct panel **panels, size_t *panels_len) {
+  FILE *wall = fopen(path, "r");
+
+  if(wall == NULL) {
+    print_error(progname, "could not open wall configuration");
+    return false;
+  }
+
+  char line[512];
+  bool success = true;
+
+  *panels = NULL;
+  *panels_len = 0;
+
+  while(success && fgets(line, sizeof(line), wall) != NULL) {
+    char host[256];
+    char port[32];
+    char format_spec[256];
+    struct panel p;
+    memset(&p, 0, sizeof(struct panel));
+
+    p.format = *format;
+    memcpy(p.header, header, MAX_HEADER_SIZE);
+
+    char *comment = strchr(line, '#');
+    if(comment != NULL) {
+      *comment = '\0';
+    }
+
+    int fields = sscanf(line, "%255s %31s %d %d %d %d %255s", host, port,
+      &p.x, &p.y, &p.width, &p.height, format_spec);
+
+    if(fields <= 0) {
+      continue; // empty line
+    }
+
+    if(fields < 6 || p.width <= 0 || p.height <= 0) {
+      print_error(progname, "malformed panel in wall configuration");
+      success = false;
+    } else if(fields == 7 && !parse_format(format_spec, &p.format, p.header)) {
+      print_error(progname, "invalid panel format in wall configuration");
+      success = false;
+    } else if(!bs_flipdot_resolve(host, port, family, &p.addr, &p.addrlen)) {
+      print_error(progname, "could not look up panel host");
+      success = false;
+    } else if(*panels_len > 0 && p.addr.ss_family != (*panels)[0].addr.ss_family) {
+      print_error(progname, "all panels must use the same address family");
+      success = false;
+    } else {
+      struct panel *tmp = realloc(*panels, sizeof(struct panel) * (*panels_len + 1));
+
+      if(tmp == NULL) {
+        print_error(progname, "could not allocate memory");
+        success = false;
+      } else {
+        *panels = tmp;
+        (*panels)[(*panels_len)++] = p;
+      }
+    }
+  }
+
+  fclose(wall);
+
+  if(success && *panels_len == 0) {
+    print_error(progname, "wall configuration contains no panels");
+    success = false;
+  }
+
+  if(!success) {
+    free(*panels);
+    *panels = NULL;
+    *panels_len = 0;
+  }
+
+  return success;
+}
+
+bs_frames_t pack_scroll_frames(bs_view_t view, const bs_frame_format_t *format, int step, size_t count, unsigned char def) {
+  // frames in the common format can be computed incrementally
+  if(bs_frame_format_is_bitarray(format)) {
+    return bs_shift_frames(view, step, count, def);
+  }
+
+  bs_frames_t frames = { NULL, 0, 0 };
+  size_t size = bs_frame_format_size(format, view.bs_view_width, view.bs_view_height);
+
+  if(size == 0 || count > SIZE_MAX / size) {
+    return frames;
+  }
+
+  frames.bs_frames = malloc(size * count);
+
+  if(frames.bs_frames == NULL) {
+    return frames;
+  }
+
+  frames.bs_frame_size = size;
+  frames.bs_frames_count = count;
+
+  for(size_t i = 0; i < count; i++) {
+    bs_view_pack(view, format, frames.bs_frames + i * size, size, def);
+    view.bs_view_offset_x += step;
+  }
+
+  return frames;
+}
+
+// Calls the tasks in the same order bs_scheduler_run() would, but
+// without waiting for their deadlines, e. g. for recording a stream.
+bool run_offline(struct display *d, uint64_t period, uint64_t update_period) {
+  uint64_t animate_deadline = 0;
+  uint64_t update_deadline = 0;
+  bool animating = true;
+  bool updating = true;
 
-  if(mode == RENDER_SCROLL) {
-    view.bs_view_offset_x = -flipdot_width;
+  while((animating || updating) && !interrupted) {
+    enum bs_tick_result result;
+
+    if(animating && (!updating || animate_deadline <= update_deadline)) {
+      result = display_animate(d);
+      animate_deadline += period;
+      animating = result == BS_TICK_CONTINUE;
+    } else {
+      result = display_update(d);
+      update_deadline += update_period;
+      updating = result == BS_TICK_CONTINUE;
+    }
+
+    if(result == BS_TICK_ERROR) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+struct recording {
+  bs_stream_writer_t  writer;
+  int                 fd;
+  bool                directory;
+  char                path[4096];
+};
+
+// Recording into a directory writes to a temporary file first, which is
+// renamed after the stream's hash once it is complete.
+bool recording_start(struct recording *rec, const char *path,
+  const struct panel *panels, size_t panels_len) {
+  struct stat st;
+  rec->directory = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+
+  int len = rec->directory
+    ? snprintf(rec->path, sizeof(rec->path), "%s/.bs-record-%ld", path, (long) getpid())
+    : snprintf(rec->path, sizeof(rec->path), "%s", path);
+
+  if(len < 0 || (size_t) len >= sizeof(rec->path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+
+  rec->fd = open(rec->path, O_RDWR | O_CREAT | O_TRUNC | (rec->directory ? O_EXCL : 0), 0666);
+
+  if(rec->fd < 0) {
+    return false;
+  }
+
+  bs_stream_panel_t *stream_panels = calloc(panels_len, sizeof(bs_stream_panel_t));
+  bool success = stream_panels != NULL;
+
+  for(size_t i = 0; success && i < panels_len; i++) {
+    stream_panels[i].bs_panel_x = panels[i].x;
+    stream_panels[i].bs_panel_y = panels[i].y;
+    stream_panels[i].bs_panel_width = panels[i].width;
+    stream_panels[i].bs_panel_height = panels[i].height;
+    stream_panels[i].bs_panel_format = panels[i].format;
+  }
+
+  success = success &&
+    bs_stream_writer_open(&rec->writer, rec->fd, stream_panels, panels_len);
+
+  free(stream_panels);
+
+  if(!success) {
+    close(rec->fd);
+    unlink(rec->path);
+  }
+
+  return success;
+}
+
+// completes the stream, or removes it if recording failed
+bool recording_finish(struct recording *rec, bool success, const char *dir) {
+  uint64_t hash;
+
+  success = bs_stream_writer_finish(&rec->writer, &hash) && success;
+  success = close(rec->fd) == 0 && success;
+
+  if(success && rec->directory) {
+    char final[sizeof(rec->path)];
+    int len = snprintf(final, sizeof(final), "%s/%016llx.bsfs", dir,
+      (unsigned long long) hash);
+
+    success = len > 0 && (size_t) len < sizeof(final) && rename(rec->path, final) == 0;
+
+    if(success) {
+      strcpy(rec->path, final);
+    }
+  }
+
+  if(success) {
+    fprintf(status_out, "Recorded frames to %s\n", rec->path);
   } else {
-    view.bs_view_offset_x = 0;
+    unlink(rec->path);
   }
 
-  struct addrinfo *addrs;
-  struct addrinfo hints;
+  return success;
+}
+
+// the virtual canvas covers all panels
+void canvas_size(const struct panel *panels, size_t panels_len, int *width, int *height) {
+  *width = 0;
+  *height = 0;
+
+  for(size_t i = 0; i < panels_len; i++) {
+    if(panels[i].x + panels[i].width > *width) {
+      *width = panels[i].x + panels[i].width;
+    }
+    if(panels[i].y + panels[i].height > *height) {
+      *height = panels[i].y + panels[i].height;
+    }
+  }
+}
 
-  memset(&hints, 0, sizeof(hints));
+bool render_flipdot(struct panel *panels, size_t panels_len, const char *progname, bs_bitmap_t *bitmap, struct pipeline *pipeline, const struct playback *opts) {
+  enum render_mode mode = opts->mode;
+  bool invert = opts->invert;
+  bool grayscale = false;
 
-  hints.ai_family = family;
-  hints.ai_socktype = SOCK_DGRAM;
-  hints.ai_flags = AI_NUMERICSERV;
+  for(size_t i = 0; i < panels_len; i++) {
+    grayscale = grayscale || panels[i].format.bs_format_depth > 1;
+  }
 
-  if(getaddrinfo(host, port, &hints, &addrs) != 0) {
-    print_error(progname, "could not look up target host");
+  if(grayscale && opts->flip_budget > 0) {
+    print_error(progname, "flip budget only works with 1 bit per pixel");
     return false;
   }
 
-  int sockfd = socket(addrs->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+  for(size_t i = 0; i < panels_len && opts->transition_steps > 0; i++) {
+    if(panels[i].format.bs_format_scan != BS_SCAN_ROWS ||
+        panels[i].format.bs_format_depth != 1) {
+      print_error(progname, "transitions only work with rows of 1 bit per pixel");
+      return false;
+    }
+  }
+
+  int canvas_width;
+  int canvas_height;
+  canvas_size(panels, panels_len, &canvas_width, &canvas_height);
+
+  // panels with more than one bit per pixel need to be sent grayscale
+  // pixels, which doesn't make a difference for the other ones
+  unsigned char def = grayscale ? bs_pixel_to_grayscale(invert) : invert;
 
-  bool failure = false;
+  if(pipeline != NULL) {
+    // the pipeline's window takes the place of the rendered bitmap
+    pipeline->height = canvas_height;
+    pipeline->off = def;
+    pipeline->on = grayscale ? bs_pixel_to_grayscale(!invert) : !invert;
+    pipeline->window = bs_bitmap_new(canvas_width + STRIP_WIDTH, canvas_height,
+      pipeline->off);
 
-  if(sockfd < 0) {
-    print_error(progname, "could not create socket");
+    if(pipeline->window.bs_bitmap == NULL || !bs_ring_init(&pipeline->ring,
+        STRIP_SLOTS, sizeof(struct strip) + STRIP_WIDTH * canvas_height)) {
+      print_error(progname, "could not allocate pipeline");
+      bs_bitmap_free(&pipeline->window);
+      return false;
+    }
+
+    bitmap = &pipeline->window;
   } else {
-    bool multiple_frames = mode == RENDER_SCROLL ||
-      mode == RENDER_PAGE;
-    bool finished = false;
+    if(mode == RENDER_NORMAL && (bitmap->bs_bitmap_width < canvas_width ||
+        bitmap->bs_bitmap_height < canvas_height)) {
+      bs_bitmap_extend(bitmap, canvas_width, canvas_height, invert);
+    } else {
+      bs_bitmap_extend(bitmap, bitmap->bs_bitmap_width, canvas_height, invert);
+    }
+
+    if(grayscale) {
+      bs_bitmap_map(*bitmap, bs_pixel_to_grayscale);
+    }
+  }
+
+  struct display d;
+  memset(&d, 0, sizeof(struct display));
+
+  // initial state
+  d.mode = mode;
+  d.scroll_step = opts->scroll_step;
+  d.pipeline = pipeline;
+  d.start = opts->start;
+  d.def = def;
+  d.keepalive = opts->keepalive * 1e9;
+  d.flip_budget = opts->flip_budget;
+  d.transition = opts->transition;
+  d.transition_steps = opts->transition_steps;
+  d.converged = true;
+  d.hold = mode == RENDER_NORMAL && d.keepalive > 0 && !opts->offline;
+  d.panels = panels;
+  d.panels_len = panels_len;
+  d.view.bs_view_bitmap = *bitmap;
+  d.view.bs_view_width = canvas_width;
+  d.view.bs_view_height = canvas_height;
+  d.view.bs_view_offset_y = 0;
+
+  if(mode == RENDER_SCROLL && pipeline != NULL) {
+    // the length of the text is only known once it has been rendered
+    d.view.bs_view_offset_x = -canvas_width;
+  } else if(mode == RENDER_SCROLL) {
+    d.view.bs_view_offset_x = -canvas_width;
+
+    // all panels get as many frames as the scroll through the whole canvas
+    d.scroll_count = 1;
+    bs_view_t counter = d.view;
+    while(!bs_scroll_next_view(&counter, opts->scroll_step, BS_DIMENSION_X)) {
+      d.scroll_count++;
+    }
+  } else {
+    d.view.bs_view_offset_x = 0;
+  }
+
+  d.batch = calloc(panels_len, sizeof(bs_flipdot_frame_t));
+  d.batch_panels = calloc(panels_len, sizeof(uint32_t));
+  bool failure = d.batch == NULL || d.batch_panels == NULL;
+  size_t max_frame_size = 0;
 
-    if(multiple_frames) {
-      // TODO use sigaction
-      // TODO handle SIGINT and SIGTERM
-      signal(SIGALRM, ignore_signal);
+  for(size_t i = 0; i < panels_len && !failure; i++) {
+    struct panel *p = panels + i;
+    bs_view_t view = panel_view(d.view, p);
 
-      failure = setitimer(ITIMER_REAL, &delay, NULL) != 0;
+    if(p->format.bs_format_header_size > 0) {
+      p->format.bs_format_header = p->header;
     }
 
-    while(!finished && !failure) {
-      failure = bs_flipdot_render(sockfd, addrs->ai_addr,
-        addrs->ai_addrlen, view, invert) != 0;
+    p->frame_size = bs_frame_format_size(&p->format, p->width, p->height);
 
-      if(multiple_frames) {
-        // restore handler which is removed by sendto
-        signal(SIGALRM, ignore_signal);
+    // the whole scrolling animation is packed up front,
+    // so playing it back only involves sending frames
+    if(mode == RENDER_SCROLL && pipeline == NULL) {
+      p->scroll = pack_scroll_frames(view, &p->format, opts->scroll_step,
+        d.scroll_count, def);
+      failure = p->scroll.bs_frames_count == 0;
+    } else {
+      p->frame = malloc(p->frame_size);
+      failure = p->frame == NULL;
+    }
+
+    // the state of the panel is unknown, the first frame is sent regardless
+    p->next = NULL;
+    p->known = false;
+    p->shown = calloc(1, p->frame_size);
+    failure = failure || p->shown == NULL;
+
+    if(opts->flip_budget > 0 && opts->flip_order == BS_FLIP_ORDER_CHECKERBOARD) {
+      p->checkerboard = malloc(p->frame_size);
+      failure = failure || p->checkerboard == NULL || bs_frame_checkerboard(&p->format,
+        p->width, p->height, p->checkerboard, p->frame_size) == 0;
+    }
+
+    // only the pixel data of the shown frame is updated
+    if(p->shown != NULL && p->format.bs_format_header_size > 0) {
+      memcpy(p->shown, p->format.bs_format_header, p->format.bs_format_header_size);
+    }
+
+    if(opts->transition_steps > 0) {
+      p->from = malloc(p->frame_size);
+      failure = failure || p->from == NULL;
+
+      if(p->from != NULL && p->shown != NULL) {
+        memcpy(p->from, p->shown, p->frame_size);
+      }
+    }
+
+    if(p->frame_size > max_frame_size) {
+      max_frame_size = p->frame_size;
+    }
+
+    if(!failure) {
+      p->dest.bs_frame_size = p->frame_size;
+      p->dest.bs_frame_addr = (struct sockaddr *) &p->addr;
+      p->dest.bs_frame_addrlen = p->addrlen;
+      bs_frame_filter_init(&p->filter);
+    }
+  }
+
+  bs_shm_ring_t shm;
+  struct recording rec;
+
+  if(failure) {
+    print_error(progname, "could not allocate frames");
+  } else if(opts->shm_name != NULL) {
+    if(bs_shm_ring_create(&shm, opts->shm_name, SHM_SLOTS, max_frame_size)) {
+      d.shm = &shm;
+    } else {
+      print_error(progname, "could not create shared memory frame ring");
+      failure = true;
+    }
+  }
+
+  if(!failure && opts->record_path != NULL) {
+    d.record_frames = calloc(panels_len, sizeof(const uint8_t *));
+
+    if(d.record_frames != NULL &&
+        recording_start(&rec, opts->record_path, panels, panels_len)) {
+      d.recorder = &rec.writer;
+    } else {
+      print_error(progname, "could not create stream file");
+      failure = true;
+    }
+  }
+
+  // Without a flip budget or transition, every frame is shown in a single
+  // update, so both tasks run in lockstep. Otherwise intermediate frames
+  // are sent at the update rate until the panels show the current frame.
+  uint64_t period = 1e9 / opts->fps;
+  uint64_t update_period = opts->flip_budget > 0 || opts->transition_steps > 0
+    ? 1e9 / opts->update_fps : period;
+
+  d.update_period = update_period;
+  d.sockfd = -1;
+
+  if(!failure && opts->offline) {
+    failure = !run_offline(&d, period, update_period);
+  } else if(!failure) {
+    d.sockfd = socket(panels[0].addr.ss_family, SOCK_DGRAM, 0);
+
+    // a single display doesn't need the address passed on every frame
+    if(d.sockfd >= 0 && panels_len == 1) {
+      if(connect(d.sockfd, (struct sockaddr *) &panels[0].addr, panels[0].addrlen) != 0) {
+        close(d.sockfd);
+        d.sockfd = -1;
+      }
+
+      panels[0].dest.bs_frame_addr = NULL;
+    }
+
+    if(d.sockfd < 0) {
+      print_error(progname, "could not connect to target host");
+      failure = true;
+    }
+  }
+
+  if(!failure && !opts->offline) {
+    bs_scheduler_t scheduler;
+    bs_scheduler_init(&scheduler);
+
+    // stops the animation cleanly, so statistics and recordings are complete
+    scheduler.bs_scheduler_stop = &interrupted;
+
+    if(!bs_scheduler_add(&scheduler, period, display_animate, &d) ||
+        !bs_scheduler_add(&scheduler, update_period, display_update, &d)) {
+      print_error(progname, "could not schedule frames");
+      failure = true;
+    } else if(pipeline != NULL &&
+        pthread_create(&pipeline->thread, NULL, pipeline_render, pipeline) != 0) {
+      print_error(progname, "could not start rendering thread");
+      failure = true;
+    } else {
+      failure = !bs_scheduler_run(&scheduler);
+
+      if(pipeline != NULL) {
+        // stops the renderer if sending failed before everything was sent
+        __atomic_store_n(&pipeline->cancel, true, __ATOMIC_RELAXED);
+        pthread_join(pipeline->thread, NULL);
       }
 
-      if(mode == RENDER_SCROLL) {
-        finished = bs_scroll_next_view(&view, 1, BS_DIMENSION_X);
-      } else if(mode == RENDER_PAGE) {
-        finished = bs_page_next_view(&view, 1, BS_DIMENSION_X);
+      if(mode != RENDER_NORMAL) {
+        print_stats(&scheduler.bs_scheduler_tasks[0].bs_task_stats);
+        print_filter_stats(panels, panels_len);
+        print_flip_stats(&d.flips);
       }
 
-      if(!multiple_frames) {
-        finished = true;
-      } else if(!finished) {
-        pause();
+      if(d.first_frame != 0 && d.start != 0) {
+        fprintf(status_out, "  first frame sent %.1fms after rendering started",
+          (d.first_frame - d.start) / 1e6);
+
+        if(pipeline != NULL) {
+          fprintf(status_out, ", %llu frames waited for rendering",
+            (unsigned long long) pipeline->underruns);
+        }
+
+        fputc('\n', status_out);
       }
     }
 
-    const struct itimerval timer_off = { { 0, 0 }, { 0, 0 } };
-    setitimer(ITIMER_REAL, &timer_off, NULL);
+    bs_scheduler_free(&scheduler);
+
+    close(d.sockfd);
+  }
+
+  if(d.shm != NULL) {
+    bs_shm_ring_close(d.shm);
+  }
+
+  if(d.recorder != NULL &&
+      !recording_finish(&rec, !failure, opts->record_path)) {
+    print_error(progname, "could not record frames");
+    failure = true;
+  }
 
-    close(sockfd);
+  for(size_t i = 0; i < panels_len; i++) {
+    bs_frames_free(&panels[i].scroll);
+    free(panels[i].frame);
+    free(panels[i].shown);
+    free(panels[i].from);
+    free(panels[i].checkerboard);
+    panels[i].checkerboard = NULL;
+    panels[i].frame = NULL;
+    panels[i].shown = NULL;
+    panels[i].from = NULL;
   }
 
-  freeaddrinfo(addrs);
+  free(d.batch);
+  free(d.batch_panels);
+  free(d.record_frames);
+
+  if(pipeline != NULL) {
+    bs_ring_free(&pipeline->ring);
+    bs_bitmap_free(&pipeline->window);
+  }
 
   return !failure;
 }
@@ -163,6 +1392,11 @@ int main(int argc, char **argv) {
   const char *port = DEFAULT_PORT;
   const char *host = DEFAULT_HOST;
   const char *text;
+  const char *trace_path = NULL;
+  const char *wall_path = NULL;
+  const char *preview_path = NULL;
+  const char *shm_name = NULL;
+  const char *record_path = NULL;
   int font_size = -1;
   int flipdot_width  = DEFAULT_FLIPDOT_WIDTH;
   int flipdot_height = DEFAULT_FLIPDOT_HEIGHT;
@@ -170,8 +1404,19 @@ int main(int argc, char **argv) {
   bool invert = false;
   int ip_family = AF_UNSPEC;
   enum render_mode mode = RENDER_NORMAL;
-  struct itimerval delay;
-  memset(&delay, 0, sizeof(struct itimerval));
+  double fps = 0;
+  int scroll_step = DEFAULT_SCROLL_STEP;
+  double keepalive = 0;
+  int flip_budget = 0;
+  bs_frame_format_t format = bs_frame_format_flipdot();
+  uint8_t header[MAX_HEADER_SIZE] = { 0 };
+  enum bs_flip_order flip_order = BS_FLIP_ORDER_ROWS;
+  double update_fps = 0;
+  bool pipelined = false;
+  bool preview = true;
+  enum bs_transition transition = BS_TRANSITION_WIPE;
+  int transition_steps = 0;
+  enum bs_export_format preview_format = BS_EXPORT_BLOCKS;
 
   int opt;
   int fontcount = 0;
@@ -183,19 +1428,73 @@ int main(int argc, char **argv) {
 
   bool parse_error = false;
 
-  while(!parse_error && (opt = getopt(argc, argv, "SP46inh:p:s:f:?W:H:")) != -1) {
+  while(!parse_error && (opt = getopt(argc, argv, "SP46inclh:p:s:f:?W:H:T:r:x:w:k:b:u:F:o:O:m:t:R:")) != -1) {
     switch(opt) {
       case 'S':
         mode = RENDER_SCROLL;
-        memset(&delay, 0, sizeof(struct itimerval));
-        delay.it_interval.tv_usec = SCROLL_DELAY_MICROSECONDS;
-        delay.it_value.tv_usec = SCROLL_DELAY_MICROSECONDS;
         break;
       case 'P':
         mode = RENDER_PAGE;
-        memset(&delay, 0, sizeof(struct itimerval));
-        delay.it_interval.tv_sec = PAGE_DELAY_SECONDS;
-        delay.it_value.tv_sec = PAGE_DELAY_SECONDS;
+        break;
+      case 'r':
+        if(!parse_positive_double(optarg, &fps)) {
+          print_error(argv[0], "frame rate passed is not a positive number");
+          parse_error = true;
+        }
+        break;
+      case 'x':
+        if(!parse_positive_int(optarg, &scroll_step)) {
+          print_error(argv[0], "scroll step passed is not a positive integer");
+          parse_error = true;
+        }
+        break;
+      case 'k':
+        if(!parse_positive_double(optarg, &keepalive)) {
+          print_error(argv[0], "keep-alive interval passed is not a positive number");
+          parse_error = true;
+        }
+        break;
+      case 'b':
+        if(!parse_positive_int(optarg, &flip_budget)) {
+          print_error(argv[0], "flip budget passed is not a positive integer");
+          parse_error = true;
+        }
+        break;
+      case 'F':
+        if(!parse_format(optarg, &format, header)) {
+          print_error(argv[0], "invalid wire format");
+          parse_error = true;
+        }
+        break;
+      case 'o':
+        if(!parse_preview(optarg, &preview, &preview_format)) {
+          print_error(argv[0], "unknown picture format");
+          parse_error = true;
+        }
+        break;
+      case 'O':
+        preview_path = optarg;
+        break;
+      case 'm':
+        shm_name = optarg;
+        break;
+      case 'R':
+        record_path = optarg;
+        break;
+      case 't':
+        if(!parse_transition(optarg, &transition, &transition_steps)) {
+          print_error(argv[0], "unknown transition");
+          parse_error = true;
+        }
+        break;
+      case 'c':
+        flip_order = BS_FLIP_ORDER_CHECKERBOARD;
+        break;
+      case 'u':
+        if(!parse_positive_double(optarg, &update_fps)) {
+          print_error(argv[0], "update rate passed is not a positive number");
+          parse_error = true;
+        }
         break;
       case '4':
         ip_family = AF_INET;
@@ -209,33 +1508,36 @@ int main(int argc, char **argv) {
       case 'n':
         dry_run = true;
         break;
+      case 'l':
+        pipelined = true;
+        break;
       case 'h':
         host = optarg;
         break;
       case 'p':
         port = optarg;
         break;
+      case 'T':
+        trace_path = optarg;
+        break;
+      case 'w':
+        wall_path = optarg;
+        break;
       case 'W':
-        errno = 0;
-        flipdot_width = atoi(optarg);
-        if(errno != 0 || flipdot_width <= 0) {
-          print_error(argv[0], "flipdot width passed is not an integer");
+        if(!parse_positive_int(optarg, &flipdot_width)) {
+          print_error(argv[0], "flipdot width passed is not a positive integer");
           parse_error = true;
         }
         break;
       case 'H':
-        errno = 0;
-        flipdot_height = atoi(optarg);
-        if(errno != 0 || flipdot_height <= 0) {
-          print_error(argv[0], "flipdot height passed is not an integer");
+        if(!parse_positive_int(optarg, &flipdot_height)) {
+          print_error(argv[0], "flipdot height passed is not a positive integer");
           parse_error = true;
         }
         break;
       case 's':
-        errno = 0;
-        font_size = atoi(optarg);
-        if(errno != 0 || font_size <= 0) {
-          print_error(argv[0], "font size passed is not an integer");
+        if(!parse_positive_int(optarg, &font_size)) {
+          print_error(argv[0], "font size passed is not a positive integer");
           parse_error = true;
         }
         break;
@@ -268,6 +1570,16 @@ int main(int argc, char **argv) {
     print_error(argv[0], "missing TEXT argument");
   }
 
+  if(pipelined && (mode != RENDER_SCROLL || dry_run)) {
+    parse_error = true;
+    print_error(argv[0], "-l only works when scrolling onto a display");
+  }
+
+  if(transition_steps > 0 && (mode == RENDER_SCROLL || flip_budget > 0)) {
+    parse_error = true;
+    print_error(argv[0], "-t can't be combined with -S or -b");
+  }
+
   if(parse_error) {
     bs_context_free(&ctx);
     print_usage(argv[0]);
@@ -280,31 +1592,141 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  if(trace_path != NULL && !bs_trace_start(TRACE_CAPACITY)) {
+    bs_context_free(&ctx);
+    print_error(argv[0], "could not enable tracing");
+    return 1;
+  }
+
+  if(fps <= 0) {
+    fps = mode == RENDER_PAGE ? DEFAULT_PAGE_FPS : DEFAULT_SCROLL_FPS;
+  }
+
+  if(update_fps <= 0) {
+    update_fps = fps > DEFAULT_UPDATE_FPS ? fps : DEFAULT_UPDATE_FPS;
+  }
+
   int status = 0;
+  struct panel *panels = NULL;
+  size_t panels_len = 0;
+
+  // binary pictures written to stdout mustn't be mixed with text
+  status_out = preview && preview_path == NULL && preview_format != BS_EXPORT_BLOCKS
+    && preview_format != BS_EXPORT_HALF_BLOCKS ? stderr : stdout;
+
+  // the display is set up first, so it is known how much of the text
+  // can be shown at all before rendering it, which also applies to
+  // recording without sending
+  if(!dry_run || record_path != NULL) {
+    if(wall_path != NULL) {
+      if(load_wall(wall_path, ip_family, &format, header, argv[0], &panels, &panels_len)
+          && !dry_run) {
+        fprintf(status_out, "Sending image to %zu panels of %s\n", panels_len, wall_path);
+      }
+    } else {
+      panels = calloc(1, sizeof(struct panel));
+
+      if(panels == NULL) {
+        print_error(argv[0], "could not allocate memory");
+      } else if(!dry_run && !bs_flipdot_resolve(host, port, ip_family, &panels[0].addr,
+          &panels[0].addrlen)) {
+        print_error(argv[0], "could not look up target host");
+        free(panels);
+        panels = NULL;
+      } else {
+        panels_len = 1;
+        panels[0].width = flipdot_width;
+        panels[0].height = flipdot_height;
+        panels[0].format = format;
+        memcpy(panels[0].header, header, MAX_HEADER_SIZE);
+
+        if(!dry_run) {
+          fprintf(status_out, "Sending image to %s:%s\n", host, port);
+        }
+      }
+    }
+
+    if(panels == NULL) {
+      status = 1;
+    }
+  }
 
   text = argv[optind];
   size_t text_len = strlen(text);
 
-  bs_bitmap_t bitmap = bs_render_utf8_string(&ctx, text, text_len);
+  uint64_t render_start = bs_clock_now();
+  bs_bitmap_t bitmap = { NULL, 0, 0 };
+  struct pipeline pipeline;
+  memset(&pipeline, 0, sizeof(pipeline));
 
-  if(!dry_run) {
-    puts("Rendered image:");
-  }
+  if(status != 0) {
+    // nowhere to send the text to
+  } else if(pipelined) {
+    // the text is rendered while sending, so it can't be printed upfront
+    pipeline.ctx = &ctx;
 
-  if(invert) {
-    bs_bitmap_map(bitmap, bs_pixel_invert_binary);
+    // decoded upfront, so invalid input is reported before anything is sent
+    if(bs_utf32_buffer_append_utf8(&pipeline.str, text, text_len) != BS_DECODE_OK) {
+      print_error(argv[0], "could not decode text");
+      status = 1;
+    }
+  } else {
+    // without scrolling or paging everything beyond the display is cut off
+    if(mode == RENDER_NORMAL && panels != NULL) {
+      canvas_size(panels, panels_len, &ctx.bs_clip_width, &ctx.bs_clip_height);
+    }
+
+    bitmap = bs_render_utf8_string(&ctx, text, text_len);
+
+    if(invert) {
+      bs_bitmap_map(bitmap, bs_pixel_invert_binary);
+    }
+
+    if(preview) {
+      if(!dry_run && preview_path == NULL && status_out == stdout) {
+        puts("Rendered image:");
+      }
+
+      if(!write_preview(preview_path, bitmap, preview_format, &format)) {
+        print_error(argv[0], "could not write picture");
+        status = 1;
+      }
+    }
   }
 
-  bs_bitmap_print(bitmap, true);
+  if(status == 0 && (!dry_run || record_path != NULL)) {
+    // no SA_RESTART, so the scheduler's sleep is interrupted as well
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
-  if(!dry_run) {
-    printf("Sending image to %s:%s\n", host, port);
+    struct playback opts = {
+      mode, fps, scroll_step, invert, keepalive,
+      flip_budget, flip_order, update_fps, transition, transition_steps,
+      render_start, shm_name, record_path, dry_run,
+    };
 
-    if(!render_flipdot(host, port, ip_family, argv[0], &bitmap, mode, delay, flipdot_width, flipdot_height, invert)) {
+    if(!render_flipdot(panels, panels_len, argv[0],
+        pipelined ? NULL : &bitmap, pipelined ? &pipeline : NULL, &opts)) {
       status = 1;
     }
   }
 
+  free(panels);
+
+  if(trace_path != NULL) {
+    if(!bs_trace_write(trace_path)) {
+      print_error(argv[0], "could not write trace file");
+      status = 1;
+    }
+
+    bs_trace_stop();
+  }
+
+  bs_utf32_buffer_free(&pipeline.str);
   bs_bitmap_free(&bitmap);
   bs_context_free(&ctx);
 
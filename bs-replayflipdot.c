@@ -0,0 +1,407 @@
+#define _POSIX_C_SOURCE 200112L /* getopt, getaddrinfo, sigaction, ... */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <buchstabensuppe.h>
+
+#define DEFAULT_HOST "localhost"
+#define DEFAULT_PORT "2323"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void handle_interrupt(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+void print_error(const char *name, const char *err) {
+  fputs(name, stderr);
+  fputs(": ", stderr);
+  fputs(err, stderr);
+  fputc('\n', stderr);
+}
+
+void print_usage(const char *name) {
+  size_t name_len = strlen(name);
+
+  fputs(name, stderr);
+  fputs(" [-4|-6] [-h HOST] [-p PORT] [-w WALLFILE] [-k SECONDS]\n", stderr);
+
+  for(size_t i = 0; i < name_len; i++) {
+    fputc(' ', stderr);
+  }
+  fputs(" [-l] [-i] STREAMFILE\n", stderr);
+
+  fputs(name, stderr);
+  fputs(" -?\n", stderr);
+
+  fprintf(stderr,
+    "\n"
+    "  -h    hostname of the flipdots to use (default: %s)\n"
+    "  -p    port of the flipdots to use (default: %s)\n"
+    "  -w    send to the panels listed in the given file, in recorded order\n"
+    "  -k    resend unchanged frames after the given number of seconds\n"
+    "  -l    loop the stream until interrupted\n"
+    "  -i    print information about the stream and exit\n"
+    "  -4    only use IPv4 for connecting\n"
+    "  -6    only use IPv6 for connecting\n"
+    "  -?    display this help screen\n",
+    DEFAULT_HOST, DEFAULT_PORT);
+}
+
+struct destination {
+  struct sockaddr_storage  addr;
+  socklen_t                addrlen;
+};
+
+struct replay {
+  const bs_stream_t   *stream;
+  int                  sockfd;
+  bool                 loop;
+  uint64_t             keepalive;
+
+  uint64_t             index;
+  bs_schedule_task_t  *task;
+
+  bs_flipdot_frame_t  *dests;
+  bs_flipdot_frame_t  *batch;
+  bs_frame_filter_t   *filters;
+};
+
+// sends the next record and waits for as long as it is shown
+enum bs_tick_result replay_tick(void *user) {
+  struct replay *r = user;
+  const bs_stream_t *s = r->stream;
+  uint64_t now = bs_clock_now();
+  size_t batch_len = 0;
+
+  if(interrupted) {
+    return BS_TICK_FINISHED;
+  }
+
+  for(size_t i = 0; i < s->bs_stream_panels_len; i++) {
+    const uint8_t *frame = bs_stream_frame(s, r->index, i);
+    size_t size = s->bs_stream_panels[i].bs_panel_frame_size;
+
+    if(bs_frame_filter_check(r->filters + i, frame, size, now, r->keepalive)) {
+      r->batch[batch_len] = r->dests[i];
+      r->batch[batch_len].bs_frame_data = frame;
+      batch_len++;
+    }
+  }
+
+  if(batch_len > 0 && bs_flipdot_send_frames(r->sockfd, r->batch, batch_len)
+      != (ssize_t) batch_len) {
+    return BS_TICK_ERROR;
+  }
+
+  r->task->bs_task_period = bs_stream_frame_duration(s, r->index);
+
+  if(++r->index >= s->bs_stream_records) {
+    if(!r->loop) {
+      return BS_TICK_FINISHED;
+    }
+
+    r->index = 0;
+  }
+
+  return BS_TICK_CONTINUE;
+}
+
+// reads HOST PORT from every line, like bs-renderflipdot's wall files
+bool load_wall(const char *path, int family, const char *progname,
+  struct destination *dests, size_t dests_len) {
+  FILE *wall = fopen(path, "r");
+
+  if(wall == NULL) {
+    print_error(progname, "could not open wall configuration");
+    return false;
+  }
+
+  char line[512];
+  size_t count = 0;
+  bool success = true;
+
+  while(success && fgets(line, sizeof(line), wall) != NULL) {
+    char host[256];
+    char port[32];
+
+    char *comment = strchr(line, '#');
+    if(comment != NULL) {
+      *comment = '\0';
+    }
+
+    int fields = sscanf(line, "%255s %31s", host, port);
+
+    if(fields <= 0) {
+      continue; // empty line
+    }
+
+    if(fields < 2) {
+      print_error(progname, "malformed panel in wall configuration");
+      success = false;
+    } else if(count >= dests_len) {
+      print_error(progname, "wall configuration has more panels than the stream");
+      success = false;
+    } else if(!bs_flipdot_resolve(host, port, family, &dests[count].addr,
+        &dests[count].addrlen)) {
+      print_error(progname, "could not look up panel host");
+      success = false;
+    } else if(count > 0 && dests[count].addr.ss_family != dests[0].addr.ss_family) {
+      print_error(progname, "all panels must use the same address family");
+      success = false;
+    } else {
+      count++;
+    }
+  }
+
+  fclose(wall);
+
+  if(success && count != dests_len) {
+    print_error(progname, "wall configuration has fewer panels than the stream");
+    success = false;
+  }
+
+  return success;
+}
+
+void print_info(const bs_stream_t *s) {
+  printf("Stream %016llx: %llu frames, %.3fs\n",
+    (unsigned long long) s->bs_stream_hash,
+    (unsigned long long) s->bs_stream_records, s->bs_stream_duration / 1e9);
+
+  for(size_t i = 0; i < s->bs_stream_panels_len; i++) {
+    const bs_stream_panel_t *p = s->bs_stream_panels + i;
+
+    printf("  panel %zu: %dx%d at %d,%d, %zu bytes per frame\n", i,
+      p->bs_panel_width, p->bs_panel_height, p->bs_panel_x, p->bs_panel_y,
+      p->bs_panel_frame_size);
+  }
+}
+
+void print_stats(const bs_schedule_stats_t *stats) {
+  uint64_t frames = stats->bs_stats_frames;
+
+  printf("Played %llu frames, %llu deadlines missed\n",
+    (unsigned long long) frames, (unsigned long long) stats->bs_stats_missed);
+
+  if(frames == 0) {
+    return;
+  }
+
+  printf("  lateness: avg %lluus max %lluus\n",
+    (unsigned long long) (stats->bs_stats_lateness_sum / frames / 1000),
+    (unsigned long long) (stats->bs_stats_lateness_max / 1000));
+  bs_schedule_histogram_print(stdout, "lateness",
+    stats->bs_stats_lateness_histogram, "us");
+
+  if(frames > 1) {
+    printf("  jitter: avg %lluus max %lluus\n",
+      (unsigned long long) (stats->bs_stats_jitter_sum / (frames - 1) / 1000),
+      (unsigned long long) (stats->bs_stats_jitter_max / 1000));
+    bs_schedule_histogram_print(stdout, "jitter",
+      stats->bs_stats_jitter_histogram, "us");
+  }
+}
+
+bool replay(const bs_stream_t *s, struct destination *dests, bool loop,
+  double keepalive, const char *progname) {
+  size_t panels_len = s->bs_stream_panels_len;
+  struct replay r;
+  memset(&r, 0, sizeof(r));
+
+  r.stream = s;
+  r.loop = loop;
+  r.keepalive = keepalive * 1e9;
+  r.dests = calloc(panels_len, sizeof(bs_flipdot_frame_t));
+  r.batch = calloc(panels_len, sizeof(bs_flipdot_frame_t));
+  r.filters = calloc(panels_len, sizeof(bs_frame_filter_t));
+  r.sockfd = -1;
+
+  bool failure = r.dests == NULL || r.batch == NULL || r.filters == NULL;
+
+  if(failure) {
+    print_error(progname, "could not allocate memory");
+  } else {
+    r.sockfd = socket(dests[0].addr.ss_family, SOCK_DGRAM, 0);
+    failure = r.sockfd < 0;
+
+    for(size_t i = 0; i < panels_len; i++) {
+      r.dests[i].bs_frame_size = s->bs_stream_panels[i].bs_panel_frame_size;
+      r.dests[i].bs_frame_addr = (struct sockaddr *) &dests[i].addr;
+      r.dests[i].bs_frame_addrlen = dests[i].addrlen;
+      bs_frame_filter_init(r.filters + i);
+    }
+
+    // a single display doesn't need the address passed on every frame
+    if(!failure && panels_len == 1) {
+      failure = connect(r.sockfd, (struct sockaddr *) &dests[0].addr,
+        dests[0].addrlen) != 0;
+      r.dests[0].bs_frame_addr = NULL;
+    }
+
+    if(failure) {
+      print_error(progname, "could not connect to target host");
+    }
+  }
+
+  if(!failure) {
+    bs_scheduler_t scheduler;
+    bs_scheduler_init(&scheduler);
+
+    // the period is set to the duration of every frame as it is sent
+    if(!bs_scheduler_add(&scheduler, bs_stream_frame_duration(s, 0), replay_tick, &r)) {
+      print_error(progname, "could not schedule frames");
+      failure = true;
+    } else {
+      r.task = scheduler.bs_scheduler_tasks;
+      failure = !bs_scheduler_run(&scheduler);
+
+      if(failure) {
+        print_error(progname, "could not send frames");
+      }
+
+      print_stats(&r.task->bs_task_stats);
+    }
+
+    bs_scheduler_free(&scheduler);
+  }
+
+  if(r.sockfd >= 0) {
+    close(r.sockfd);
+  }
+
+  free(r.dests);
+  free(r.batch);
+  free(r.filters);
+
+  return !failure;
+}
+
+int main(int argc, char **argv) {
+  const char *host = DEFAULT_HOST;
+  const char *port = DEFAULT_PORT;
+  const char *wall_path = NULL;
+  int family = AF_UNSPEC;
+  double keepalive = 0;
+  bool loop = false;
+  bool info = false;
+
+  int opt;
+  bool parse_error = false;
+
+  while(!parse_error && (opt = getopt(argc, argv, "46lih:p:w:k:?")) != -1) {
+    switch(opt) {
+      case '4':
+        family = AF_INET;
+        break;
+      case '6':
+        family = AF_INET6;
+        break;
+      case 'l':
+        loop = true;
+        break;
+      case 'i':
+        info = true;
+        break;
+      case 'h':
+        host = optarg;
+        break;
+      case 'p':
+        port = optarg;
+        break;
+      case 'w':
+        wall_path = optarg;
+        break;
+      case 'k':
+        errno = 0;
+        keepalive = strtod(optarg, NULL);
+        if(errno != 0 || keepalive <= 0) {
+          print_error(argv[0], "keep-alive interval passed is not a positive number");
+          parse_error = true;
+        }
+        break;
+      case '?':
+        print_usage(argv[0]);
+        return 0;
+        break;
+      default:
+        parse_error = true;
+        break;
+    }
+  }
+
+  if(!parse_error && optind >= argc) {
+    print_error(argv[0], "missing STREAMFILE argument");
+    parse_error = true;
+  }
+
+  if(parse_error) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  bs_stream_t stream;
+
+  if(!bs_stream_open(&stream, argv[optind])) {
+    print_error(argv[0], errno == EINVAL
+      ? "not a valid stream file" : "could not open stream file");
+    return 1;
+  }
+
+  // reading everything once also means no page faults during playback
+  if(!bs_stream_verify(&stream)) {
+    print_error(argv[0], "stream file is corrupted");
+    bs_stream_close(&stream);
+    return 1;
+  }
+
+  if(info || stream.bs_stream_records == 0) {
+    print_info(&stream);
+    bs_stream_close(&stream);
+    return 0;
+  }
+
+  int status = 0;
+  size_t panels_len = stream.bs_stream_panels_len;
+  struct destination *dests = calloc(panels_len, sizeof(struct destination));
+
+  if(dests == NULL) {
+    print_error(argv[0], "could not allocate memory");
+    status = 1;
+  } else if(wall_path != NULL) {
+    if(!load_wall(wall_path, family, argv[0], dests, panels_len)) {
+      status = 1;
+    }
+  } else if(panels_len != 1) {
+    print_error(argv[0], "stream has several panels, use -w");
+    status = 1;
+  } else if(!bs_flipdot_resolve(host, port, family, &dests[0].addr, &dests[0].addrlen)) {
+    print_error(argv[0], "could not look up target host");
+    status = 1;
+  }
+
+  if(status == 0) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_interrupt;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if(!replay(&stream, dests, loop, keepalive, argv[0])) {
+      status = 1;
+    }
+  }
+
+  free(dests);
+  bs_stream_close(&stream);
+
+  return status;
+}
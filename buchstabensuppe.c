@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -21,30 +22,72 @@
   fprintf(stderr, __VA_ARGS__); \
   fputc('\n', stderr);
 
+static bool render_utf32_string(bs_context_t *, bs_bitmap_t *,
+  bs_display_list_t *, bs_cursor_t *, bs_utf32_buffer_t);
+static bool render_grapheme(bs_context_t *, bs_bitmap_t *, bs_display_list_t *,
+  bs_cursor_t *, bs_utf32_buffer_t, size_t, size_t);
+static void analyze_simple_codepoints(bs_font_t *);
+
 // context management
 
 void bs_context_init(bs_context_t *ctx) {
+  bs_context_init_allocator(ctx, bs_allocator_default());
+}
+
+void bs_context_init_allocator(bs_context_t *ctx, bs_allocator_t allocator) {
+#ifdef BS_STATIC_MEMORY
+  bs_context_init_scratch(ctx, allocator, ctx->bs_scratch, sizeof(ctx->bs_scratch));
+#else
   ctx->bs_fonts = NULL;
   ctx->bs_fonts_len = 0;
   ctx->bs_rendering_flags = 0;
+  ctx->bs_clip_width = 0;
+  ctx->bs_clip_height = 0;
+  ctx->bs_allocator = allocator;
+  ctx->bs_hb_buffer = NULL;
+
+  bs_arena_init(&ctx->bs_arena, allocator);
+#endif
+}
+
+void bs_context_init_scratch(bs_context_t *ctx, bs_allocator_t allocator, void *scratch, size_t size) {
+  ctx->bs_fonts = NULL;
+  ctx->bs_fonts_len = 0;
+  ctx->bs_rendering_flags = 0;
+  ctx->bs_clip_width = 0;
+  ctx->bs_clip_height = 0;
+  ctx->bs_allocator = allocator;
+  ctx->bs_hb_buffer = NULL;
+
+  bs_arena_init_buffer(&ctx->bs_arena, scratch, size);
 }
 
 void bs_context_free(bs_context_t *ctx) {
+  bs_allocator_t *a = &ctx->bs_allocator;
+
   for(size_t i = 0; i < ctx->bs_fonts_len; i++) {
     sft_freefont(ctx->bs_fonts[i].bs_font_schrift);
-    free(ctx->bs_fonts[i].bs_font_file);
+    a->bs_allocator_free(a->bs_allocator_user, ctx->bs_fonts[i].bs_font_file);
     hb_font_destroy(ctx->bs_fonts[i].bs_font_hb);
   }
 
   if(ctx->bs_fonts != NULL) {
-    free(ctx->bs_fonts);
+    a->bs_allocator_free(a->bs_allocator_user, ctx->bs_fonts);
+  }
+
+  if(ctx->bs_hb_buffer != NULL) {
+    hb_buffer_destroy(ctx->bs_hb_buffer);
   }
 
+  bs_arena_free(&ctx->bs_arena);
+
   ctx->bs_fonts = NULL;
   ctx->bs_fonts_len = 0;
+  ctx->bs_hb_buffer = NULL;
 }
 
 bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsigned int pixel_height) {
+  bs_allocator_t *a = &ctx->bs_allocator;
   struct stat finfo;
   memset(&finfo, 0, sizeof(struct stat));
 
@@ -59,7 +102,8 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
   }
 
   size_t file_buffer_size = finfo.st_size;
-  unsigned char *file_buffer = malloc(sizeof(unsigned char) * file_buffer_size);
+  unsigned char *file_buffer = a->bs_allocator_malloc(a->bs_allocator_user,
+    sizeof(unsigned char) * file_buffer_size);
 
   if(file_buffer == NULL) {
     LOG("Error: Could not allocate memory");
@@ -70,7 +114,7 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
 
   if(font_file == NULL) {
     LOG("Error: Could not open file %s", font_path);
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
     return false;
   }
 
@@ -80,7 +124,7 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
   if(!feof(font_file) && read == file_buffer_size * sizeof(unsigned char)) {
     LOG("Error: did not read font file fully");
     fclose(font_file);
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
   }
 
   fclose(font_file);
@@ -89,7 +133,7 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
 
   if(sft_font == NULL) {
     LOG("Error: sft_loadmem failed");
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
     return false;
   }
 
@@ -99,7 +143,7 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
   if(hb_blob_get_length(file) == 0) {
     LOG("Error: could not create harfbuzz blob");
     hb_blob_destroy(file);
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
     return false;
   }
 
@@ -108,7 +152,7 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
 
   if(hb_face_get_glyph_count(face) == 0) {
     LOG("Error: could not create harfbuzz face");
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
     return false;
   }
 
@@ -117,21 +161,41 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
 
   if(font == NULL) {
     LOG("Error: could not create harfbuzz font");
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
     return false;
   }
 
   hb_font_set_scale(font, pixel_height * FONT_SCALE_MULTIPLIER,
       pixel_height * FONT_SCALE_MULTIPLIER);
 
+#ifdef BS_STATIC_MEMORY
+  // HarfBuzz allocates its buffer and the font's shape plan on first use,
+  // so both are done here while the program is still starting up. The
+  // buffer comes first, as the font can't be taken back once it is added.
+  if(ctx->bs_hb_buffer == NULL) {
+    ctx->bs_hb_buffer = hb_buffer_create();
+
+    if(!hb_buffer_pre_allocate(ctx->bs_hb_buffer, BS_STATIC_MAX_TEXT_LENGTH)) {
+      LOG("Error: could not allocate harfbuzz buffer");
+      hb_buffer_destroy(ctx->bs_hb_buffer);
+      ctx->bs_hb_buffer = NULL;
+      hb_font_destroy(font);
+      sft_freefont(sft_font);
+      a->bs_allocator_free(a->bs_allocator_user, file_buffer);
+      return false;
+    }
+  }
+#endif
+
   size_t new_index = ctx->bs_fonts_len;
 
-  bs_font_t *tmp = realloc(ctx->bs_fonts, sizeof(bs_font_t) * (new_index + 1));
+  bs_font_t *tmp = a->bs_allocator_realloc(a->bs_allocator_user, ctx->bs_fonts,
+    sizeof(bs_font_t) * (new_index + 1));
 
   if(tmp == NULL) {
     LOG("Error: couldn't allocate memory");
     hb_font_destroy(font);
-    free(file_buffer);
+    a->bs_allocator_free(a->bs_allocator_user, file_buffer);
     return false;
   }
 
@@ -144,15 +208,105 @@ bool bs_add_font(bs_context_t *ctx, const char *font_path, int font_index, unsig
   ctx->bs_fonts[new_index].bs_font_file_size = file_buffer_size;
   ctx->bs_fonts[new_index].bs_font_pixel_height = pixel_height;
 
+  uint64_t analyze_start = bs_trace_begin();
+  analyze_simple_codepoints(ctx->bs_fonts + new_index);
+  bs_trace_end("analyze", analyze_start, "font", new_index);
+
+#ifdef BS_STATIC_MEMORY
+  // the shape plan is made on first use as well, so shape something now
+  const uint32_t sample = 'A';
+  hb_buffer_clear_contents(ctx->bs_hb_buffer);
+  hb_buffer_add_utf32(ctx->bs_hb_buffer, &sample, 1, 0, 1);
+  hb_buffer_guess_segment_properties(ctx->bs_hb_buffer);
+  hb_shape(font, ctx->bs_hb_buffer, NULL, 0);
+#endif
+
   return true;
 }
 
+// Finds the codepoints the font can lay out without shaping: if a glyph
+// isn't touched by any GSUB or GPOS lookup, shaping a lone codepoint
+// mapped to it can't do anything but look it up in the cmap and use its
+// advance. Graphemes are shaped on their own, so pair kerning never
+// applies between them. Codepoints missing from the font are left to
+// HarfBuzz, which may still compose them from other glyphs.
+static void analyze_simple_codepoints(bs_font_t *font) {
+  hb_face_t *face = hb_font_get_face(font->bs_font_hb);
+  hb_set_t *lookups = hb_set_create();
+  hb_set_t *glyphs = hb_set_create();
+  const hb_tag_t tables[2] = { HB_OT_TAG_GSUB, HB_OT_TAG_GPOS };
+
+  memset(font->bs_font_simple_glyphs, 0, sizeof(font->bs_font_simple_glyphs));
+  font->bs_font_monospace_advance = 0;
+
+  if(!hb_set_allocation_successful(lookups) || !hb_set_allocation_successful(glyphs)) {
+    hb_set_destroy(lookups);
+    hb_set_destroy(glyphs);
+    return;
+  }
+
+  for(size_t t = 0; t < 2; t++) {
+    hb_set_clear(lookups);
+    hb_ot_layout_collect_lookups(face, tables[t], NULL, NULL, NULL, lookups);
+
+    hb_codepoint_t lookup = HB_SET_VALUE_INVALID;
+    while(hb_set_next(lookups, &lookup)) {
+      // context glyphs count as well, the lookup might still apply
+      hb_ot_layout_lookup_collect_glyphs(face, tables[t], lookup,
+        glyphs, glyphs, glyphs, glyphs);
+    }
+  }
+
+  bool monospace = true;
+  int advance = 0;
+
+  for(uint32_t c = 0; c < BS_SIMPLE_CODEPOINTS; c++) {
+    hb_codepoint_t glyph = 0;
+
+    // controls and the default ignorable soft hyphen get special treatment
+    if(c < 0x20 || (c >= 0x7f && c < 0xa0) || c == 0xad ||
+        !hb_font_get_nominal_glyph(font->bs_font_hb, c, &glyph) ||
+        glyph == 0 || hb_set_has(glyphs, glyph)) {
+      continue;
+    }
+
+    font->bs_font_simple_glyphs[c] = glyph;
+    font->bs_font_simple_advances[c] =
+      hb_font_get_glyph_h_advance(font->bs_font_hb, glyph);
+
+    if(advance == 0) {
+      advance = font->bs_font_simple_advances[c];
+    }
+
+    monospace = monospace && font->bs_font_simple_advances[c] == advance;
+  }
+
+  font->bs_font_monospace_advance = monospace ? advance : 0;
+
+  hb_set_destroy(lookups);
+  hb_set_destroy(glyphs);
+}
+
 // font rendering
 
-bool bs_cursor_insert(bs_bitmap_t *dst, bs_cursor_t *cursor, int offset_x, int offset_y, int advance_x, int advance_y, bs_bitmap_t src) {
+static bool clip_enabled(bs_context_t *ctx) {
+  return ctx->bs_clip_width > 0 && ctx->bs_clip_height > 0;
+}
+
+// copies src to the cursor moved by the offset, extending dst as needed
+// but never beyond the clip of ctx, and advances the cursor
+static bool bs_cursor_insert(bs_context_t *ctx, bs_bitmap_t *dst, bs_cursor_t *cursor, int offset_x, int offset_y, int advance_x, int advance_y, bs_bitmap_t src) {
   int required_width = cursor->bs_cursor_x + offset_x + src.bs_bitmap_width;
   int required_height = cursor->bs_cursor_y + offset_y + src.bs_bitmap_height;
 
+  // the bitmap never grows beyond the clip, bs_bitmap_copy() cuts off the rest
+  if(clip_enabled(ctx)) {
+    required_width = required_width < ctx->bs_clip_width
+      ? required_width : ctx->bs_clip_width;
+    required_height = required_height < ctx->bs_clip_height
+      ? required_height : ctx->bs_clip_height;
+  }
+
   if(required_width > dst->bs_bitmap_width ||
       required_height > dst->bs_bitmap_height) {
     bool success = bs_bitmap_extend(dst, required_width, required_height, 0);
@@ -171,53 +325,410 @@ bool bs_cursor_insert(bs_bitmap_t *dst, bs_cursor_t *cursor, int offset_x, int o
   return true;
 }
 
-bs_bitmap_t bs_render_utf8_string(bs_context_t *ctx, const char *s, size_t l) {
-  bs_bitmap_t b = { NULL, 0, 0 };
+// renders s into either a bitmap or a display list
+static bool render_utf8(bs_context_t *ctx, bs_bitmap_t *b, bs_display_list_t *list, const char *s, size_t l) {
   bs_cursor_t cursor = { 0, 0 };
+  bool success = true;
 
   if(l > 0) {
-    bs_utf32_buffer_t buf = bs_decode_utf8(s, l);
+    // the decoded string lives in the arena, so it needs no buffer
+    // management and is released in one go with all other temporaries
+    bs_utf32_buffer_t buf;
+    buf.bs_utf32_buffer = bs_arena_alloc(&ctx->bs_arena, sizeof(uint32_t) * l);
+    buf.bs_utf32_buffer_cap = l;
+    buf.bs_utf32_buffer_len = 0;
+
+    uint64_t trace_start = bs_trace_begin();
+    bool decoded = buf.bs_utf32_buffer != NULL && bs_utf8_decode(s, l,
+      buf.bs_utf32_buffer, &buf.bs_utf32_buffer_len) == BS_DECODE_OK;
+    bs_trace_end("decode", trace_start, "codepoints", buf.bs_utf32_buffer_len);
 
-    if(errno == 0) {
-      if(!bs_render_utf32_string_append(ctx, &b, &cursor, buf)) {
-        // TODO, but probably best option because bs_decode_utf8 will return EINVAL
+    errno = 0;
+
+    if(buf.bs_utf32_buffer == NULL) {
+      errno = ENOMEM;
+      success = false;
+    } else if(!decoded) {
+      errno = EINVAL;
+      success = false;
+    } else if(!render_utf32_string(ctx, b, list, &cursor, buf)) {
+      // running out of fixed scratch memory is reported as such
+      if(errno != ENOMEM) {
         errno = EIO;
       }
+      success = false;
     }
 
-    bs_utf32_buffer_free(&buf);
+    bs_arena_reset(&ctx->bs_arena);
   }
 
+  return success;
+}
+
+bs_bitmap_t bs_render_utf8_string(bs_context_t *ctx, const char *s, size_t l) {
+  bs_bitmap_t b = { NULL, 0, 0 };
+
+  // everything rendered fits, so the bitmap never needs to be extended
+  if(clip_enabled(ctx)) {
+    b = bs_bitmap_new(ctx->bs_clip_width, ctx->bs_clip_height, 0);
+
+    if(b.bs_bitmap == NULL) {
+      return b;
+    }
+  }
+
+  render_utf8(ctx, &b, NULL, s, l);
+
   return b;
 }
 
+bool bs_render_utf8_into(bs_context_t *ctx, const char *s, size_t l, bs_bitmap_t target) {
+  if(target.bs_bitmap_width <= 0 || target.bs_bitmap_height <= 0) {
+    return true;
+  }
+
+  memset(target.bs_bitmap, 0, (size_t) target.bs_bitmap_width * target.bs_bitmap_height);
+
+  // with the clip matching target, bs_cursor_insert() never extends it
+  int clip_width = ctx->bs_clip_width;
+  int clip_height = ctx->bs_clip_height;
+  ctx->bs_clip_width = target.bs_bitmap_width;
+  ctx->bs_clip_height = target.bs_bitmap_height;
+
+  bool success = render_utf8(ctx, &target, NULL, s, l);
+
+  ctx->bs_clip_width = clip_width;
+  ctx->bs_clip_height = clip_height;
+
+  return success;
+}
+
+bool bs_render_utf8_display_list(bs_context_t *ctx, const char *s, size_t l, bs_display_list_t *list) {
+  memset(list, 0, sizeof(bs_display_list_t));
+
+  bool success = render_utf8(ctx, NULL, list, s, l);
+
+  // glyphs are mostly placed from left to right already, so insertion
+  // sort is cheap and keeps the order of glyphs at the same position
+  bs_placement_t *p = list->bs_list_placements;
+
+  for(size_t i = 1; i < list->bs_list_placements_len; i++) {
+    bs_placement_t current = p[i];
+    size_t j = i;
+
+    for(; j > 0 && p[j - 1].bs_placement_x > current.bs_placement_x; j--) {
+      p[j] = p[j - 1];
+    }
+
+    p[j] = current;
+  }
+
+  return success;
+}
+
+// moves the first n columns of work (or all of them if it is narrower)
+// into b at column offset and drops them from work
+static bool tiled_flush(bs_tiled_bitmap_t *b, size_t offset, bs_bitmap_t *work, int n) {
+  int moved = n < work->bs_bitmap_width ? n : work->bs_bitmap_width;
+
+  if(offset > SIZE_MAX - moved) {
+    errno = EOVERFLOW;
+    return false;
+  }
+
+  // the copy is cut off at the new width of b, so only moved columns land in it
+  if(!bs_tiled_bitmap_extend(b, offset + moved, work->bs_bitmap_height)
+     || (moved > 0 && !bs_tiled_bitmap_copy(b, offset, 0, *work))) {
+    return false;
+  }
+
+  int width = work->bs_bitmap_width - moved;
+
+  for(int y = 0; y < work->bs_bitmap_height && width > 0; y++) {
+    memmove(work->bs_bitmap + (size_t) y * width,
+      work->bs_bitmap + (size_t) y * work->bs_bitmap_width + moved, width);
+  }
+
+  work->bs_bitmap_width = width;
+
+  return true;
+}
+
+bool bs_render_utf8_tiled(bs_context_t *ctx, const char *s, size_t l, bs_tiled_bitmap_t *b) {
+  bs_tiled_bitmap_init(b, 0);
+
+  if(l == 0) {
+    return true;
+  }
+
+  bs_utf32_buffer_t buf;
+  buf.bs_utf32_buffer = bs_arena_alloc(&ctx->bs_arena, sizeof(uint32_t) * l);
+  buf.bs_utf32_buffer_cap = l;
+  buf.bs_utf32_buffer_len = 0;
+
+  if(buf.bs_utf32_buffer == NULL) {
+    bs_arena_reset(&ctx->bs_arena);
+    errno = ENOMEM;
+    return false;
+  }
+
+  if(bs_utf8_decode(s, l, buf.bs_utf32_buffer, &buf.bs_utf32_buffer_len) != BS_DECODE_OK) {
+    bs_arena_reset(&ctx->bs_arena);
+    errno = EINVAL;
+    return false;
+  }
+
+  // the whole text is rendered, the clip only applies to ordinary bitmaps
+  int clip_width = ctx->bs_clip_width;
+  int clip_height = ctx->bs_clip_height;
+  ctx->bs_clip_width = 0;
+  ctx->bs_clip_height = 0;
+
+  // only a few tiles worth of columns are kept in an ordinary bitmap,
+  // so neither its size nor the cursor can overflow an int. One tile of
+  // columns left of the cursor stays, since glyphs may reach back a bit.
+  bs_bitmap_t work = { NULL, 0, 0 };
+  bs_cursor_t cursor = { 0, 0 };
+  size_t flushed = 0;
+  bool success = true;
+  size_t len;
+
+  for(size_t offset = 0; success && offset < buf.bs_utf32_buffer_len; offset += len) {
+    len = bs_utf32_grapheme_length(buf, offset);
+
+    if(!render_grapheme(ctx, &work, NULL, &cursor, buf, offset, len)) {
+      errno = EIO;
+      success = false;
+    } else if(cursor.bs_cursor_x >= 2 * BS_TILE_WIDTH) {
+      int n = (cursor.bs_cursor_x / BS_TILE_WIDTH - 1) * BS_TILE_WIDTH;
+
+      success = tiled_flush(b, flushed, &work, n);
+      flushed += n;
+      cursor.bs_cursor_x -= n;
+    }
+  }
+
+  if(success) {
+    success = tiled_flush(b, flushed, &work, work.bs_bitmap_width);
+  }
+
+  ctx->bs_clip_width = clip_width;
+  ctx->bs_clip_height = clip_height;
+
+  bs_bitmap_free(&work);
+  bs_arena_reset(&ctx->bs_arena);
+
+  return success;
+}
+
 bool bs_render_utf32_string_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor_t *cursor, bs_utf32_buffer_t str) {
-  utf8proc_int32_t state = 0;
-  size_t start_index = 0;
-  size_t len = 0;
+  return render_utf32_string(ctx, target, NULL, cursor, str);
+}
 
-  for(size_t i = 0; i < str.bs_utf32_buffer_len; i++) {
-    len++;
+static bool render_utf32_string(bs_context_t *ctx, bs_bitmap_t *target, bs_display_list_t *list, bs_cursor_t *cursor, bs_utf32_buffer_t str) {
+  size_t len;
 
-    // end of string or grapheme boundary following
-    bool boundary = (i + 1) >= str.bs_utf32_buffer_len ||
-        utf8proc_grapheme_break_stateful(str.bs_utf32_buffer[i],
-            str.bs_utf32_buffer[i + 1], &state);
+  for(size_t offset = 0; offset < str.bs_utf32_buffer_len; offset += len) {
+    // nothing right of the clip will ever be visible
+    if(clip_enabled(ctx) && cursor->bs_cursor_x >= ctx->bs_clip_width) {
+      break;
+    }
 
-    if(boundary) {
-      if(!bs_render_grapheme_append(ctx, target, cursor, str, start_index, len)) {
-        return false;
-      }
+    uint64_t trace_start = bs_trace_begin();
+    len = bs_utf32_grapheme_length(str, offset);
+    bs_trace_end("segment", trace_start, "codepoints", len);
+
+    if(!render_grapheme(ctx, target, list, cursor, str, offset, len)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// display lists
+
+void bs_display_list_free(bs_display_list_t *list) {
+  for(size_t i = 0; i < list->bs_list_glyphs_len; i++) {
+    bs_bitmap_free(&list->bs_list_glyphs[i]);
+  }
+
+  free(list->bs_list_glyphs);
+  free(list->bs_list_glyph_keys);
+  free(list->bs_list_index);
+  free(list->bs_list_placements);
+
+  memset(list, 0, sizeof(bs_display_list_t));
+}
+
+// slot of key in the open addressing index, either holding key or empty
+static size_t display_list_slot(const bs_display_list_t *list, uint64_t key) {
+  size_t mask = list->bs_list_index_cap - 1;
+  size_t slot = (size_t) ((key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+
+  while(list->bs_list_index[slot] != 0 &&
+      list->bs_list_glyph_keys[list->bs_list_index[slot] - 1] != key) {
+    slot = (slot + 1) & mask;
+  }
 
-      len = 0;
-      start_index = i + 1;
+  return slot;
+}
+
+// keeps the index at most half full
+static bool display_list_grow_index(bs_display_list_t *list) {
+  if(2 * (list->bs_list_glyphs_len + 1) <= list->bs_list_index_cap) {
+    return true;
+  }
+
+  size_t cap = list->bs_list_index_cap == 0 ? 64 : 2 * list->bs_list_index_cap;
+  uint32_t *index = calloc(cap, sizeof(uint32_t));
+
+  if(index == NULL) {
+    return false;
+  }
+
+  free(list->bs_list_index);
+  list->bs_list_index = index;
+  list->bs_list_index_cap = cap;
+
+  for(size_t i = 0; i < list->bs_list_glyphs_len; i++) {
+    index[display_list_slot(list, list->bs_list_glyph_keys[i])] = i + 1;
+  }
+
+  return true;
+}
+
+// Returns the index of the given glyph in the list's glyph cache,
+// rasterizing and adding it if it is new, or -1 on error.
+static long display_list_glyph(bs_context_t *ctx, bs_display_list_t *list,
+  struct SFT *sft, size_t font_index, unsigned long glyph_id,
+  struct SFT_GMetrics *gmetrics) {
+  // glyph ids are never 0 here, since that is the missing glyph
+  uint64_t key = ((uint64_t) font_index << 32) | glyph_id;
+
+  if(list->bs_list_index_cap > 0) {
+    uint32_t found = list->bs_list_index[display_list_slot(list, key)];
+
+    if(found != 0) {
+      return found - 1;
+    }
+  }
+
+  if(!display_list_grow_index(list)) {
+    return -1;
+  }
+
+  if(list->bs_list_glyphs_len == list->bs_list_glyphs_cap) {
+    size_t cap = list->bs_list_glyphs_cap == 0 ? 32 : 2 * list->bs_list_glyphs_cap;
+    bs_bitmap_t *glyphs = realloc(list->bs_list_glyphs, cap * sizeof(bs_bitmap_t));
+    uint64_t *keys = glyphs == NULL ? NULL
+      : realloc(list->bs_list_glyph_keys, cap * sizeof(uint64_t));
+
+    if(glyphs != NULL) {
+      list->bs_list_glyphs = glyphs;
     }
+
+    if(keys == NULL) {
+      return -1;
+    }
+
+    list->bs_list_glyph_keys = keys;
+    list->bs_list_glyphs_cap = cap;
+  }
+
+  bs_bitmap_t glyph = bs_bitmap_new(gmetrics->minWidth, gmetrics->minHeight, 0);
+
+  if(glyph.bs_bitmap == NULL) {
+    return -1;
+  }
+
+  struct SFT_Image sft_image = {
+    glyph.bs_bitmap, glyph.bs_bitmap_width, glyph.bs_bitmap_height
+  };
+
+  uint64_t rasterize_start = bs_trace_begin();
+
+  if(sft_render(sft, glyph_id, sft_image) != 0) {
+    bs_bitmap_free(&glyph);
+    return -1;
+  }
+
+  bs_trace_end("rasterize", rasterize_start, "glyph", glyph_id);
+
+  if(ctx->bs_rendering_flags & BS_RENDER_BINARY) {
+    bs_bitmap_map(glyph, &bs_pixel_to_binary);
+  }
+
+  size_t i = list->bs_list_glyphs_len++;
+  list->bs_list_glyphs[i] = glyph;
+  list->bs_list_glyph_keys[i] = key;
+  list->bs_list_index[display_list_slot(list, key)] = i + 1;
+
+  if(glyph.bs_bitmap_width > list->bs_list_max_glyph_width) {
+    list->bs_list_max_glyph_width = glyph.bs_bitmap_width;
+  }
+
+  return i;
+}
+
+static bool display_list_place(bs_context_t *ctx, bs_display_list_t *list,
+  uint32_t glyph, int x, int y) {
+  if(list->bs_list_placements_len == list->bs_list_placements_cap) {
+    size_t cap = list->bs_list_placements_cap == 0
+      ? 64 : 2 * list->bs_list_placements_cap;
+    bs_placement_t *placements = realloc(list->bs_list_placements,
+      cap * sizeof(bs_placement_t));
+
+    if(placements == NULL) {
+      return false;
+    }
+
+    list->bs_list_placements = placements;
+    list->bs_list_placements_cap = cap;
+  }
+
+  bs_placement_t *p = list->bs_list_placements + list->bs_list_placements_len++;
+  p->bs_placement_glyph = glyph;
+  p->bs_placement_x = x;
+  p->bs_placement_y = y;
+
+  // same size a bitmap rendered by bs_render_utf8_string() would have
+  int width = x + list->bs_list_glyphs[glyph].bs_bitmap_width;
+  int height = y + list->bs_list_glyphs[glyph].bs_bitmap_height;
+
+  if(clip_enabled(ctx)) {
+    width = width < ctx->bs_clip_width ? width : ctx->bs_clip_width;
+    height = height < ctx->bs_clip_height ? height : ctx->bs_clip_height;
+  }
+
+  if(width > list->bs_list_width) {
+    list->bs_list_width = width;
+  }
+
+  if(height > list->bs_list_height) {
+    list->bs_list_height = height;
   }
 
   return true;
 }
 
 bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor_t *cursor, bs_utf32_buffer_t str, size_t offset, size_t len) {
+  return render_grapheme(ctx, target, NULL, cursor, str, offset, len);
+}
+
+bool bs_grapheme_advance(bs_context_t *ctx, bs_utf32_buffer_t str, size_t offset, size_t len, int *advance) {
+  bs_cursor_t cursor = { 0, 0 };
+
+  if(!render_grapheme(ctx, NULL, NULL, &cursor, str, offset, len)) {
+    return false;
+  }
+
+  *advance = cursor.bs_cursor_x;
+
+  return true;
+}
+
+static bool render_grapheme(bs_context_t *ctx, bs_bitmap_t *target, bs_display_list_t *list, bs_cursor_t *cursor, bs_utf32_buffer_t str, size_t offset, size_t len) {
   if(len == 0) {
     return false;
   }
@@ -232,25 +743,64 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
 
   bool have_glyphs = false;
   size_t font_index = 0;
+  uint32_t first = str.bs_utf32_buffer[offset];
+  bool may_skip_shaping = len == 1 && first < BS_SIMPLE_CODEPOINTS &&
+    !(ctx->bs_rendering_flags & BS_RENDER_ALWAYS_SHAPE);
 
   while(!have_glyphs && font_index < ctx->bs_fonts_len) {
-    hb_buffer_t *buf = hb_buffer_create();
-    // Add grapheme to buffer, but use item_offset to give harfbuzz context
-    hb_buffer_add_utf32(buf, str.bs_utf32_buffer, str.bs_utf32_buffer_len,
-      (unsigned int) offset, (int) len);
+    uint64_t fallback_start = bs_trace_begin();
+    const bs_font_t *font = ctx->bs_fonts + font_index;
+
+    unsigned int glyph_count = 0;
+    hb_glyph_info_t *glyph_info;
+    hb_glyph_position_t *glyph_pos;
+    hb_glyph_info_t simple_info;
+    hb_glyph_position_t simple_pos;
+
+    if(may_skip_shaping && font->bs_font_simple_glyphs[first] != 0) {
+      // exactly what hb_shape() would produce, see analyze_simple_codepoints()
+      memset(&simple_info, 0, sizeof(simple_info));
+      memset(&simple_pos, 0, sizeof(simple_pos));
+
+      simple_info.codepoint = font->bs_font_simple_glyphs[first];
+      simple_info.cluster = (uint32_t) offset;
+      simple_pos.x_advance = font->bs_font_simple_advances[first];
+
+      glyph_count = 1;
+      glyph_info = &simple_info;
+      glyph_pos = &simple_pos;
+    } else {
+      if(ctx->bs_hb_buffer == NULL) {
+        ctx->bs_hb_buffer = hb_buffer_create();
+
+        if(!hb_buffer_allocation_successful(ctx->bs_hb_buffer)) {
+          hb_buffer_destroy(ctx->bs_hb_buffer);
+          ctx->bs_hb_buffer = NULL;
+          return false;
+        }
+      }
 
-    hb_buffer_guess_segment_properties(buf);
+      // clearing keeps the buffer's allocations around for the next grapheme
+      hb_buffer_t *buf = ctx->bs_hb_buffer;
+      hb_buffer_clear_contents(buf);
 
-    if(hb_buffer_get_length(buf) <= 0) {
-      hb_buffer_destroy(buf);
-      return false;
-    }
+      // Add grapheme to buffer, but use item_offset to give harfbuzz context
+      hb_buffer_add_utf32(buf, str.bs_utf32_buffer, str.bs_utf32_buffer_len,
+        (unsigned int) offset, (int) len);
 
-    hb_shape(ctx->bs_fonts[font_index].bs_font_hb, buf, NULL, 0);
+      hb_buffer_guess_segment_properties(buf);
 
-    unsigned int glyph_count = 0;
-    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, &glyph_count);
-    hb_glyph_position_t *glyph_pos = hb_buffer_get_glyph_positions(buf, &glyph_count);
+      if(hb_buffer_get_length(buf) <= 0) {
+        return false;
+      }
+
+      uint64_t shape_start = bs_trace_begin();
+      hb_shape(font->bs_font_hb, buf, NULL, 0);
+      bs_trace_end("shape", shape_start, "font", font_index);
+
+      glyph_info = hb_buffer_get_glyph_infos(buf, &glyph_count);
+      glyph_pos = hb_buffer_get_glyph_positions(buf, &glyph_count);
+    }
 
     // first check all glyphs wether they are in this font
     have_glyphs = true;
@@ -277,7 +827,6 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
       sft.flags = SFT_DOWNWARD_Y;
 
       if(sft_lmetrics(&sft, &lmetrics) != 0) {
-        hb_buffer_destroy(buf);
         return false;
       }
 
@@ -285,19 +834,61 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
         struct SFT_GMetrics gmetrics;
         struct SFT_Image    sft_image;
 
+        // only measuring, see bs_grapheme_advance()
+        if(target == NULL && list == NULL) {
+          cursor->bs_cursor_x += glyph_pos[i].x_advance;
+          cursor->bs_cursor_y += glyph_pos[i].y_advance;
+          continue;
+        }
+
         if(sft_gmetrics(&sft, glyph_info[i].codepoint, &gmetrics) != 0) {
-          hb_buffer_destroy(buf);
           return false;
         }
 
-        // allocate manually since we don't need to initialize the memory
+        int offset_x = glyph_pos[i].x_offset + gmetrics.leftSideBearing;
+        int offset_y = glyph_pos[i].y_offset + gmetrics.yOffset + lmetrics.ascender;
+
+        if(clip_enabled(ctx)) {
+          int x = cursor->bs_cursor_x + offset_x;
+          int y = cursor->bs_cursor_y + offset_y;
+
+          // glyphs which wouldn't show up at all are not rasterized
+          if(x >= ctx->bs_clip_width || x + gmetrics.minWidth <= 0 ||
+              y >= ctx->bs_clip_height || y + gmetrics.minHeight <= 0) {
+            cursor->bs_cursor_x += glyph_pos[i].x_advance;
+            cursor->bs_cursor_y += glyph_pos[i].y_advance;
+            continue;
+          }
+        }
+
+        // glyphs are rasterized once per display list and only referenced
+        if(list != NULL) {
+          if(gmetrics.minWidth > 0 && gmetrics.minHeight > 0) {
+            long glyph = display_list_glyph(ctx, list, &sft, font_index,
+              glyph_info[i].codepoint, &gmetrics);
+
+            if(glyph < 0 || !display_list_place(ctx, list, glyph,
+                cursor->bs_cursor_x + offset_x, cursor->bs_cursor_y + offset_y)) {
+              return false;
+            }
+          }
+
+          cursor->bs_cursor_x += glyph_pos[i].x_advance;
+          cursor->bs_cursor_y += glyph_pos[i].y_advance;
+          continue;
+        }
+
+        // glyph bitmaps are only needed until they are blitted, so take
+        // them from the arena and release them right after
+        bs_arena_mark_t arena_mark = bs_arena_mark(&ctx->bs_arena);
+
         bs_bitmap_t glyph;
-        glyph.bs_bitmap = malloc(gmetrics.minWidth * gmetrics.minHeight);
+        glyph.bs_bitmap = bs_arena_alloc(&ctx->bs_arena,
+          gmetrics.minWidth * gmetrics.minHeight);
         glyph.bs_bitmap_width = gmetrics.minWidth;
         glyph.bs_bitmap_height = gmetrics.minHeight;
 
         if(glyph.bs_bitmap == NULL) {
-          hb_buffer_destroy(buf);
           return false;
         }
 
@@ -306,12 +897,15 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
         sft_image.width  = glyph.bs_bitmap_width;
         sft_image.height = glyph.bs_bitmap_height;
 
+        uint64_t rasterize_start = bs_trace_begin();
+
         if(sft_render(&sft, glyph_info[i].codepoint, sft_image) != 0) {
-          hb_buffer_destroy(buf);
-          bs_bitmap_free(&glyph);
+          bs_arena_rollback(&ctx->bs_arena, arena_mark);
           return false;
         }
 
+        bs_trace_end("rasterize", rasterize_start, "glyph", glyph_info[i].codepoint);
+
         if(glyph.bs_bitmap_width != 0 && glyph.bs_bitmap_height != 0) {
           LOG("Offset: HarfBuzz (%d,%d) TrueType (%lf, %d)",
             glyph_pos[i].x_offset, glyph_pos[i].y_offset,
@@ -365,22 +959,22 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
             LOG("Warn: font is actually higher than pixel size");
           }
 
-          int offset_x = glyph_pos[i].x_offset + gmetrics.leftSideBearing;
-          int offset_y = glyph_pos[i].y_offset + gmetrics.yOffset + lmetrics.ascender;
-
           LOG("Computed offset: (%d, %d)", offset_x, offset_y);
 
           if(ctx->bs_rendering_flags & BS_RENDER_BINARY) {
             bs_bitmap_map(glyph, &bs_pixel_to_binary);
           }
 
-          bool result = bs_cursor_insert(target, cursor, offset_x, offset_y,
+          uint64_t blit_start = bs_trace_begin();
+
+          bool result = bs_cursor_insert(ctx, target, cursor, offset_x, offset_y,
             glyph_pos[i].x_advance, glyph_pos[i].y_advance,
             glyph);
 
+          bs_trace_end("blit", blit_start, "glyph", glyph_info[i].codepoint);
+
           if(!result) {
-            bs_bitmap_free(&glyph);
-            hb_buffer_destroy(buf);
+            bs_arena_rollback(&ctx->bs_arena, arena_mark);
             return false;
           }
         } else {
@@ -388,28 +982,24 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
           cursor->bs_cursor_y += glyph_pos[i].y_advance;
         }
 
-        bs_bitmap_free(&glyph);
+        bs_arena_rollback(&ctx->bs_arena, arena_mark);
       }
     }
 
-    hb_buffer_destroy(buf);
+    bs_trace_end("fallback", fallback_start, "font", font_index);
 
     font_index++;
   }
 
   if(!have_glyphs && !(ctx->bs_rendering_flags & BS_RENDER_NO_FALLBACK)) {
-    bs_utf32_buffer_t fallback_grapheme = bs_utf32_buffer_new(1);
-    bs_utf32_buffer_append_single(FALLBACK_CODEPOINT, &fallback_grapheme);
-
-    if(fallback_grapheme.bs_utf32_buffer_len > 0) {
-      // avoid infinite recursion
-      ctx->bs_rendering_flags |= BS_RENDER_NO_FALLBACK;
-      have_glyphs = bs_render_grapheme_append(ctx,
-        target, cursor, fallback_grapheme, 0, 1);
-      ctx->bs_rendering_flags ^= BS_RENDER_NO_FALLBACK;
-    }
-
-    bs_utf32_buffer_free(&fallback_grapheme);
+    uint32_t fallback_codepoint = FALLBACK_CODEPOINT;
+    bs_utf32_buffer_t fallback_grapheme = { &fallback_codepoint, 1, 1 };
+
+    // avoid infinite recursion
+    ctx->bs_rendering_flags |= BS_RENDER_NO_FALLBACK;
+    have_glyphs = render_grapheme(ctx,
+      target, list, cursor, fallback_grapheme, 0, 1);
+    ctx->bs_rendering_flags ^= BS_RENDER_NO_FALLBACK;
   }
 
   return have_glyphs;
@@ -418,30 +1008,49 @@ bool bs_render_grapheme_append(bs_context_t *ctx, bs_bitmap_t *target, bs_cursor
 // buffer implementation
 
 bs_utf32_buffer_t bs_decode_utf8(const char *s, size_t l) {
-  bs_utf32_buffer_t buf = bs_utf32_buffer_new(l);
+  bs_utf32_buffer_t buf = { NULL, 0, 0 };
 
-  const utf8proc_uint8_t *utf8_ptr = (utf8proc_uint8_t *) s;
-  size_t left = l;
+  switch(bs_utf32_buffer_append_utf8(&buf, s, l)) {
+    case BS_DECODE_NOMEM:
+      errno = ENOMEM;
+      break;
+    case BS_DECODE_INVALID:
+      errno = EINVAL;
+      break;
+    case BS_DECODE_OK:
+      break;
+  }
 
-  while(left > 0) {
-    utf8proc_int32_t codepoint;
-    utf8proc_ssize_t read = utf8proc_iterate(utf8_ptr, left, &codepoint);
+  return buf;
+}
 
-    if(read <= 0) {
-      errno = EINVAL;
-      return buf;
-    }
+size_t bs_utf32_grapheme_length(bs_utf32_buffer_t str, size_t offset) {
+  utf8proc_int32_t state = 0;
+  size_t i = offset;
 
-    utf8_ptr += read;
-    left -= read;
+  if(offset >= str.bs_utf32_buffer_len) {
+    return 0;
+  }
 
-    if(!bs_utf32_buffer_append_single(codepoint, &buf)) {
-      errno = ENOMEM;
-      return buf;
+  // the break state starts out fresh at every boundary anyways
+  while(i + 1 < str.bs_utf32_buffer_len) {
+    uint32_t a = str.bs_utf32_buffer[i];
+    uint32_t b = str.bs_utf32_buffer[i + 1];
+
+    // Latin-1 has no extending or prepended characters,
+    // so there is a boundary between any two except CR LF
+    if(a < 0x100 && b < 0x100) {
+      if(a != '\r' || b != '\n') {
+        break;
+      }
+    } else if(utf8proc_grapheme_break_stateful(a, b, &state)) {
+      break;
     }
+
+    i++;
   }
 
-  return buf;
+  return i + 1 - offset;
 }
 
 bs_utf32_buffer_t bs_utf32_buffer_new(size_t cap) {
@@ -464,18 +1073,36 @@ void bs_utf32_buffer_free(bs_utf32_buffer_t *buf) {
   buf->bs_utf32_buffer_len = 0;
 }
 
-bool bs_utf32_buffer_append(uint32_t *us, size_t l, bs_utf32_buffer_t *buf) {
+bool bs_utf32_buffer_reserve(bs_utf32_buffer_t *buf, size_t l) {
   size_t needed_size = buf->bs_utf32_buffer_len + l;
 
-  if(buf->bs_utf32_buffer_cap < needed_size) {
-    uint32_t *tmp = realloc(buf->bs_utf32_buffer, sizeof(uint32_t) * needed_size);
+  if(buf->bs_utf32_buffer_cap >= needed_size) {
+    return true;
+  }
 
-    if(tmp == NULL) {
-      return false;
-    }
+  // growing geometrically keeps appending in a loop linear
+  size_t cap = 2 * buf->bs_utf32_buffer_cap;
+  if(cap < needed_size) {
+    cap = needed_size;
+  }
+
+  uint32_t *tmp = realloc(buf->bs_utf32_buffer, sizeof(uint32_t) * cap);
+
+  if(tmp == NULL) {
+    return false;
+  }
 
-    buf->bs_utf32_buffer = tmp;
-    buf->bs_utf32_buffer_cap = needed_size;
+  buf->bs_utf32_buffer = tmp;
+  buf->bs_utf32_buffer_cap = cap;
+
+  return true;
+}
+
+bool bs_utf32_buffer_append(uint32_t *us, size_t l, bs_utf32_buffer_t *buf) {
+  size_t needed_size = buf->bs_utf32_buffer_len + l;
+
+  if(!bs_utf32_buffer_reserve(buf, l)) {
+    return false;
   }
 
   memcpy(buf->bs_utf32_buffer + buf->bs_utf32_buffer_len, us, l * sizeof(uint32_t));
@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// A compact bitmap is cut into spans of 8 columns. A span is stored as
+// one byte per row holding the row's 8 pixels most significant bit
+// first, i. e. exactly the bytes bs_view_bitarray_pack() produces for
+// a view whose offset is a multiple of 8. Spans without any set pixel,
+// e. g. the gaps between words, aren't stored at all. Which spans of a
+// group of 64 are stored is kept in a bit mask, so the data of any span
+// is found using a single popcount.
+
+#define GROUP_SPANS 64
+
+static inline size_t span_count(int width) {
+  return ((size_t) width + 7) / 8;
+}
+
+// data of span s or NULL if it is empty or outside of the bitmap
+static inline const uint8_t *span_data(const bs_compact_bitmap_t *b, long s) {
+  if(s < 0 || (size_t) s >= span_count(b->bs_compact_width)) {
+    return NULL;
+  }
+
+  const bs_compact_group_t *g = b->bs_compact_groups + s / GROUP_SPANS;
+  uint64_t bit = (uint64_t) 1 << (s % GROUP_SPANS);
+
+  if((g->bs_group_occupied & bit) == 0) {
+    return NULL;
+  }
+
+  size_t index = g->bs_group_first + __builtin_popcountll(g->bs_group_occupied & (bit - 1));
+
+  return b->bs_compact_spans + index * b->bs_compact_height;
+}
+
+static uint8_t span_row(bs_bitmap_t bitmap, size_t s, int y) {
+  const unsigned char *pixels = bitmap.bs_bitmap + (size_t) y * bitmap.bs_bitmap_width + s * 8;
+  int columns = bitmap.bs_bitmap_width - s * 8;
+  uint8_t byte = 0;
+
+  if(columns > 8) {
+    columns = 8;
+  }
+
+  for(int x = 0; x < columns; x++) {
+    if(pixels[x] > 0) {
+      byte |= 0x80 >> x;
+    }
+  }
+
+  return byte;
+}
+
+bool bs_compact_bitmap_encode(bs_bitmap_t bitmap, bs_compact_bitmap_t *b) {
+  memset(b, 0, sizeof(bs_compact_bitmap_t));
+
+  if(bitmap.bs_bitmap_width <= 0 || bitmap.bs_bitmap_height <= 0) {
+    return true;
+  }
+
+  size_t spans = span_count(bitmap.bs_bitmap_width);
+  size_t groups = (spans + GROUP_SPANS - 1) / GROUP_SPANS;
+
+  b->bs_compact_groups = calloc(groups, sizeof(bs_compact_group_t));
+
+  if(b->bs_compact_groups == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  // first find out which spans need to be stored at all
+  size_t stored = 0;
+
+  for(size_t s = 0; s < spans; s++) {
+    bs_compact_group_t *g = b->bs_compact_groups + s / GROUP_SPANS;
+
+    if(s % GROUP_SPANS == 0) {
+      g->bs_group_first = stored;
+    }
+
+    for(int y = 0; y < bitmap.bs_bitmap_height; y++) {
+      if(span_row(bitmap, s, y) != 0) {
+        g->bs_group_occupied |= (uint64_t) 1 << (s % GROUP_SPANS);
+        stored++;
+        break;
+      }
+    }
+  }
+
+  if(stored > 0) {
+    b->bs_compact_spans = malloc(stored * bitmap.bs_bitmap_height);
+
+    if(b->bs_compact_spans == NULL) {
+      free(b->bs_compact_groups);
+      memset(b, 0, sizeof(bs_compact_bitmap_t));
+      errno = ENOMEM;
+      return false;
+    }
+  }
+
+  b->bs_compact_width = bitmap.bs_bitmap_width;
+  b->bs_compact_height = bitmap.bs_bitmap_height;
+  b->bs_compact_spans_len = stored;
+
+  uint8_t *out = b->bs_compact_spans;
+
+  for(size_t s = 0; s < spans; s++) {
+    if(span_data(b, s) == NULL) {
+      continue;
+    }
+
+    for(int y = 0; y < bitmap.bs_bitmap_height; y++) {
+      *out++ = span_row(bitmap, s, y);
+    }
+  }
+
+  return true;
+}
+
+void bs_compact_bitmap_free(bs_compact_bitmap_t *b) {
+  free(b->bs_compact_spans);
+  free(b->bs_compact_groups);
+
+  memset(b, 0, sizeof(bs_compact_bitmap_t));
+}
+
+size_t bs_compact_bitmap_size(const bs_compact_bitmap_t *b) {
+  size_t groups = (span_count(b->bs_compact_width) + GROUP_SPANS - 1) / GROUP_SPANS;
+
+  return sizeof(bs_compact_bitmap_t)
+    + groups * sizeof(bs_compact_group_t)
+    + b->bs_compact_spans_len * b->bs_compact_height;
+}
+
+// mask of the bits of a byte starting at column x which lie outside
+// of [0, width)
+static inline uint8_t outside_mask(long x, int width) {
+  uint8_t mask = 0;
+
+  if(x < 0) {
+    mask |= x <= -8 ? 0xff : 0xff << (8 + x);
+  }
+
+  if(x + 8 > width) {
+    mask |= x >= width ? 0xff : 0xff >> (width - x);
+  }
+
+  return mask;
+}
+
+size_t bs_compact_view_pack(const bs_compact_bitmap_t *b, bs_rect_t view,
+  uint8_t *array, size_t size, unsigned char def) {
+  if(view.bs_rect_width <= 0 || view.bs_rect_height <= 0) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  size_t row_bytes = ((size_t) view.bs_rect_width + 7) / 8;
+  size_t needed = row_bytes * view.bs_rect_height;
+
+  if(size < needed) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  uint8_t def_byte = def > 0 ? 0xff : 0x00;
+
+  // rows of the view covered by the bitmap
+  int min_i = view.bs_rect_y < 0 ? -view.bs_rect_y : 0;
+  int max_i = b->bs_compact_height - view.bs_rect_y;
+
+  if(min_i > view.bs_rect_height) {
+    min_i = view.bs_rect_height;
+  }
+
+  if(max_i > view.bs_rect_height) {
+    max_i = view.bs_rect_height;
+  }
+
+  if(max_i < min_i) {
+    max_i = min_i;
+  }
+
+  // the frame is filled byte column by byte column, so every
+  // span only needs to be looked up once
+  for(size_t j = 0; j < row_bytes; j++) {
+    long x = (long) view.bs_rect_x + j * 8;
+    long s = x >= 0 ? x / 8 : -((-x + 7) / 8);
+    int shift = x - s * 8;
+
+    const uint8_t *left = span_data(b, s);
+    const uint8_t *right = shift > 0 ? span_data(b, s + 1) : NULL;
+    uint8_t outside = def > 0 ? outside_mask(x, b->bs_compact_width) : 0;
+
+    uint8_t *out = array + j;
+
+    for(int i = 0; i < min_i; i++, out += row_bytes) {
+      *out = def_byte;
+    }
+
+    for(int i = min_i; i < max_i; i++, out += row_bytes) {
+      int y = view.bs_rect_y + i;
+      uint8_t byte = outside;
+
+      if(left != NULL) {
+        byte |= left[y] << shift;
+      }
+
+      if(right != NULL) {
+        byte |= right[y] >> (8 - shift);
+      }
+
+      *out = byte;
+    }
+
+    for(int i = max_i; i < view.bs_rect_height; i++, out += row_bytes) {
+      *out = def_byte;
+    }
+  }
+
+  // keep the padding bits of each row zero
+  if(view.bs_rect_width % 8 != 0) {
+    uint8_t padding = 0xff << (8 - view.bs_rect_width % 8);
+
+    for(int i = 0; i < view.bs_rect_height; i++) {
+      array[i * row_bytes + row_bytes - 1] &= padding;
+    }
+  }
+
+  return needed;
+}
@@ -1,11 +1,14 @@
-{ pkgs ? import <nixpkgs> { } }:
+{ pkgs ? import <nixpkgs> { }
+# builds the library with -Dstatic_memory=true, see README.md
+, staticMemory ? false
+}:
 
 assert pkgs.lib.versionAtLeast pkgs.libschrift.version "0.10.1";
 
 let
   gi = pkgs.nix-gitignore;
 
-  buchstabensuppe = { stdenv, utf8proc, harfbuzz, libschrift, meson, ninja, pkg-config }:
+  buchstabensuppe = { stdenv, utf8proc, harfbuzz, libschrift, meson, ninja, pkg-config, dejavu_fonts }:
     stdenv.mkDerivation rec {
       pname = "buchstabensuppe";
       version = "unstable";
@@ -22,6 +25,13 @@ let
 
       outputs = [ "out" "lib" "dev" "man" ];
 
+      # libschrift only reads TrueType outlines
+      mesonFlags = [
+        "-Dtest_font=${dejavu_fonts}/share/fonts/truetype/DejaVuSans.ttf"
+      ] ++ pkgs.lib.optional staticMemory "-Dstatic_memory=true";
+
+      nativeCheckInputs = [ dejavu_fonts ];
+
       doCheck = true;
     };
 in
@@ -0,0 +1,243 @@
+#define _POSIX_C_SOURCE 200112L /* writev */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <buchstabensuppe.h>
+
+// Every format is assembled in a fixed buffer which is written out
+// whenever it is full, so even a long ticker only takes a handful of
+// system calls instead of one stdio call per pixel.
+
+#define OUTPUT_BUFFER_SIZE 16384
+
+#define BLOCK_FULL  "\xe2\x96\x88" // U+2588 FULL BLOCK
+#define BLOCK_UPPER "\xe2\x96\x80" // U+2580 UPPER HALF BLOCK
+#define BLOCK_LOWER "\xe2\x96\x84" // U+2584 LOWER HALF BLOCK
+
+struct output {
+  int fd;
+  bool failed;
+  size_t len;
+  uint8_t buf[OUTPUT_BUFFER_SIZE];
+};
+
+// writes all of the given buffers, continuing after partial writes
+static bool write_all(int fd, struct iovec *iov, int iovcnt) {
+  while(iovcnt > 0) {
+    ssize_t written = writev(fd, iov, iovcnt);
+
+    if(written < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    while(iovcnt > 0 && (size_t) written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if(iovcnt > 0) {
+      iov->iov_base = (uint8_t *) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return true;
+}
+
+static void output_flush(struct output *out) {
+  struct iovec iov = { out->buf, out->len };
+
+  if(!out->failed && out->len > 0 && !write_all(out->fd, &iov, 1)) {
+    out->failed = true;
+  }
+
+  out->len = 0;
+}
+
+// n must not exceed OUTPUT_BUFFER_SIZE
+static inline void output_put(struct output *out, const void *data, size_t n) {
+  if(out->len + n > OUTPUT_BUFFER_SIZE) {
+    output_flush(out);
+  }
+
+  memcpy(out->buf + out->len, data, n);
+  out->len += n;
+}
+
+static inline bool pixel_set(bs_bitmap_t bitmap, bool binary, int x, int y) {
+  unsigned char p = bitmap.bs_bitmap[(size_t) y * bitmap.bs_bitmap_width + x];
+  return binary ? p : p > 0x80;
+}
+
+static void export_blocks(struct output *out, bs_bitmap_t bitmap, bool binary) {
+  for(int y = 0; y < bitmap.bs_bitmap_height; y++) {
+    for(int x = 0; x < bitmap.bs_bitmap_width; x++) {
+      if(pixel_set(bitmap, binary, x, y)) {
+        output_put(out, BLOCK_FULL, 3);
+      } else {
+        output_put(out, " ", 1);
+      }
+    }
+
+    output_put(out, "\n", 1);
+  }
+}
+
+static void export_half_blocks(struct output *out, bs_bitmap_t bitmap, bool binary) {
+  // indexed by upper pixel | lower pixel << 1
+  static const char *const blocks[] = { " ", BLOCK_UPPER, BLOCK_LOWER, BLOCK_FULL };
+  static const size_t lens[] = { 1, 3, 3, 3 };
+
+  for(int y = 0; y < bitmap.bs_bitmap_height; y += 2) {
+    bool has_lower = y + 1 < bitmap.bs_bitmap_height;
+
+    for(int x = 0; x < bitmap.bs_bitmap_width; x++) {
+      int i = pixel_set(bitmap, binary, x, y) |
+        (has_lower && pixel_set(bitmap, binary, x, y + 1)) << 1;
+
+      output_put(out, blocks[i], lens[i]);
+    }
+
+    output_put(out, "\n", 1);
+  }
+}
+
+static void export_pbm(struct output *out, bs_bitmap_t bitmap, bool binary) {
+  char header[32];
+  int header_len = snprintf(header, sizeof(header), "P4\n%d %d\n",
+    bitmap.bs_bitmap_width, bitmap.bs_bitmap_height);
+
+  output_put(out, header, header_len);
+
+  for(int y = 0; y < bitmap.bs_bitmap_height; y++) {
+    uint8_t byte = 0;
+
+    for(int x = 0; x < bitmap.bs_bitmap_width; x++) {
+      // in PBM 1 is black
+      if(!pixel_set(bitmap, binary, x, y)) {
+        byte |= 0x80 >> (x % 8);
+      }
+
+      if(x % 8 == 7 || x == bitmap.bs_bitmap_width - 1) {
+        output_put(out, &byte, 1);
+        byte = 0;
+      }
+    }
+  }
+}
+
+static void export_pgm(struct output *out, bs_bitmap_t bitmap, bool binary) {
+  char header[40];
+  int header_len = snprintf(header, sizeof(header), "P5\n%d %d\n255\n",
+    bitmap.bs_bitmap_width, bitmap.bs_bitmap_height);
+
+  size_t size = (size_t) bitmap.bs_bitmap_width * bitmap.bs_bitmap_height;
+
+  if(!binary) {
+    // grayscale pixels are written as they are, straight from the bitmap
+    struct iovec iov[] = {
+      { header, header_len },
+      { bitmap.bs_bitmap, size },
+    };
+
+    out->failed = !write_all(out->fd, iov, size > 0 ? 2 : 1);
+    return;
+  }
+
+  output_put(out, header, header_len);
+
+  for(size_t i = 0; i < size; i++) {
+    uint8_t p = bitmap.bs_bitmap[i] ? 0xff : 0x00;
+    output_put(out, &p, 1);
+  }
+}
+
+static void export_raw(struct output *out, bs_bitmap_t bitmap,
+  const bs_frame_format_t *format) {
+  bs_view_t view = {
+    bitmap, 0, 0, bitmap.bs_bitmap_width, bitmap.bs_bitmap_height,
+  };
+
+  size_t size = bs_frame_format_size(format, view.bs_view_width,
+    view.bs_view_height);
+
+  if(size == 0) {
+    return;
+  }
+
+  uint8_t *frame = malloc(size);
+
+  if(frame == NULL) {
+    out->failed = true;
+    return;
+  }
+
+  struct iovec iov = { frame, bs_view_pack(view, format, frame, size, 0) };
+
+  out->failed = !write_all(out->fd, &iov, 1);
+
+  free(frame);
+}
+
+bool bs_bitmap_export(int fd, bs_bitmap_t bitmap, bool binary_image,
+  enum bs_export_format export_format, const bs_frame_format_t *frame_format) {
+  bs_frame_format_t flipdot = bs_frame_format_flipdot();
+
+  if(frame_format == NULL) {
+    frame_format = &flipdot;
+  }
+
+  if(export_format == BS_EXPORT_RAW &&
+      bs_frame_format_size(frame_format, 1, 1) == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  struct output *out = malloc(sizeof(struct output));
+
+  if(out == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  out->fd = fd;
+  out->failed = false;
+  out->len = 0;
+
+  switch(export_format) {
+    case BS_EXPORT_BLOCKS:
+      export_blocks(out, bitmap, binary_image);
+      break;
+    case BS_EXPORT_HALF_BLOCKS:
+      export_half_blocks(out, bitmap, binary_image);
+      break;
+    case BS_EXPORT_PBM:
+      export_pbm(out, bitmap, binary_image);
+      break;
+    case BS_EXPORT_PGM:
+      export_pgm(out, bitmap, binary_image);
+      break;
+    case BS_EXPORT_RAW:
+      export_raw(out, bitmap, frame_format);
+      break;
+  }
+
+  output_flush(out);
+
+  bool ok = !out->failed;
+  int saved_errno = errno;
+
+  free(out);
+  errno = saved_errno;
+
+  return ok;
+}
@@ -1,8 +1,20 @@
+#define _GNU_SOURCE /* sendmmsg */
 #include <errno.h>
+#include <netdb.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <buchstabensuppe.h>
 
+// frames up to this size are packed on the stack by bs_flipdot_render_format()
+#define FRAME_STACK_SIZE 1024
+
+// number of messages passed to a single sendmmsg call
+#define SEND_BATCH_SIZE 64
+
 bool bs_scroll_next_view(bs_view_t *view, int step, enum bs_dimension dim) {
   if(step == 0) {
     return true;
@@ -15,13 +27,13 @@ bool bs_scroll_next_view(bs_view_t *view, int step, enum bs_dimension dim) {
     case BS_DIMENSION_Y:
       bitmap_len = view->bs_view_bitmap.bs_bitmap_height;
       offset = &(view->bs_view_offset_y);
-      len = view->bs_view_width;
+      len = view->bs_view_height;
       break;
     case BS_DIMENSION_X: /* is also default case */
     default:
       bitmap_len = view->bs_view_bitmap.bs_bitmap_width;
       offset = &(view->bs_view_offset_x);
-      len = view->bs_view_height;
+      len = view->bs_view_width;
       break;
   }
 
@@ -50,13 +62,13 @@ bool bs_page_next_view(bs_view_t *view, int dir, enum bs_dimension dim) {
     case BS_DIMENSION_Y:
       bitmap_len = view->bs_view_bitmap.bs_bitmap_height;
       offset = &(view->bs_view_offset_y);
-      len = view->bs_view_width;
+      len = view->bs_view_height;
       break;
     case BS_DIMENSION_X: /* is also default case */
     default:
       bitmap_len = view->bs_view_bitmap.bs_bitmap_width;
       offset = &(view->bs_view_offset_x);
-      len = view->bs_view_height;
+      len = view->bs_view_width;
       break;
   }
 
@@ -73,22 +85,438 @@ bool bs_page_next_view(bs_view_t *view, int dir, enum bs_dimension dim) {
   return false;
 }
 
-int bs_flipdot_render(int sockfd, struct sockaddr *addr, socklen_t addrlen, bs_view_t view, unsigned char overflow_color) {
-  size_t bits_size;
-  uint8_t *bits = bs_view_bitarray(view, &bits_size, overflow_color);
+// Shifts every packed row of frame left by step pixels and fills in the
+// columns entering the view on the right from its bitmap. view must
+// already have been moved by step.
+static void scroll_frame_shift(bs_view_t view, int step, uint8_t *frame, unsigned char def) {
+  bs_bitmap_t b = view.bs_view_bitmap;
+  size_t row_bytes = (view.bs_view_width + 7) / 8;
+  size_t byte_shift = step / 8;
+  int bit_shift = step % 8;
 
-  if(bits == NULL) {
+  for(int i = 0; i < view.bs_view_height; i++) {
+    uint8_t *row = frame + i * row_bytes;
+
+    for(size_t j = 0; j < row_bytes; j++) {
+      uint8_t hi = j + byte_shift < row_bytes ? row[j + byte_shift] : 0;
+      uint8_t lo = j + byte_shift + 1 < row_bytes ? row[j + byte_shift + 1] : 0;
+
+      row[j] = bit_shift == 0 ? hi
+        : (uint8_t) ((hi << bit_shift) | (lo >> (8 - bit_shift)));
+    }
+
+    int y = view.bs_view_offset_y + i;
+    bool row_in_bitmap = y >= 0 && y < b.bs_bitmap_height;
+
+    for(int j = view.bs_view_width - step; j < view.bs_view_width; j++) {
+      int x = view.bs_view_offset_x + j;
+      unsigned char pixel = row_in_bitmap && x >= 0 && x < b.bs_bitmap_width
+        ? b.bs_bitmap[(size_t) y * b.bs_bitmap_width + x] : def;
+      uint8_t mask = 0x80 >> (j & 7);
+
+      if(pixel > 0) {
+        row[j >> 3] |= mask;
+      } else {
+        row[j >> 3] &= ~mask;
+      }
+    }
+  }
+}
+
+void bs_view_shift_frame(bs_view_t *view, int step, uint8_t *frame, size_t frame_size, unsigned char def) {
+  view->bs_view_offset_x += step;
+
+  if(step > 0 && step < view->bs_view_width &&
+      frame_size >= bs_view_bitarray_size(*view)) {
+    scroll_frame_shift(*view, step, frame, def);
+  } else {
+    bs_view_bitarray_pack(*view, frame, frame_size, def);
+  }
+}
+
+bool bs_scroll_next_frame(bs_view_t *view, int step, uint8_t *frame, size_t frame_size, unsigned char def) {
+  bs_view_t next = *view;
+  bool finished = bs_scroll_next_view(&next, step, BS_DIMENSION_X);
+
+  if(next.bs_view_offset_x - view->bs_view_offset_x == step) {
+    bs_view_shift_frame(view, step, frame, frame_size, def);
+  } else {
+    // wrapped around, can't be done incrementally
+    *view = next;
+    bs_view_bitarray_pack(*view, frame, frame_size, def);
+  }
+
+  return finished;
+}
+
+bs_frames_t bs_scroll_frames(bs_view_t view, int step, unsigned char def) {
+  if(step == 0) {
+    bs_frames_t frames = { NULL, 0, bs_view_bitarray_size(view) };
+    errno = EINVAL;
+    return frames;
+  }
+
+  // count the frames first, a view is cheap to move
+  size_t count = 1;
+  bs_view_t counter = view;
+
+  while(!bs_scroll_next_view(&counter, step, BS_DIMENSION_X)) {
+    count++;
+  }
+
+  return bs_shift_frames(view, step, count, def);
+}
+
+bs_frames_t bs_shift_frames(bs_view_t view, int step, size_t count, unsigned char def) {
+  bs_frames_t frames = { NULL, 0, bs_view_bitarray_size(view) };
+
+  if(frames.bs_frame_size == 0 || count == 0) {
+    errno = EINVAL;
+    return frames;
+  }
+
+  if(count > SIZE_MAX / frames.bs_frame_size) {
     errno = ENOMEM;
-    return -1;
+    return frames;
+  }
+
+  frames.bs_frames = malloc(count * frames.bs_frame_size);
+
+  if(frames.bs_frames == NULL) {
+    errno = ENOMEM;
+    return frames;
+  }
+
+  uint8_t *frame = frames.bs_frames;
+  bs_view_bitarray_pack(view, frame, frames.bs_frame_size, def);
+
+  for(size_t i = 1; i < count; i++) {
+    uint8_t *next = frame + frames.bs_frame_size;
+
+    memcpy(next, frame, frames.bs_frame_size);
+    bs_view_shift_frame(&view, step, next, frames.bs_frame_size, def);
+
+    frame = next;
+  }
+
+  frames.bs_frames_count = count;
+
+  return frames;
+}
+
+void bs_frames_free(bs_frames_t *frames) {
+  if(frames->bs_frames != NULL) {
+    free(frames->bs_frames);
   }
 
-  ssize_t sent = sendto(sockfd, bits, bits_size, 0, addr, addrlen);
+  frames->bs_frames = NULL;
+  frames->bs_frames_count = 0;
+}
 
-  free(bits);
+// Packs view into frame and sends that very buffer, to addr if it isn't
+// NULL. The frame is never copied or repacked on the way to the socket.
+static int send_view(int sockfd, const struct sockaddr *addr, socklen_t addrlen,
+  bs_view_t view, const bs_frame_format_t *format, uint8_t *frame,
+  size_t frame_size, unsigned char overflow_color) {
+  uint64_t trace_start = bs_trace_begin();
+  size_t size = format == NULL
+    ? bs_view_bitarray_pack(view, frame, frame_size, overflow_color)
+    : bs_view_pack(view, format, frame, frame_size, overflow_color);
+  bs_trace_end("pack", trace_start, "bytes", size);
 
-  if(sent != (ssize_t) bits_size) {
+  if(size == 0) {
+    return -1;
+  }
+
+  trace_start = bs_trace_begin();
+  ssize_t sent = addr == NULL
+    ? send(sockfd, frame, size, 0)
+    : sendto(sockfd, frame, size, 0, addr, addrlen);
+  bs_trace_end("send", trace_start, "bytes", sent);
+
+  if(sent != (ssize_t) size) {
     return -1;
   }
 
   return 0;
 }
+
+int bs_flipdot_render_format(int sockfd, struct sockaddr *addr, socklen_t addrlen,
+  bs_view_t view, const bs_frame_format_t *format, unsigned char overflow_color) {
+  uint8_t stack_frame[FRAME_STACK_SIZE];
+  uint8_t *frame = stack_frame;
+  size_t frame_size = format == NULL
+    ? bs_view_bitarray_size(view)
+    : bs_frame_format_size(format, view.bs_view_width, view.bs_view_height);
+
+  if(frame_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if(frame_size > sizeof(stack_frame)) {
+    frame = malloc(frame_size);
+
+    if(frame == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+  }
+
+  int result = send_view(sockfd, addr, addrlen, view, format, frame,
+    frame_size, overflow_color);
+
+  if(frame != stack_frame) {
+    free(frame);
+  }
+
+  return result;
+}
+
+int bs_flipdot_render(int sockfd, struct sockaddr *addr, socklen_t addrlen, bs_view_t view, unsigned char overflow_color) {
+  return bs_flipdot_render_format(sockfd, addr, addrlen, view, NULL, overflow_color);
+}
+
+static struct addrinfo *flipdot_lookup(const char *host, const char *port, int family) {
+  struct addrinfo *addrs;
+  struct addrinfo hints;
+
+  memset(&hints, 0, sizeof(hints));
+
+  hints.ai_family = family;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_NUMERICSERV;
+
+  if(getaddrinfo(host, port, &hints, &addrs) != 0) {
+    errno = EHOSTUNREACH;
+    return NULL;
+  }
+
+  return addrs;
+}
+
+bool bs_flipdot_resolve(const char *host, const char *port, int family, struct sockaddr_storage *addr, socklen_t *addrlen) {
+  struct addrinfo *addrs = flipdot_lookup(host, port, family);
+
+  if(addrs == NULL) {
+    return false;
+  }
+
+  memcpy(addr, addrs->ai_addr, addrs->ai_addrlen);
+  *addrlen = addrs->ai_addrlen;
+
+  freeaddrinfo(addrs);
+
+  return true;
+}
+
+int bs_flipdot_connect(const char *host, const char *port, int family) {
+  struct addrinfo *addrs = flipdot_lookup(host, port, family);
+
+  if(addrs == NULL) {
+    return -1;
+  }
+
+  int sockfd = -1;
+
+  for(struct addrinfo *ai = addrs; ai != NULL && sockfd < 0; ai = ai->ai_next) {
+    sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+    if(sockfd >= 0 && connect(sockfd, ai->ai_addr, ai->ai_addrlen) != 0) {
+      close(sockfd);
+      sockfd = -1;
+    }
+  }
+
+  freeaddrinfo(addrs);
+
+  return sockfd;
+}
+
+int bs_flipdot_send(int sockfd, bs_view_t view, const bs_frame_format_t *format, uint8_t *frame, size_t frame_size, unsigned char overflow_color) {
+  return send_view(sockfd, NULL, 0, view, format, frame, frame_size, overflow_color);
+}
+
+ssize_t bs_flipdot_send_frames(int sockfd, const bs_flipdot_frame_t *frames, size_t count) {
+  struct mmsghdr msgs[SEND_BATCH_SIZE];
+  struct iovec iovs[SEND_BATCH_SIZE];
+  size_t sent = 0;
+
+  while(sent < count) {
+    size_t batch = count - sent;
+    if(batch > SEND_BATCH_SIZE) {
+      batch = SEND_BATCH_SIZE;
+    }
+
+    memset(msgs, 0, sizeof(struct mmsghdr) * batch);
+
+    for(size_t i = 0; i < batch; i++) {
+      const bs_flipdot_frame_t *f = frames + sent + i;
+
+      iovs[i].iov_base = (void *) f->bs_frame_data;
+      iovs[i].iov_len = f->bs_frame_size;
+
+      msgs[i].msg_hdr.msg_iov = iovs + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = (void *) f->bs_frame_addr;
+      msgs[i].msg_hdr.msg_namelen = f->bs_frame_addr == NULL ? 0 : f->bs_frame_addrlen;
+    }
+
+    uint64_t trace_start = bs_trace_begin();
+    int result = sendmmsg(sockfd, msgs, batch, 0);
+    bs_trace_end("send", trace_start, "frames", result);
+
+    if(result < 0) {
+      return sent > 0 ? (ssize_t) sent : -1;
+    }
+
+    sent += result;
+
+    if((size_t) result < batch) {
+      break;
+    }
+  }
+
+  return sent;
+}
+
+uint64_t bs_frame_hash(const uint8_t *frame, size_t size) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for(size_t i = 0; i < size; i++) {
+    hash ^= frame[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+void bs_frame_filter_init(bs_frame_filter_t *filter) {
+  memset(filter, 0, sizeof(bs_frame_filter_t));
+}
+
+bool bs_frame_filter_check(bs_frame_filter_t *filter, const uint8_t *frame, size_t size, uint64_t now, uint64_t keepalive) {
+  uint64_t hash = bs_frame_hash(frame, size);
+
+  bool changed = !filter->bs_filter_valid || hash != filter->bs_filter_hash
+    || size != filter->bs_filter_size;
+  bool refresh = keepalive > 0 && now - filter->bs_filter_last_sent >= keepalive;
+
+  if(!changed && !refresh) {
+    filter->bs_filter_skipped++;
+    return false;
+  }
+
+  filter->bs_filter_valid = true;
+  filter->bs_filter_hash = hash;
+  filter->bs_filter_size = size;
+  filter->bs_filter_last_sent = now;
+  filter->bs_filter_sent++;
+
+  return true;
+}
+
+size_t bs_frame_flip_count(const uint8_t *from, const uint8_t *to, size_t size) {
+  size_t flips = 0;
+
+  for(size_t i = 0; i < size; i++) {
+    flips += __builtin_popcount(from[i] ^ to[i]);
+  }
+
+  return flips;
+}
+
+// flip up to budget dots of *shown selected by mask to match target,
+// starting with the most significant bit, i. e. leftmost dot
+static size_t flip_byte(uint8_t *shown, uint8_t target, uint8_t mask, size_t budget) {
+  uint8_t diff = (*shown ^ target) & mask;
+  size_t flips = __builtin_popcount(diff);
+
+  if(flips > budget) {
+    uint8_t partial = 0;
+    flips = 0;
+
+    for(uint8_t bit = 0x80; bit != 0 && flips < budget; bit >>= 1) {
+      if(diff & bit) {
+        partial |= bit;
+        flips++;
+      }
+    }
+
+    diff = partial;
+  }
+
+  *shown ^= diff;
+
+  return flips;
+}
+
+size_t bs_frame_flip_step(uint8_t *shown, const uint8_t *target, size_t size,
+  size_t row_size, size_t budget, enum bs_flip_order order) {
+  if(budget == 0) {
+    budget = SIZE_MAX;
+  }
+
+  size_t flipped = 0;
+  int passes = order == BS_FLIP_ORDER_CHECKERBOARD && row_size > 0 ? 2 : 1;
+
+  for(int pass = 0; pass < passes && flipped < budget; pass++) {
+    for(size_t i = 0; i < size && flipped < budget; i++) {
+      uint8_t mask = 0xff;
+
+      if(passes == 2) {
+        // dots with even x + y in the first pass, odd in the second.
+        // The most significant bit of a byte has an even x coordinate.
+        mask = ((i / row_size) & 1) == (size_t) pass ? 0xaa : 0x55;
+      }
+
+      flipped += flip_byte(shown + i, target[i], mask, budget - flipped);
+    }
+  }
+
+  return flipped;
+}
+
+size_t bs_frame_checkerboard(const bs_frame_format_t *format, int width, int height,
+  uint8_t *frame, size_t frame_size) {
+  bs_bitmap_t board = bs_bitmap_new(width, height, 0);
+
+  if(board.bs_bitmap == NULL) {
+    errno = ENOMEM;
+    return 0;
+  }
+
+  // parity is decided on coordinates, the format decides where dots end up
+  for(int y = 0; y < height; y++) {
+    for(int x = 0; x < width; x++) {
+      board.bs_bitmap[(size_t) y * width + x] = (x + y) % 2 == 0 ? 0xff : 0;
+    }
+  }
+
+  bs_view_t view = { board, 0, 0, width, height };
+  size_t size = bs_view_pack(view, format, frame, frame_size, 0);
+
+  bs_bitmap_free(&board);
+
+  return size;
+}
+
+size_t bs_frame_flip_step_masked(uint8_t *shown, const uint8_t *target,
+  const uint8_t *first, size_t size, size_t budget) {
+  if(budget == 0) {
+    budget = SIZE_MAX;
+  }
+
+  size_t flipped = 0;
+
+  for(int pass = 0; pass < 2 && flipped < budget; pass++) {
+    for(size_t i = 0; i < size && flipped < budget; i++) {
+      uint8_t mask = pass == 0 ? first[i] : (uint8_t) ~first[i];
+
+      flipped += flip_byte(shown + i, target[i], mask, budget - flipped);
+    }
+  }
+
+  return flipped;
+}
@@ -0,0 +1,350 @@
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+bs_frame_format_t bs_frame_format_flipdot(void) {
+  bs_frame_format_t format = {
+    BS_SCAN_ROWS, BS_BIT_ORDER_MSB_FIRST, 1, 0, NULL, 0
+  };
+
+  return format;
+}
+
+static bool format_valid(const bs_frame_format_t *format) {
+  return format != NULL
+    && (format->bs_format_scan == BS_SCAN_ROWS
+        || format->bs_format_scan == BS_SCAN_COLUMNS)
+    && (format->bs_format_bit_order == BS_BIT_ORDER_MSB_FIRST
+        || format->bs_format_bit_order == BS_BIT_ORDER_LSB_FIRST)
+    && (format->bs_format_depth == 1 || format->bs_format_depth == 2
+        || format->bs_format_depth == 4)
+    && format->bs_format_band_height >= 0
+    && (format->bs_format_header != NULL || format->bs_format_header_size == 0);
+}
+
+static bool format_is_flipdot(const bs_frame_format_t *format) {
+  // bands don't change anything if every row is packed separately anyways
+  return format->bs_format_scan == BS_SCAN_ROWS
+    && format->bs_format_bit_order == BS_BIT_ORDER_MSB_FIRST
+    && format->bs_format_depth == 1;
+}
+
+bool bs_frame_format_is_bitarray(const bs_frame_format_t *format) {
+  return format_valid(format) && format_is_flipdot(format)
+    && format->bs_format_header_size == 0;
+}
+
+// size of a block of lines packed without any header
+static size_t band_size(const bs_frame_format_t *format, int width, int height) {
+  int depth = format->bs_format_depth;
+
+  if(format->bs_format_scan == BS_SCAN_COLUMNS) {
+    return (size_t) width * (((size_t) height * depth + 7) / 8);
+  } else {
+    return (size_t) height * (((size_t) width * depth + 7) / 8);
+  }
+}
+
+size_t bs_frame_format_size(const bs_frame_format_t *format, int width, int height) {
+  if(!format_valid(format) || width <= 0 || height <= 0) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  int band = format->bs_format_band_height;
+  if(band == 0 || band > height) {
+    band = height;
+  }
+
+  size_t size = format->bs_format_header_size;
+  size_t full_bands = height / band;
+
+  size += full_bands * band_size(format, width, band);
+
+  if(height % band != 0) {
+    size += band_size(format, width, height % band);
+  }
+
+  return size;
+}
+
+// binary bitmaps have a single bit per pixel, grayscale
+// ones are reduced to their most significant bits
+static inline uint8_t quantize(unsigned char p, int depth) {
+  return depth == 1 ? p > 0 : p >> (8 - depth);
+}
+
+// Packs the pixels of line positions pos .. pos + per_byte - 1 into a
+// single byte. line is the index of the first pixel of the line in the
+// bitmap and stride the distance between two of its pixels. Only
+// [lo, hi) is covered by the bitmap, other pixels of the line are def_q
+// and pixels from len on are padding, which is always zero.
+static inline __attribute__((always_inline))
+uint8_t pack_clipped(const unsigned char *pixels, ptrdiff_t line, ptrdiff_t stride,
+  int pos, int lo, int hi, int len, uint8_t def_q, bool lsb_first, int depth) {
+  const int per_byte = 8 / depth;
+  uint8_t acc = 0;
+
+  for(int k = 0; k < per_byte; k++, pos++) {
+    uint8_t q = pos >= lo && pos < hi
+      ? quantize(pixels[line + pos * stride], depth) : def_q;
+
+    q = pos < len ? q : 0;
+    acc |= q << (lsb_first ? k * depth : 8 - (k + 1) * depth);
+  }
+
+  return acc;
+}
+
+// Packs all lines (rows or columns) of view into out. This is
+// only ever called with constant scan order, bit order and depth,
+// so each combination gets a specialized copy with fixed shifts,
+// masks and a fully unrolled loop over the pixels of a byte.
+// Every line is clipped against the bitmap once, so the bytes in
+// between its edges are packed without any bounds checks.
+static inline __attribute__((always_inline))
+void pack_lines(bs_view_t view, uint8_t *out, unsigned char def,
+  bool columns, bool lsb_first, int depth) {
+  bs_bitmap_t b = view.bs_view_bitmap;
+  const int per_byte = 8 / depth;
+
+  int lines = columns ? view.bs_view_width : view.bs_view_height;
+  int line_len = columns ? view.bs_view_height : view.bs_view_width;
+  int line_bytes = (line_len + per_byte - 1) / per_byte;
+
+  // position of the first line and of the first pixel of a line
+  int line_offset = columns ? view.bs_view_offset_x : view.bs_view_offset_y;
+  int pos_offset = columns ? view.bs_view_offset_y : view.bs_view_offset_x;
+  int bitmap_lines = columns ? b.bs_bitmap_width : b.bs_bitmap_height;
+  int bitmap_line_len = columns ? b.bs_bitmap_height : b.bs_bitmap_width;
+  ptrdiff_t line_stride = columns ? 1 : b.bs_bitmap_width;
+  ptrdiff_t stride = columns ? b.bs_bitmap_width : 1;
+
+  // pixels of a line that are within the bitmap, if it is at all
+  int min_pos = -pos_offset > 0 ? -pos_offset : 0;
+  int max_pos = bitmap_line_len - pos_offset < line_len
+    ? bitmap_line_len - pos_offset : line_len;
+
+  uint8_t def_q = quantize(def, depth);
+
+  for(int l = 0; l < lines; l++) {
+    int bitmap_line = line_offset + l;
+    bool inside = bitmap_line >= 0 && bitmap_line < bitmap_lines
+      && min_pos < max_pos;
+    int lo = inside ? min_pos : 0;
+    int hi = inside ? max_pos : 0;
+
+    // index of the line's first pixel, which may lie outside of the bitmap
+    ptrdiff_t line = (ptrdiff_t) bitmap_line * line_stride + (ptrdiff_t) pos_offset * stride;
+
+    // bytes entirely within [lo, hi)
+    int inner_lo = (lo + per_byte - 1) / per_byte;
+    int inner_hi = hi / per_byte;
+    int byte = 0;
+
+    for(; byte < inner_lo; byte++) {
+      *out++ = pack_clipped(b.bs_bitmap, line, stride, byte * per_byte,
+        lo, hi, line_len, def_q, lsb_first, depth);
+    }
+
+    for(; byte < inner_hi; byte++) {
+      const unsigned char *p = b.bs_bitmap + line + (ptrdiff_t) byte * per_byte * stride;
+      uint8_t acc = 0;
+
+      for(int k = 0; k < per_byte; k++) {
+        acc |= quantize(p[k * stride], depth)
+          << (lsb_first ? k * depth : 8 - (k + 1) * depth);
+      }
+
+      *out++ = acc;
+    }
+
+    for(; byte < line_bytes; byte++) {
+      *out++ = pack_clipped(b.bs_bitmap, line, stride, byte * per_byte,
+        lo, hi, line_len, def_q, lsb_first, depth);
+    }
+  }
+}
+
+typedef void (*packer_t)(bs_view_t view, uint8_t *out, unsigned char def);
+
+#define DEFINE_PACKER(name, columns, lsb_first, depth) \
+  static void name(bs_view_t view, uint8_t *out, unsigned char def) { \
+    pack_lines(view, out, def, columns, lsb_first, depth); \
+  }
+
+DEFINE_PACKER(pack_rows_msb_1, false, false, 1)
+DEFINE_PACKER(pack_rows_msb_2, false, false, 2)
+DEFINE_PACKER(pack_rows_msb_4, false, false, 4)
+DEFINE_PACKER(pack_rows_lsb_1, false, true, 1)
+DEFINE_PACKER(pack_rows_lsb_2, false, true, 2)
+DEFINE_PACKER(pack_rows_lsb_4, false, true, 4)
+DEFINE_PACKER(pack_columns_msb_1, true, false, 1)
+DEFINE_PACKER(pack_columns_msb_2, true, false, 2)
+DEFINE_PACKER(pack_columns_msb_4, true, false, 4)
+DEFINE_PACKER(pack_columns_lsb_1, true, true, 1)
+DEFINE_PACKER(pack_columns_lsb_2, true, true, 2)
+DEFINE_PACKER(pack_columns_lsb_4, true, true, 4)
+
+#undef DEFINE_PACKER
+
+// indexed by scan order, bit order and depth / 2
+static const packer_t packers[2][2][3] = {
+  {
+    { pack_rows_msb_1, pack_rows_msb_2, pack_rows_msb_4 },
+    { pack_rows_lsb_1, pack_rows_lsb_2, pack_rows_lsb_4 },
+  },
+  {
+    { pack_columns_msb_1, pack_columns_msb_2, pack_columns_msb_4 },
+    { pack_columns_lsb_1, pack_columns_lsb_2, pack_columns_lsb_4 },
+  },
+};
+
+size_t bs_view_pack(bs_view_t view, const bs_frame_format_t *format,
+  uint8_t *array, size_t size, unsigned char def) {
+  size_t needed = bs_frame_format_size(format, view.bs_view_width,
+    view.bs_view_height);
+
+  if(needed == 0 || size < needed) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  size_t header_size = format->bs_format_header_size;
+
+  if(header_size > 0) {
+    memcpy(array, format->bs_format_header, header_size);
+  }
+
+  uint8_t *out = array + header_size;
+
+  if(format_is_flipdot(format)) {
+    bs_view_bitarray_pack(view, out, size - header_size, def);
+    return needed;
+  }
+
+  packer_t pack = packers[format->bs_format_scan]
+    [format->bs_format_bit_order][format->bs_format_depth / 2];
+
+  int band = format->bs_format_band_height;
+  if(band == 0 || band > view.bs_view_height) {
+    band = view.bs_view_height;
+  }
+
+  // every band is packed as if it was a frame of its own
+  for(int y = 0; y < view.bs_view_height; y += band) {
+    bs_view_t band_view = view;
+    band_view.bs_view_offset_y += y;
+    band_view.bs_view_height = view.bs_view_height - y < band
+      ? view.bs_view_height - y : band;
+
+    pack(band_view, out, def);
+    out += band_size(format, band_view.bs_view_width, band_view.bs_view_height);
+  }
+
+  return needed;
+}
+
+// Sets a single pixel of a frame packed by bs_view_pack() without
+// its header. width and height are the dimensions of the frame.
+static void packed_set(const bs_frame_format_t *format, int width, int height,
+  uint8_t *out, int x, int y, uint8_t q) {
+  int depth = format->bs_format_depth;
+  int per_byte = 8 / depth;
+
+  int band = format->bs_format_band_height;
+  if(band == 0 || band > height) {
+    band = height;
+  }
+
+  out += (y / band) * band_size(format, width, band);
+
+  // the last band may be shorter than the others
+  int band_height = height - (y / band) * band < band
+    ? height - (y / band) * band : band;
+  y %= band;
+
+  bool columns = format->bs_format_scan == BS_SCAN_COLUMNS;
+  int line = columns ? x : y;
+  int pos = columns ? y : x;
+  int line_len = columns ? band_height : width;
+
+  uint8_t *byte = out + (size_t) line * ((line_len + per_byte - 1) / per_byte)
+    + pos / per_byte;
+  int k = pos % per_byte;
+  int shift = format->bs_format_bit_order == BS_BIT_ORDER_LSB_FIRST
+    ? k * depth : 8 - (k + 1) * depth;
+  uint8_t mask = (uint8_t) (((1 << depth) - 1) << shift);
+
+  *byte = (*byte & ~mask) | (uint8_t) (q << shift);
+}
+
+size_t bs_display_list_pack(const bs_display_list_t *list, bs_view_t view,
+  const bs_frame_format_t *format, uint8_t *array, size_t size,
+  unsigned char def) {
+  size_t needed = bs_view_pack(view, format, array, size, def);
+
+  if(needed == 0) {
+    return 0;
+  }
+
+  uint8_t *out = array + format->bs_format_header_size;
+  const bs_placement_t *p = list->bs_list_placements;
+  size_t len = list->bs_list_placements_len;
+
+  // visible part of the view in list coordinates
+  int min_x = view.bs_view_offset_x > 0 ? view.bs_view_offset_x : 0;
+  int min_y = view.bs_view_offset_y > 0 ? view.bs_view_offset_y : 0;
+  int max_x = view.bs_view_offset_x + view.bs_view_width;
+  int max_y = view.bs_view_offset_y + view.bs_view_height;
+
+  if(max_x > list->bs_list_width) {
+    max_x = list->bs_list_width;
+  }
+
+  if(max_y > list->bs_list_height) {
+    max_y = list->bs_list_height;
+  }
+
+  // first placement that could reach into the view, no glyph
+  // is wider than bs_list_max_glyph_width
+  size_t lo = 0;
+  size_t hi = len;
+
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if(p[mid].bs_placement_x + list->bs_list_max_glyph_width <= min_x) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for(size_t i = lo; i < len && p[i].bs_placement_x < max_x; i++) {
+    bs_bitmap_t g = list->bs_list_glyphs[p[i].bs_placement_glyph];
+    int gx = p[i].bs_placement_x;
+    int gy = p[i].bs_placement_y;
+
+    int x0 = gx > min_x ? gx : min_x;
+    int x1 = gx + g.bs_bitmap_width < max_x ? gx + g.bs_bitmap_width : max_x;
+    int y0 = gy > min_y ? gy : min_y;
+    int y1 = gy + g.bs_bitmap_height < max_y ? gy + g.bs_bitmap_height : max_y;
+
+    for(int y = y0; y < y1; y++) {
+      const unsigned char *row = g.bs_bitmap + (size_t) (y - gy) * g.bs_bitmap_width;
+
+      for(int x = x0; x < x1; x++) {
+        if(row[x - gx] > 0) {
+          packed_set(format, view.bs_view_width, view.bs_view_height, out,
+            x - view.bs_view_offset_x, y - view.bs_view_offset_y,
+            quantize(row[x - gx], format->bs_format_depth));
+        }
+      }
+    }
+  }
+
+  return needed;
+}
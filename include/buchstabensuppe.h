@@ -7,6 +7,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>       /* FILE */
+#include <signal.h>      /* sig_atomic_t */
 #include <sys/socket.h>  /* sockaddr */
 
 /*!
@@ -27,8 +29,58 @@ bool bs_utf32_buffer_append(uint32_t *, size_t, bs_utf32_buffer_t *);
 
 bool bs_utf32_buffer_append_single(uint32_t, bs_utf32_buffer_t *);
 
+/*!
+ * @brief Make room for `l` more codepoints
+ *
+ * The capacity is at least doubled if it needs to grow, so appending
+ * repeatedly takes amortized constant time per codepoint.
+ */
+bool bs_utf32_buffer_reserve(bs_utf32_buffer_t *, size_t l);
+
+enum bs_decode_result {
+  BS_DECODE_OK,
+  BS_DECODE_INVALID,  //!< invalid UTF-8, decoded up to the offending sequence
+  BS_DECODE_NOMEM,
+};
+
+/*!
+ * @brief Decode UTF-8 into codepoints
+ *
+ * Decodes the `l` bytes at `s` into `dst` which must have room for `l`
+ * codepoints and stores the number of codepoints written in `len`;
+ * anything in `dst` past that may be overwritten.
+ * Decoding stops at the first invalid sequence. Runs of ASCII are
+ * decoded a block at a time, using SSE2 if available.
+ */
+enum bs_decode_result bs_utf8_decode(const char *s, size_t l, uint32_t *dst,
+  size_t *len);
+
+/*!
+ * @brief Decode UTF-8 and append it to a buffer
+ *
+ * Like bs_utf8_decode(), but appends to `buf`, growing it as needed.
+ */
+enum bs_decode_result bs_utf32_buffer_append_utf8(bs_utf32_buffer_t *buf,
+  const char *s, size_t l);
+
+/*!
+ * @brief Decode UTF-8 into a new buffer
+ *
+ * Sets `errno` to `EINVAL` for invalid input or `ENOMEM`, see
+ * bs_utf32_buffer_append_utf8() for a variant returning the error.
+ */
 bs_utf32_buffer_t bs_decode_utf8(const char *, size_t);
 
+/*!
+ * @brief Length of the grapheme cluster starting at `offset`
+ *
+ * Returns the number of codepoints belonging to the extended grapheme
+ * cluster which starts at `offset` or 0 if `offset` is out of bounds.
+ * Allows rendering a string one grapheme at a time using
+ * bs_render_grapheme_append().
+ */
+size_t bs_utf32_grapheme_length(bs_utf32_buffer_t str, size_t offset);
+
 //! @}
 
 /*!
@@ -116,7 +168,8 @@ void bs_bitmap_copy(bs_bitmap_t destination, int offset_x,
  * @brief Print a representation of a bitmap to stdout
  *
  * Uses the unicode block character to render a representation
- * of the bitmap. If `binary_image` is false, the image is
+ * of the bitmap, see bs_bitmap_export() for other formats and
+ * targets. If `binary_image` is false, the image is
  * considered as a grayscale image and all values greater than
  * 0x80 are rendered as “white” pixels, all below as “black”
  * pixels. Else 1 is “white”, 0 is “black”.
@@ -192,6 +245,10 @@ typedef struct bs_bm_view {
  * [Flidpot UDP protocol](https://wiki.openlab-augsburg.de/Flipdots#per-udp-schnittstelle)
  * requires.
  *
+ * Every row starts with a new byte, so if the width of the
+ * view is not divisible by 8, the last byte of every row is
+ * padded with zero bits.
+ *
  * `view` describes the bitmap to be used and the area
  * of it. `size` will hold the length of the returned array.
  *
@@ -204,6 +261,165 @@ typedef struct bs_bm_view {
  */
 uint8_t *bs_view_bitarray(bs_view_t view, size_t *size, unsigned char def);
 
+/*!
+ * @brief Size of a compacted view
+ *
+ * Returns the number of bytes bs_view_bitarray() and
+ * bs_view_bitarray_pack() produce for the given view.
+ */
+size_t bs_view_bitarray_size(bs_view_t view);
+
+/*!
+ * @brief Compact a binary bitmap into a given buffer
+ *
+ * Like bs_view_bitarray(), but writes the result to `array` which
+ * must be at least `size` bytes big. This allows reusing a single frame
+ * buffer for every frame sent to a display.
+ *
+ * Returns the number of bytes written or 0 if the buffer is too small.
+ */
+size_t bs_view_bitarray_pack(bs_view_t view, uint8_t *array, size_t size,
+  unsigned char def);
+
+/*!
+ * @brief Order pixels are packed in
+ */
+enum bs_scan_order {
+  BS_SCAN_ROWS,     //!< row by row, every row starts with a new byte
+  BS_SCAN_COLUMNS,  //!< column by column, every column starts with a new byte
+};
+
+/*!
+ * @brief Order of pixels within a byte
+ */
+enum bs_bit_order {
+  BS_BIT_ORDER_MSB_FIRST,  //!< first pixel in the most significant bits
+  BS_BIT_ORDER_LSB_FIRST,  //!< first pixel in the least significant bits
+};
+
+/*!
+ * @brief Wire format of a display
+ *
+ * Describes how a display controller expects a frame to be laid out,
+ * so bs_view_pack() can produce a buffer that can be sent as is.
+ *
+ * With a depth of 1 every pixel greater than zero is set. With a depth
+ * of 2 or 4 pixels are expected to be grayscale and reduced to their
+ * most significant bits (see bs_pixel_to_grayscale()).
+ *
+ * If `bs_format_band_height` is not zero, the frame is split into
+ * horizontal bands of that many rows, e. g. the 8 row modules a panel
+ * is made of, which are packed one after another as if they were
+ * separate frames. The last band may have fewer rows.
+ */
+typedef struct bs_frame_format {
+  enum bs_scan_order  bs_format_scan;         //!< order of lines
+  enum bs_bit_order   bs_format_bit_order;    //!< order of pixels within a byte
+  int                 bs_format_depth;        //!< bits per pixel: 1, 2 or 4
+  int                 bs_format_band_height;  //!< rows per band, 0 for no bands
+  const uint8_t      *bs_format_header;       //!< bytes preceding every frame
+  size_t              bs_format_header_size;  //!< number of header bytes
+} bs_frame_format_t;
+
+/*!
+ * @brief Format of common flipdot displays
+ *
+ * Returns the format bs_view_bitarray() produces: row by row, most
+ * significant bit first, 1 bit per pixel without any header.
+ */
+bs_frame_format_t bs_frame_format_flipdot(void);
+
+/*!
+ * @brief Whether a format packs frames like bs_view_bitarray()
+ *
+ * Compares the fields of `format` rather than its bytes, so
+ * e. g. the band height of a format without any effect on the
+ * layout and padding between the fields don't matter.
+ */
+bool bs_frame_format_is_bitarray(const bs_frame_format_t *format);
+
+/*!
+ * @brief Size of a frame in a given format
+ *
+ * Returns the number of bytes a `width` times `height` frame takes up
+ * in `format` including its header or 0 if the format is invalid.
+ */
+size_t bs_frame_format_size(const bs_frame_format_t *format, int width,
+  int height);
+
+/*!
+ * @brief Pack a view in a given wire format
+ *
+ * Like bs_view_bitarray_pack(), but lays out the frame as described by
+ * `format`. Every supported combination of scan order, bit order and
+ * depth has its own specialized packing loop.
+ *
+ * Returns the number of bytes written or 0 if the format is invalid or
+ * the buffer is too small.
+ */
+size_t bs_view_pack(bs_view_t view, const bs_frame_format_t *format,
+  uint8_t *array, size_t size, unsigned char def);
+
+/*!
+ * @brief Composite a display list into a frame
+ *
+ * Packs `view` like bs_view_pack() and draws the glyphs of `list`
+ * intersecting it on top, i. e. the view's bitmap serves as background
+ * (use an empty bitmap for just `def`) and the list's coordinates are
+ * relative to it. Only glyphs which are at least partially visible are
+ * touched, so the cost doesn't depend on the length of the text. Pixels
+ * of a glyph that are 0 are transparent, so overlapping glyphs don't
+ * erase each other. Returns the number of bytes written or 0 on error.
+ */
+struct bs_display_list;
+
+size_t bs_display_list_pack(const struct bs_display_list *list, bs_view_t view,
+  const bs_frame_format_t *format, uint8_t *array, size_t size,
+  unsigned char def);
+
+/*!
+ * @brief Expand a compacted bitmap
+ *
+ * Reverses bs_view_bitarray(): decodes `array` into `bitmap` the way a
+ * flipdot display does, i. e. the frame must have exactly the size
+ * bs_view_bitarray() produces for the dimensions of `bitmap`, otherwise
+ * `false` is returned. Set dots become 1, all other pixels 0.
+ */
+bool bs_bitarray_unpack(bs_bitmap_t bitmap, const uint8_t *array, size_t size);
+
+/*!
+ * @brief Formats a bitmap can be exported in
+ */
+enum bs_export_format {
+  BS_EXPORT_BLOCKS,       //!< terminal preview, a block character per pixel
+  BS_EXPORT_HALF_BLOCKS,  //!< terminal preview, two rows per line of text
+  BS_EXPORT_PBM,          //!< binary portable bitmap (P4)
+  BS_EXPORT_PGM,          //!< binary portable graymap (P5)
+  BS_EXPORT_RAW,          //!< a single frame as packed by bs_view_pack()
+};
+
+/*!
+ * @brief Write a bitmap to a file descriptor
+ *
+ * Writes `bitmap` to `fd` in `export_format`. The output is assembled
+ * in a buffer and written with a few `writev()` calls, so it is fast
+ * even for very wide bitmaps.
+ *
+ * Pixels are interpreted like bs_bitmap_print() does depending on
+ * `binary_image`. Set pixels are white in PBM and PGM output as well,
+ * like they appear on a display. Grayscale images are written to PGM
+ * with all their shades, binary ones as black and white.
+ *
+ * `BS_EXPORT_RAW` packs the whole bitmap as a single frame in
+ * `frame_format` or the flipdot format if it is `NULL`; `frame_format`
+ * is ignored for all other formats.
+ *
+ * Returns `false` and sets `errno` if writing failed or the frame
+ * format is invalid.
+ */
+bool bs_bitmap_export(int fd, bs_bitmap_t bitmap, bool binary_image,
+  enum bs_export_format export_format, const bs_frame_format_t *frame_format);
+
 /*!
  * @brief Axis description
  *
@@ -220,8 +436,9 @@ enum bs_dimension {
  *
  * Advance a bitmap view by `step` in a given dimension. Will return `true`
  * as soon as the bitmap is out of view and wrap around, i. e. sets the offset
- * to `-len`. This is intended to provide the view for the next frame to be
- * rendered to a (flipdot) display.
+ * to `-len` where `len` is the view's width for `BS_DIMENSION_X` and its
+ * height for `BS_DIMENSION_Y`. This is intended to provide the view for the
+ * next frame to be rendered to a (flipdot) display.
  *
  * The given view is expected to be fully intialized and `bs_view_width` and
  * `bs_view_height` to be equal to the dimensions of the target screen. Also
@@ -254,6 +471,76 @@ bool bs_scroll_next_view(bs_view_t *view, int step, enum bs_dimension dim);
  */
 bool bs_page_next_view(bs_view_t *view, int direction, enum bs_dimension dim);
 
+/*!
+ * @brief Move a view horizontally and update its packed frame
+ *
+ * Moves `view` by `step` pixels in `BS_DIMENSION_X` without any
+ * wrapping around and updates `frame`, which must contain the packed
+ * view before the call (see bs_view_bitarray_pack()), to match it.
+ * Instead of packing the whole view again, the rows of `frame` are
+ * shifted by `step` bits and only the columns entering the view are read
+ * from the bitmap. If `step` is negative or not smaller than the view's
+ * width, the view is packed anew.
+ */
+void bs_view_shift_frame(bs_view_t *view, int step, uint8_t *frame,
+  size_t frame_size, unsigned char def);
+
+/*!
+ * @brief Calculates the next packed frame of a horizontal scroll
+ *
+ * Advances `view` like bs_scroll_next_view() in `BS_DIMENSION_X` and
+ * updates `frame`, which must contain the packed view before the call
+ * (see bs_view_bitarray_pack()), to match the new view using
+ * bs_view_shift_frame(). If the view has wrapped around, it is
+ * packed anew.
+ *
+ * @return true if the bitmap has come out of view,
+ *         i. e. the scrolling motion is finished
+ */
+bool bs_scroll_next_frame(bs_view_t *view, int step, uint8_t *frame,
+  size_t frame_size, unsigned char def);
+
+/*!
+ * @brief Contiguous array of packed frames
+ *
+ * Frame `i` starts at `bs_frames + i * bs_frame_size`.
+ */
+typedef struct bs_frames {
+  uint8_t *bs_frames;        //!< Dynamically allocated frame buffer
+  size_t   bs_frames_count;  //!< Number of frames
+  size_t   bs_frame_size;    //!< Size of a single frame in bytes
+} bs_frames_t;
+
+/*!
+ * @brief Precompute all frames of a horizontal scroll
+ *
+ * Packs the frames for `view` and every view bs_scroll_next_view()
+ * produces for it until the scrolling motion is finished, including the
+ * last one, using bs_scroll_next_frame(). Sending them one after another
+ * yields the same animation as packing every view separately.
+ *
+ * On error the returned array has no frames. It must be freed using
+ * bs_frames_free().
+ */
+bs_frames_t bs_scroll_frames(bs_view_t view, int step, unsigned char def);
+
+/*!
+ * @brief Precompute a fixed number of frames of a horizontal movement
+ *
+ * Packs `count` frames, the first for `view` and every following one for
+ * the view moved by another `step` pixels using bs_view_shift_frame().
+ * Unlike bs_scroll_frames() the view never wraps around, which allows
+ * computing frames for several views moving in lockstep, e. g. panels of
+ * a bigger display.
+ */
+bs_frames_t bs_shift_frames(bs_view_t view, int step, size_t count,
+  unsigned char def);
+
+/*!
+ * @brief Free an array of frames
+ */
+void bs_frames_free(bs_frames_t *frames);
+
 /*!
  * @brief Render a bitmap view onto a flipdot display
  *
@@ -273,6 +560,338 @@ bool bs_page_next_view(bs_view_t *view, int direction, enum bs_dimension dim);
 int bs_flipdot_render(int sockfd, struct sockaddr *addr, socklen_t addrlen,
   bs_view_t view, unsigned char overflow_color);
 
+/*!
+ * @brief Render a bitmap view onto a display with a given wire format
+ *
+ * Like bs_flipdot_render(), but packs the view as described by `format`
+ * (see bs_view_pack()) or like bs_view_bitarray() if it is `NULL`. The
+ * packed buffer is exactly what is sent, so displays with a different
+ * layout don't need a second pass over the frame.
+ */
+int bs_flipdot_render_format(int sockfd, struct sockaddr *addr, socklen_t addrlen,
+  bs_view_t view, const bs_frame_format_t *format, unsigned char overflow_color);
+
+/*!
+ * @brief Open a connected socket for a flipdot display
+ *
+ * Looks up `host` and numeric `port` using `getaddrinfo(3)` and returns
+ * a `SOCK_DGRAM` socket `connect(2)`ed to the first address that works.
+ * `family` may be `AF_UNSPEC`, `AF_INET` or `AF_INET6`. Since the
+ * destination is fixed, sending to it doesn't need to pass the address
+ * on every frame. Returns -1 on error.
+ */
+int bs_flipdot_connect(const char *host, const char *port, int family);
+
+/*!
+ * @brief Look up the address of a flipdot display
+ *
+ * Like bs_flipdot_connect(), but stores the first address found for
+ * `host` and `port` in `addr`, e. g. to be used as the destination of a
+ * bs_flipdot_frame_t. Returns `false` if the lookup fails.
+ */
+bool bs_flipdot_resolve(const char *host, const char *port, int family,
+  struct sockaddr_storage *addr, socklen_t *addrlen);
+
+/*!
+ * @brief Render a bitmap view onto a flipdot display using a given buffer
+ *
+ * Like bs_flipdot_render(), but packs the view into the caller owned
+ * buffer `frame` of size `frame_size` (see bs_frame_format_size()) and
+ * sends it using a connected socket, e. g. one returned by
+ * bs_flipdot_connect(). This allows sending frames without allocating.
+ * The view is packed in the given wire format, so `frame` is sent as is.
+ *
+ * @param sockfd          file descriptor of a connected `SOCK_DGRAM` socket
+ * @param view            bitmap view to render
+ * @param format          wire format of the display or `NULL` for the
+ *                        format returned by bs_frame_format_flipdot()
+ * @param frame           buffer to pack the view into
+ * @param frame_size      size of `frame` in bytes
+ * @param overflow_color  value area outside of the picture should get
+ */
+int bs_flipdot_send(int sockfd, bs_view_t view, const bs_frame_format_t *format,
+  uint8_t *frame, size_t frame_size, unsigned char overflow_color);
+
+/*!
+ * @brief Precomputed frame to be sent by bs_flipdot_send_frames()
+ */
+typedef struct bs_flipdot_frame {
+  const uint8_t         *bs_frame_data;     //!< packed frame
+  size_t                 bs_frame_size;     //!< size of the packed frame
+  const struct sockaddr *bs_frame_addr;     //!< destination or `NULL` for connected sockets
+  socklen_t              bs_frame_addrlen;  //!< length of the destination address
+} bs_flipdot_frame_t;
+
+/*!
+ * @brief Send many frames at once
+ *
+ * Sends a batch of already packed frames, e. g. all frames of an
+ * animation or one frame for each panel of a bigger display, using
+ * as few `sendmmsg(2)` calls as possible. To address several panels,
+ * use an unconnected socket and set the destination of every frame.
+ *
+ * Returns the number of frames sent or -1 if the first frame
+ * could not be sent.
+ */
+ssize_t bs_flipdot_send_frames(int sockfd, const bs_flipdot_frame_t *frames,
+  size_t count);
+
+/*!
+ * @brief Fingerprint of a packed frame
+ *
+ * 64 bit FNV-1a hash of the given frame.
+ */
+uint64_t bs_frame_hash(const uint8_t *frame, size_t size);
+
+/*!
+ * @brief Tracks the frame last sent to a display
+ *
+ * Used by bs_frame_filter_check() to suppress sending frames a display
+ * is already showing. Should be initialized using bs_frame_filter_init().
+ */
+typedef struct bs_frame_filter {
+  bool     bs_filter_valid;      //!< whether a frame has been sent yet
+  uint64_t bs_filter_hash;       //!< fingerprint of the frame last sent
+  size_t   bs_filter_size;       //!< size of the frame last sent
+  uint64_t bs_filter_last_sent;  //!< time the last frame was sent
+  uint64_t bs_filter_sent;       //!< number of frames that had to be sent
+  uint64_t bs_filter_skipped;    //!< number of frames that were suppressed
+} bs_frame_filter_t;
+
+void bs_frame_filter_init(bs_frame_filter_t *filter);
+
+/*!
+ * @brief Decide whether a frame needs to be sent
+ *
+ * Returns `false` if `frame` is identical to the frame last sent,
+ * unless more than `keepalive` nanoseconds have passed since then, so
+ * displays which lost their state are refreshed eventually. A `keepalive`
+ * of 0 disables this. If `true` is returned, the frame is assumed to
+ * be sent at `now` (see bs_clock_now()).
+ */
+bool bs_frame_filter_check(bs_frame_filter_t *filter, const uint8_t *frame,
+  size_t size, uint64_t now, uint64_t keepalive);
+
+/*!
+ * @brief Count dots which differ between two packed frames
+ *
+ * This is the number of dots an electromechanical display has to
+ * flip physically to change from frame `from` to frame `to`.
+ */
+size_t bs_frame_flip_count(const uint8_t *from, const uint8_t *to, size_t size);
+
+/*!
+ * @brief Order in which bs_frame_flip_step() changes dots
+ */
+enum bs_flip_order {
+  BS_FLIP_ORDER_ROWS,          //!< row by row, from the top left
+  BS_FLIP_ORDER_CHECKERBOARD,  //!< every other dot first, then the rest
+};
+
+/*!
+ * @brief Move a frame towards a target frame with a limited number of flips
+ *
+ * Changes at most `budget` dots of `shown`, the frame a display currently
+ * shows, to match `target`. Calling this repeatedly and sending `shown`
+ * after every step splits a big transition into intermediate frames which
+ * don't exceed the number of flips the hardware can handle per update.
+ * A `budget` of 0 means no limit.
+ *
+ * `BS_FLIP_ORDER_CHECKERBOARD` assumes frames packed like
+ * bs_view_bitarray_pack() does. For other formats, use
+ * bs_frame_flip_step_masked() with a mask from bs_frame_checkerboard().
+ *
+ * @param shown     packed frame to update
+ * @param target    packed frame to converge to
+ * @param size      size of both frames in bytes
+ * @param row_size  size of a single row in bytes, i. e. `(width + 7) / 8`
+ * @param budget    maximum number of dots to flip
+ * @param order     order to flip the dots in
+ *
+ * @return number of dots flipped, `shown` equals `target` if this is
+ *         smaller than `budget`
+ */
+size_t bs_frame_flip_step(uint8_t *shown, const uint8_t *target, size_t size,
+  size_t row_size, size_t budget, enum bs_flip_order order);
+
+/*!
+ * @brief Pack a checkerboard in the given format
+ *
+ * Packs a `width` by `height` frame in which exactly the dots with an
+ * even sum of coordinates are set, to be passed to
+ * bs_frame_flip_step_masked(). Returns its size or 0 on error, like
+ * bs_view_pack().
+ */
+size_t bs_frame_checkerboard(const bs_frame_format_t *format, int width,
+  int height, uint8_t *frame, size_t frame_size);
+
+/*!
+ * @brief Move a frame towards a target frame, some dots first
+ *
+ * Like bs_frame_flip_step(), but the dots set in the packed frame
+ * `first` are flipped before all others, e. g. the ones of
+ * bs_frame_checkerboard(), which works for frames of any format with
+ * one bit per pixel.
+ */
+size_t bs_frame_flip_step_masked(uint8_t *shown, const uint8_t *target,
+  const uint8_t *first, size_t size, size_t budget);
+
+/*!
+ * @brief Effect used to change from one frame to another
+ */
+enum bs_transition {
+  BS_TRANSITION_WIPE,      //!< new frame is revealed from left to right
+  BS_TRANSITION_PUSH,      //!< new frame pushes the old one out at the top
+  BS_TRANSITION_DISSOLVE,  //!< new frame appears in an ordered dither pattern
+  BS_TRANSITION_BLINDS,    //!< new frame is revealed row by row in slats of 8 rows
+};
+
+/*!
+ * @brief Compute an intermediate frame of a transition
+ *
+ * Writes frame `step` of `steps` of changing from the packed frame
+ * `from` to the packed frame `to` to `frame`, i. e. step 0 is `from`
+ * and step `steps` is `to`. All frames are `width` times `height` pixels
+ * packed in `format` or the flipdot format if it is `NULL`. The header
+ * is taken from `to`. `frame` may be the same buffer as `from`, but must
+ * not overlap `to`.
+ *
+ * Frames are only combined row- or bytewise, so this works for formats
+ * which pack rows of 1 bit pixels. Returns `false` for other formats or
+ * if `step` is out of range.
+ */
+bool bs_frame_transition(enum bs_transition transition, int step, int steps,
+  const bs_frame_format_t *format, int width, int height,
+  const uint8_t *from, const uint8_t *to, uint8_t *frame);
+
+/*!
+ * @brief Pack an intermediate frame of a transition between two views
+ *
+ * Like bs_frame_transition(), but packs the views `from` and `to`, which
+ * must have the same dimensions, like bs_view_pack() does first. Returns
+ * the number of bytes written to `frame` or 0 on error.
+ */
+size_t bs_view_transition(enum bs_transition transition, int step, int steps,
+  const bs_frame_format_t *format, bs_view_t from, bs_view_t to,
+  uint8_t *frame, size_t size, unsigned char def);
+
+//! @}
+
+/*!
+ * @name Memory Management
+ * @{
+ */
+
+/*!
+ * @brief Pluggable allocator
+ *
+ * Set of functions used by a bs_context_t to allocate the memory it
+ * owns. `bs_allocator_user` is passed as first argument to each of them.
+ * The functions must behave like their counterparts from `stdlib.h`.
+ */
+typedef struct bs_allocator {
+  void *(*bs_allocator_malloc)(void *user, size_t size);
+  void *(*bs_allocator_realloc)(void *user, void *ptr, size_t size);
+  void  (*bs_allocator_free)(void *user, void *ptr);
+  void   *bs_allocator_user;
+} bs_allocator_t;
+
+/*!
+ * @brief Allocator using `malloc(3)`, `realloc(3)` and `free(3)`
+ */
+bs_allocator_t bs_allocator_default(void);
+
+/*!
+ * @brief Allocator which never allocates
+ *
+ * Every allocation fails with `ENOMEM`, freeing does nothing. Used for
+ * memory which is sized once and must not grow, see bs_arena_init_buffer().
+ */
+bs_allocator_t bs_allocator_none(void);
+
+struct bs_arena_block;
+
+/*!
+ * @brief Bump allocator for temporary memory
+ *
+ * An arena hands out memory from a single buffer by incrementing an
+ * offset. Individual allocations can't be freed, instead the whole arena
+ * is reset at once in constant time. If an allocation doesn't fit into
+ * the buffer, an overflow block is requested from the arena's allocator.
+ * On the next reset the buffer is grown to hold all memory used before,
+ * so repeating the same allocations doesn't touch the allocator again.
+ */
+typedef struct bs_arena {
+  bs_allocator_t          bs_arena_allocator;     //!< Allocator for the buffer
+  unsigned char          *bs_arena_buffer;        //!< Main buffer
+  size_t                  bs_arena_used;          //!< Bytes used of the main buffer
+  size_t                  bs_arena_cap;           //!< Size of the main buffer
+  struct bs_arena_block  *bs_arena_overflow;      //!< Blocks allocated since the last reset
+  size_t                  bs_arena_overflow_size; //!< Total size of the overflow blocks
+} bs_arena_t;
+
+/*!
+ * @brief Initialize an empty arena using the given allocator
+ */
+void bs_arena_init(bs_arena_t *arena, bs_allocator_t allocator);
+
+/*!
+ * @brief Initialize an arena using a fixed buffer
+ *
+ * All allocations are taken from the `size` bytes at `buffer`, which the
+ * caller keeps ownership of. Once it is full, bs_arena_alloc() returns
+ * `NULL` instead of allocating an overflow block, so the arena never
+ * touches the heap. Allocations are aligned relative to `buffer`.
+ */
+void bs_arena_init_buffer(bs_arena_t *arena, void *buffer, size_t size);
+
+/*!
+ * @brief Free all memory held by an arena
+ */
+void bs_arena_free(bs_arena_t *arena);
+
+/*!
+ * @brief Allocate memory from an arena
+ *
+ * Returns a pointer to `size` bytes suitably aligned for any type or
+ * `NULL` if no memory could be allocated. The memory is valid until the
+ * next call to bs_arena_reset() or bs_arena_free().
+ */
+void *bs_arena_alloc(bs_arena_t *arena, size_t size);
+
+/*!
+ * @brief Position in an arena
+ *
+ * Returned by bs_arena_mark() to be used with bs_arena_rollback().
+ */
+typedef struct bs_arena_mark {
+  struct bs_arena_block *bs_mark_block;
+  size_t                 bs_mark_used;
+} bs_arena_mark_t;
+
+/*!
+ * @brief Remember the current position of an arena
+ */
+bs_arena_mark_t bs_arena_mark(bs_arena_t *arena);
+
+/*!
+ * @brief Release everything allocated since a mark
+ *
+ * Memory allocated after bs_arena_mark() returned `mark` is made
+ * available again. If an overflow block has been allocated in the
+ * meantime, only the memory allocated after it is released, the rest
+ * is released on the next reset.
+ */
+void bs_arena_rollback(bs_arena_t *arena, bs_arena_mark_t mark);
+
+/*!
+ * @brief Release all memory allocated from an arena
+ *
+ * Constant time unless overflow blocks had to be allocated since
+ * the last reset, in which case the main buffer is grown.
+ */
+void bs_arena_reset(bs_arena_t *arena);
+
 //! @}
 
 /*!
@@ -281,33 +900,121 @@ int bs_flipdot_render(int sockfd, struct sockaddr *addr, socklen_t addrlen,
  */
 
 typedef struct hb_font_t hb_font_t;
+typedef struct hb_buffer_t hb_buffer_t;
 typedef struct SFT_Font SFT_Font;
 
+//! Codepoints below this may be rendered without shaping, i. e. Latin-1
+#define BS_SIMPLE_CODEPOINTS 0x100
+
+/*
+ * Limits of the static memory profile, set by the `static_memory` meson
+ * option together with `BS_STATIC_MEMORY`. Programs using the library
+ * get the same values from pkg-config.
+ */
+#ifndef BS_STATIC_MAX_TEXT_LENGTH
+//! Most codepoints rendered at once in the static profile
+#define BS_STATIC_MAX_TEXT_LENGTH 1024
+#endif
+#ifndef BS_STATIC_GLYPH_POOL_SIZE
+//! Bytes available for rasterizing a glyph in the static profile
+#define BS_STATIC_GLYPH_POOL_SIZE 16384
+#endif
+
+//! Scratch memory of a context needed in the static profile
+#define BS_STATIC_SCRATCH_SIZE \
+  (BS_STATIC_MAX_TEXT_LENGTH * sizeof(uint32_t) + BS_STATIC_GLYPH_POOL_SIZE + 64)
+
+/*!
+ * @brief A loaded font
+ *
+ * When a font is added, it is determined which codepoints below
+ * #BS_SIMPLE_CODEPOINTS shaping can't change: those whose glyph isn't
+ * affected by any GSUB or GPOS lookup of the font. A grapheme consisting
+ * of just such a codepoint is laid out using the glyph and advance stored
+ * here, skipping HarfBuzz entirely. If all of them have the same advance,
+ * as in monospace fonts like GNU Unifont, it is stored as
+ * `bs_font_monospace_advance`.
+ */
 typedef struct bs_font {
   hb_font_t      *bs_font_hb;
   SFT_Font       *bs_font_schrift;
   unsigned char  *bs_font_file;
   size_t          bs_font_file_size;
   unsigned int    bs_font_pixel_height;
+
+  uint32_t        bs_font_simple_glyphs[BS_SIMPLE_CODEPOINTS];    //!< 0 if shaping is required
+  int32_t         bs_font_simple_advances[BS_SIMPLE_CODEPOINTS];
+  int32_t         bs_font_monospace_advance;                      //!< 0 if not monospace
 } bs_font_t;
 
 enum bs_rendering_flag {
-  BS_RENDER_BINARY      = 0x01,
-  BS_RENDER_NO_FALLBACK = 0x04,
+  BS_RENDER_BINARY       = 0x01,
+  BS_RENDER_NO_FALLBACK  = 0x04,
+  BS_RENDER_ALWAYS_SHAPE = 0x08,  //!< don't skip shaping for simple text
 };
 
+/*!
+ * @brief Fonts and settings used for rendering
+ *
+ * If `bs_clip_width` and `bs_clip_height` are both positive, only the
+ * rectangle from `(0, 0)` to `(bs_clip_width, bs_clip_height)` of the
+ * rendered text is produced: bs_render_utf8_string() returns a bitmap of
+ * exactly that size, glyphs outside of it are skipped without being
+ * rasterized and rendering stops once the cursor has left the clip on the
+ * right. This is useful if only as much as fits a display is ever shown.
+ * Both default to 0, i. e. no clipping.
+ *
+ * With `BS_STATIC_MEMORY` the scratch memory used while rendering lives
+ * in the context itself, so a context must not be moved after it has
+ * been initialized.
+ */
 typedef struct bs_context {
-  bs_font_t  *bs_fonts;
-  size_t      bs_fonts_len;
+  bs_font_t      *bs_fonts;
+  size_t          bs_fonts_len;
+
+  int             bs_rendering_flags;
+
+  int             bs_clip_width;      //!< width of the clip, see bs_context_t
+  int             bs_clip_height;     //!< height of the clip, see bs_context_t
 
-  int         bs_rendering_flags;
+  bs_allocator_t  bs_allocator;       //!< allocator for memory owned by the context
+  bs_arena_t      bs_arena;           //!< scratch memory for a single render
+  hb_buffer_t    *bs_hb_buffer;       //!< reused for shaping every grapheme
+#ifdef BS_STATIC_MEMORY
+  uint64_t        bs_scratch[(BS_STATIC_SCRATCH_SIZE + 7) / 8]; //!< backs `bs_arena`
+#endif
 } bs_context_t;
 
 void bs_context_init(bs_context_t *);
 
-void bs_context_free(bs_context_t *);
-
-bool bs_add_font(bs_context_t *, const char *, int, unsigned int);
+/*!
+ * @brief Initialize a context using a custom allocator
+ *
+ * All memory owned by the context, i. e. loaded fonts and scratch memory
+ * used while rendering, is allocated using `allocator`. Temporary memory
+ * is reused across renders, so rendering the same text repeatedly doesn't
+ * call the allocator after the first time. Bitmaps returned to the caller
+ * are still allocated using `malloc(3)`, so they can be freed with
+ * bs_bitmap_free().
+ */
+void bs_context_init_allocator(bs_context_t *, bs_allocator_t allocator);
+
+/*!
+ * @brief Initialize a context with fixed scratch memory
+ *
+ * Like bs_context_init_allocator(), but the scratch memory used while
+ * rendering is the `size` bytes at `scratch`, which are never grown.
+ * Rendering a text which doesn't fit fails with `ENOMEM` instead. The
+ * allocator is then only used for loading fonts. In the static memory
+ * profile, bs_context_init() and bs_context_init_allocator() do this with
+ * #BS_STATIC_SCRATCH_SIZE bytes inside the context.
+ */
+void bs_context_init_scratch(bs_context_t *, bs_allocator_t allocator,
+  void *scratch, size_t size);
+
+void bs_context_free(bs_context_t *);
+
+bool bs_add_font(bs_context_t *, const char *, int, unsigned int);
 
 typedef struct bs_cursor {
   int bs_cursor_x;
@@ -316,12 +1023,975 @@ typedef struct bs_cursor {
 
 bs_bitmap_t bs_render_utf8_string(bs_context_t *, const char *, size_t);
 
+/*!
+ * @brief Render a UTF-8 string into an existing bitmap
+ *
+ * Clears `target` and renders the part of the string that fits into it,
+ * as if the clip of the context was the size of `target`, which is owned
+ * by the caller and may be of any size. Doesn't
+ * allocate anything once the scratch memory of the context suffices, so
+ * with fixed scratch memory, see bs_context_init_scratch(), and a
+ * statically allocated `target` rendering never touches the heap.
+ * Returns `false` and sets `errno` if rendering fails, e. g. to `ENOMEM`
+ * if the text doesn't fit into the scratch memory.
+ */
+bool bs_render_utf8_into(bs_context_t *, const char *, size_t, bs_bitmap_t target);
+
 bool bs_render_grapheme_append(bs_context_t *, bs_bitmap_t *, bs_cursor_t *,
   bs_utf32_buffer_t, size_t, size_t);
 
+/*!
+ * @brief Measure a grapheme cluster without rasterizing it
+ *
+ * Stores how far bs_render_grapheme_append() would move the cursor for the
+ * grapheme cluster of `len` codepoints at `offset` of `str` in `advance`.
+ * Only shapes the cluster, no glyph is rasterized. Returns `false` under
+ * the same conditions as bs_render_grapheme_append().
+ */
+bool bs_grapheme_advance(bs_context_t *, bs_utf32_buffer_t str, size_t offset,
+  size_t len, int *advance);
+
+/*!
+ * @brief Render a UTF-32 string at the cursor
+ *
+ * Renders `str` into the given bitmap starting at the cursor, which is
+ * moved past the rendered text. The bitmap is only extended if the text
+ * doesn't fit, so rendering repeatedly into a bitmap which is large
+ * enough doesn't allocate anything once the scratch memory of the
+ * context has grown to the size it needs.
+ */
 bool bs_render_utf32_string_append(bs_context_t *, bs_bitmap_t *,
   bs_cursor_t *, bs_utf32_buffer_t);
 
+/*!
+ * @brief Position of a glyph in a display list
+ */
+typedef struct bs_placement {
+  uint32_t  bs_placement_glyph;   //!< index into `bs_list_glyphs`
+  int       bs_placement_x;       //!< left edge of the glyph bitmap
+  int       bs_placement_y;       //!< top edge of the glyph bitmap
+} bs_placement_t;
+
+/*!
+ * @brief Rendered text as a list of glyph placements
+ *
+ * Instead of blitting every glyph into one bitmap of the full width of
+ * the text, every distinct glyph is rasterized once and only referenced
+ * by its placements, so memory use scales with the number of distinct
+ * glyphs rather than with the width of the text. Placements are sorted by
+ * their x coordinate. `bs_list_width` and `bs_list_height` are the size
+ * the bitmap returned by bs_render_utf8_string() would have, glyphs are
+ * cut off at its edges.
+ *
+ * Use bs_display_list_pack() to composite the glyphs visible in a view
+ * directly into a frame.
+ */
+typedef struct bs_display_list {
+  bs_bitmap_t     *bs_list_glyphs;          //!< rasterized glyphs
+  size_t           bs_list_glyphs_len;
+  size_t           bs_list_glyphs_cap;
+  uint64_t        *bs_list_glyph_keys;      //!< font index and glyph id of each glyph
+  uint32_t        *bs_list_index;           //!< hash table of glyph index + 1, 0 if empty
+  size_t           bs_list_index_cap;
+  bs_placement_t  *bs_list_placements;
+  size_t           bs_list_placements_len;
+  size_t           bs_list_placements_cap;
+  int              bs_list_width;
+  int              bs_list_height;
+  int              bs_list_max_glyph_width; //!< bounds the search for visible glyphs
+} bs_display_list_t;
+
+/*!
+ * @brief Render a UTF-8 string into a display list
+ *
+ * Like bs_render_utf8_string(), but produces a bs_display_list_t which
+ * must be freed using bs_display_list_free() even if rendering fails.
+ * Returns `false` on error, in which case the list contains everything
+ * rendered up to the error.
+ */
+bool bs_render_utf8_display_list(bs_context_t *, const char *, size_t,
+  bs_display_list_t *);
+
+void bs_display_list_free(bs_display_list_t *);
+
+/*!
+ * @brief Rectangle in bitmap coordinates
+ */
+typedef struct bs_rect {
+  int bs_rect_x;
+  int bs_rect_y;
+  int bs_rect_width;
+  int bs_rect_height;
+} bs_rect_t;
+
+/*!
+ * @brief Position of a grapheme cluster in a rendered text
+ */
+typedef struct bs_grapheme_layout {
+  size_t  bs_layout_offset;   //!< index of the first codepoint
+  size_t  bs_layout_len;      //!< number of codepoints
+  int     bs_layout_x;        //!< cursor position before rendering it
+} bs_grapheme_layout_t;
+
+/*!
+ * @brief Text that is rendered again whenever it changes
+ *
+ * Keeps the last text, the position of its grapheme clusters and its
+ * bitmap, so an update which only changes a few grapheme clusters, like a
+ * clock going from `12:34` to `12:35`, only needs to shape and rasterize
+ * those and their direct neighbours. The rest of the bitmap is kept or
+ * moved if the width of the changed part differs.
+ *
+ * The result is the same as rendering the whole text with
+ * bs_render_utf8_string(), except for pixels of glyphs reaching beyond
+ * their own advance into a neighbouring grapheme cluster that is not
+ * rendered again, and the bitmap never getting less high.
+ */
+typedef struct bs_retained_text {
+  bs_utf32_buffer_t      bs_retained_string;
+  bs_grapheme_layout_t  *bs_retained_graphemes;
+  size_t                 bs_retained_graphemes_len;
+  int                    bs_retained_cursor_x;  //!< cursor position after the text
+  bs_bitmap_t            bs_retained_bitmap;    //!< the rendered text
+} bs_retained_text_t;
+
+void bs_retained_text_init(bs_retained_text_t *);
+
+/*!
+ * @brief Replace the text and render what has changed
+ *
+ * Updates `bs_retained_bitmap` to show the UTF-8 string `s` of length `l`
+ * and stores the part of the bitmap whose pixels changed in `dirty`,
+ * which is empty if the text is unchanged. The dirty rectangle may extend
+ * beyond the new bitmap if it got narrower. On error `false` is returned
+ * and the previous text is kept.
+ */
+bool bs_retained_text_update(bs_context_t *, bs_retained_text_t *,
+  const char *s, size_t l, bs_rect_t *dirty);
+
+void bs_retained_text_free(bs_retained_text_t *);
+
+//! @}
+
+/*!
+ * @name Paragraphs
+ *
+ * Text broken into lines for panels high enough to show more than one,
+ * e. g. two rows of panels stacked on top of each other. Line break
+ * opportunities follow a simplified version of UAX #14: lines are broken
+ * after spaces, hyphens and before or after ideographs, never before
+ * closing or after opening punctuation, and always after newlines.
+ *
+ * The advance of every grapheme cluster is measured once when the text is
+ * set, so breaking it into lines of another width is pure arithmetic.
+ * Lines are only rasterized once a view showing them is rendered, e. g.
+ * while paging through the paragraph using bs_page_next_view() or
+ * bs_scroll_next_view() in `BS_DIMENSION_Y`.
+ * @{
+ */
+
+enum bs_line_break {
+  BS_BREAK_NONE,       //!< no line may start here
+  BS_BREAK_ALLOWED,    //!< a line may start here
+  BS_BREAK_MANDATORY,  //!< a line has to start here
+};
+
+/*!
+ * @brief Line break opportunity before a codepoint
+ *
+ * Returns whether a line may start with the codepoint at `offset` of
+ * `str`, as described above. There is no opportunity before the first
+ * codepoint, the end of the string is a mandatory one.
+ */
+enum bs_line_break bs_utf32_line_break(bs_utf32_buffer_t str, size_t offset);
+
+typedef struct bs_line {
+  size_t  bs_line_start;      //!< index of the first grapheme cluster
+  size_t  bs_line_end;        //!< index after the last one, without trailing spaces
+  int     bs_line_width;      //!< width without trailing spaces
+  bool    bs_line_rendered;   //!< whether it has been rasterized
+} bs_line_t;
+
+/*!
+ * @brief Text broken into lines of a given width
+ *
+ * `bs_paragraph_bitmap` is `bs_paragraph_width` wide and has a band of
+ * `bs_paragraph_line_height` rows for every line, which stays blank until
+ * the line is rendered by bs_paragraph_render_view(). Glyphs are cut off
+ * at the edges of their line's band.
+ */
+typedef struct bs_paragraph {
+  bs_utf32_buffer_t      bs_paragraph_string;
+  bs_grapheme_layout_t  *bs_paragraph_graphemes;   //!< `bs_layout_x` is relative to the line
+  int                   *bs_paragraph_advances;    //!< measured advance of every grapheme cluster
+  unsigned char         *bs_paragraph_breaks;      //!< bs_line_break before every grapheme cluster
+  size_t                 bs_paragraph_graphemes_len;
+  bs_line_t             *bs_paragraph_lines;
+  size_t                 bs_paragraph_lines_len;
+  int                    bs_paragraph_width;       //!< width the lines are broken at
+  int                    bs_paragraph_line_height;
+  bs_bitmap_t            bs_paragraph_bitmap;
+} bs_paragraph_t;
+
+void bs_paragraph_init(bs_paragraph_t *);
+
+/*!
+ * @brief Set the text of a paragraph
+ *
+ * Decodes the UTF-8 string `s` of length `l`, finds its line break
+ * opportunities and measures its grapheme clusters using the fonts of the
+ * context. The line height is the largest pixel height of these fonts.
+ * The paragraph needs to be wrapped using bs_paragraph_wrap() afterwards.
+ * On error `false` is returned and the paragraph is left empty.
+ */
+bool bs_paragraph_set_text(bs_context_t *, bs_paragraph_t *, const char *s,
+  size_t l);
+
+/*!
+ * @brief Break a paragraph into lines of at most `width` pixels
+ *
+ * Lines are filled greedily, spaces at their end don't count towards
+ * their width. A word wider than a line is broken wherever it doesn't
+ * fit. Allocates a blank `bs_paragraph_bitmap` of the new size, so views
+ * of the previous one need to be created again. Nothing is measured or
+ * rasterized. Returns `false` if allocating memory fails.
+ */
+bool bs_paragraph_wrap(bs_paragraph_t *, int width);
+
+/*!
+ * @brief Rasterize the lines shown by a view of a paragraph
+ *
+ * Renders every line of the paragraph that overlaps the rows shown by
+ * `view`, which needs to be a view of `bs_paragraph_bitmap`, unless it has
+ * been rendered already. Returns `false` if rendering fails.
+ */
+bool bs_paragraph_render_view(bs_context_t *, bs_paragraph_t *, bs_view_t view);
+
+void bs_paragraph_free(bs_paragraph_t *);
+
+//! @}
+
+/*!
+ * @name Layouts
+ *
+ * A layout splits a frame into rectangular regions, each showing its own
+ * text rendered using its own context, i. e. font set and rendering
+ * flags, which is either static, scrolled or paged at its own pace, e. g.
+ * a fixed line number next to a scrolling destination. The layout keeps
+ * track of which regions changed, so only those are packed again, and a
+ * region's text is only rendered when it is set.
+ * @{
+ */
+
+/*!
+ * @brief How a region shows its text
+ */
+enum bs_region_mode {
+  BS_REGION_STATIC,  //!< the start of the text, as far as it fits
+  BS_REGION_SCROLL,  //!< scrolled through the region, see bs_scroll_next_view()
+  BS_REGION_PAGE,    //!< page by page, see bs_page_next_view()
+};
+
+/*!
+ * @brief Part of a layout
+ */
+typedef struct bs_region {
+  bs_context_t        *bs_region_ctx;        //!< context the text is rendered with
+  bs_rect_t            bs_region_rect;       //!< position and size within the frame
+  enum bs_region_mode  bs_region_mode;
+  int                  bs_region_step;       //!< pixels to scroll by
+  uint64_t             bs_region_period;     //!< nanoseconds between steps or pages
+  bs_retained_text_t   bs_region_text;       //!< rendered text
+  bs_view_t            bs_region_view;       //!< part of the text currently shown
+  uint64_t             bs_region_next_tick;  //!< time of the next step or 0
+  bool                 bs_region_dirty;      //!< whether it needs to be packed again
+} bs_region_t;
+
+/*!
+ * @brief Frame made up of independently updated regions
+ */
+typedef struct bs_layout {
+  int            bs_layout_width;         //!< width of the frame
+  int            bs_layout_height;        //!< height of the frame
+  unsigned char  bs_layout_def;           //!< value of pixels without text
+  bs_region_t   *bs_layout_regions;
+  size_t         bs_layout_regions_len;
+  uint8_t       *bs_layout_scratch;       //!< a region's packed view
+  size_t         bs_layout_scratch_size;
+  bool           bs_layout_packed;        //!< whether the frame has been packed yet
+} bs_layout_t;
+
+/*!
+ * @brief Initialize an empty layout for a `width` times `height` frame
+ */
+void bs_layout_init(bs_layout_t *layout, int width, int height,
+  unsigned char def);
+
+/*!
+ * @brief Free a layout and the text of its regions
+ *
+ * The contexts of the regions are owned by the caller.
+ */
+void bs_layout_free(bs_layout_t *layout);
+
+/*!
+ * @brief Add a region to a layout
+ *
+ * Adds a region at `rect`, which must lie within the frame, whose text
+ * is rendered using `ctx`. Regions shouldn't overlap. Scrolling regions
+ * move by `step` pixels, paging ones by a page, every `period`
+ * nanoseconds, both are ignored for static regions. Returns the index of
+ * the new region or -1 on error.
+ */
+int bs_layout_add_region(bs_layout_t *layout, bs_context_t *ctx, bs_rect_t rect,
+  enum bs_region_mode mode, int step, uint64_t period);
+
+/*!
+ * @brief Set the text of a region
+ *
+ * Renders the UTF-8 string `s` of length `l` for the region with index
+ * `region`. Only the graphemes which changed are rendered again (see
+ * bs_retained_text_update()), and nothing is done if the text didn't
+ * change at all. Otherwise the region's animation starts over.
+ */
+bool bs_layout_set_text(bs_layout_t *layout, int region, const char *s, size_t l);
+
+/*!
+ * @brief Advance the regions' animations
+ *
+ * Moves every animated region whose period has passed at `now` (see
+ * bs_clock_now()) on by one step or page. Returns `true` if any region
+ * needs to be packed again.
+ */
+bool bs_layout_tick(bs_layout_t *layout, uint64_t now);
+
+/*!
+ * @brief Pack the layout into a frame
+ *
+ * Packs the layout in the format of bs_view_bitarray_pack() into
+ * `frame` of `size` bytes. Only regions which changed since the last
+ * call are packed, the rest of `frame` must be unchanged since then.
+ * Returns the size of the frame or 0 if `size` is too small.
+ */
+size_t bs_layout_pack(bs_layout_t *layout, uint8_t *frame, size_t size);
+
+//! @}
+
+/*!
+ * @name Compact Bitmaps
+ *
+ * Read only encoding of binary bitmaps for keeping many pre-rendered
+ * messages in memory. Instead of a byte per pixel, spans of 8 columns are
+ * stored as a byte per row and spans without any set pixel are left out
+ * entirely. Any view of a compact bitmap can be packed without decoding
+ * more than the spans under it, so frames can be produced directly from
+ * the compact representation.
+ * @{
+ */
+
+/*!
+ * @brief Index of the stored spans among 64 consecutive spans
+ */
+typedef struct bs_compact_group {
+  uint64_t  bs_group_occupied;  //!< bit `i` is set if span `i` of the group is stored
+  size_t    bs_group_first;     //!< index of the group's first stored span
+} bs_compact_group_t;
+
+/*!
+ * @brief Compact representation of a binary bitmap
+ */
+typedef struct bs_compact_bitmap {
+  int                  bs_compact_width;
+  int                  bs_compact_height;
+  uint8_t             *bs_compact_spans;      //!< `bs_compact_height` bytes per stored span
+  size_t               bs_compact_spans_len;  //!< number of stored spans
+  bs_compact_group_t  *bs_compact_groups;
+} bs_compact_bitmap_t;
+
+/*!
+ * @brief Encode a bitmap compactly
+ *
+ * Every pixel of `bitmap` greater than zero is set. Returns `false` if
+ * allocating memory fails.
+ */
+bool bs_compact_bitmap_encode(bs_bitmap_t bitmap, bs_compact_bitmap_t *compact);
+
+void bs_compact_bitmap_free(bs_compact_bitmap_t *compact);
+
+/*!
+ * @brief Number of bytes a compact bitmap takes up in memory
+ */
+size_t bs_compact_bitmap_size(const bs_compact_bitmap_t *compact);
+
+/*!
+ * @brief Pack a view of a compact bitmap
+ *
+ * Packs the part of `compact` at `view` into `array` exactly like
+ * bs_view_bitarray_pack() packs the same view of the original bitmap,
+ * i. e. pixels outside of the bitmap are `def`. Only the spans under the
+ * view are read. Returns the number of bytes written or 0 if `array` is
+ * too small.
+ */
+size_t bs_compact_view_pack(const bs_compact_bitmap_t *compact, bs_rect_t view,
+  uint8_t *array, size_t size, unsigned char def);
+
+//! @}
+
+/*!
+ * @name Tiled Bitmaps
+ *
+ * Bitmaps for texts too long for bs_bitmap_t, whose `int` dimensions
+ * limit it to about 2 GiB of pixels. The columns are split into tiles of
+ * #BS_TILE_WIDTH columns which are only allocated once something other
+ * than the initial value is written to them, so blank stretches of a
+ * message and growing it to the right are cheap. Dimensions are `size_t`,
+ * every size computation is checked for overflow.
+ * @{
+ */
+
+//! Number of columns per tile
+#define BS_TILE_WIDTH 256
+
+typedef struct bs_tiled_bitmap {
+  unsigned char  **bs_tiled_tiles;      //!< `NULL` for tiles that were never written
+  size_t           bs_tiled_tiles_cap;
+  size_t           bs_tiled_width;
+  size_t           bs_tiled_height;
+  unsigned char    bs_tiled_init;       //!< value of pixels that were never written
+} bs_tiled_bitmap_t;
+
+/*!
+ * @brief Initialize an empty tiled bitmap
+ */
+void bs_tiled_bitmap_init(bs_tiled_bitmap_t *b, unsigned char init);
+
+void bs_tiled_bitmap_free(bs_tiled_bitmap_t *b);
+
+/*!
+ * @brief Grow a tiled bitmap to at least `width` times `height` pixels
+ *
+ * New pixels have the bitmap's initial value. Returns `false` and sets
+ * `errno` to `EOVERFLOW` if the size can't be represented or to `ENOMEM`
+ * if allocating fails.
+ */
+bool bs_tiled_bitmap_extend(bs_tiled_bitmap_t *b, size_t width, size_t height);
+
+/*!
+ * @brief Get a pixel of a tiled bitmap
+ *
+ * Returns `def` and sets `errno` to `EINVAL` if the pixel is out of bounds.
+ */
+unsigned char bs_tiled_bitmap_get(const bs_tiled_bitmap_t *b, size_t x, size_t y,
+  unsigned char def);
+
+/*!
+ * @brief Set a pixel of a tiled bitmap
+ *
+ * Pixels out of bounds are ignored. Returns `false` if the pixel's tile
+ * needs to be allocated and that fails.
+ */
+bool bs_tiled_bitmap_set(bs_tiled_bitmap_t *b, size_t x, size_t y, unsigned char p);
+
+/*!
+ * @brief Copy a bitmap into a tiled bitmap
+ *
+ * Works like bs_bitmap_copy(), rows of `src` which are entirely the
+ * initial value don't cause tiles to be allocated.
+ */
+bool bs_tiled_bitmap_copy(bs_tiled_bitmap_t *dst, int64_t offset_x, int64_t offset_y,
+  bs_bitmap_t src);
+
+/*!
+ * @brief Copy a part of a tiled bitmap into a bitmap
+ *
+ * Fills `window` with the pixels of `b` starting at `(offset_x, offset_y)`,
+ * pixels outside of `b` are `def`. The result can be used with all view
+ * functions, e. g. to scroll through a tiled bitmap a screen at a time.
+ */
+void bs_tiled_bitmap_crop(const bs_tiled_bitmap_t *b, int64_t offset_x,
+  int64_t offset_y, bs_bitmap_t window, unsigned char def);
+
+/*!
+ * @brief Pack a view of a tiled bitmap
+ *
+ * Packs the `width` times `height` pixels of `b` starting at
+ * `(offset_x, offset_y)` into `array` exactly like bs_view_bitarray_pack()
+ * packs the same view of an ordinary bitmap. Returns the number of bytes
+ * written or 0 if `array` is too small.
+ */
+size_t bs_tiled_view_pack(const bs_tiled_bitmap_t *b, int64_t offset_x,
+  int64_t offset_y, int width, int height, uint8_t *array, size_t size,
+  unsigned char def);
+
+/*!
+ * @brief Render a UTF-8 string into a tiled bitmap
+ *
+ * Initializes `b` and renders `s` into it like bs_render_utf8_string(),
+ * but without a limit on the width of the text. The clip of the context
+ * is ignored. Only a few tiles of the text are held in an ordinary bitmap
+ * at a time. Returns `false` if rendering fails, `b` needs to be freed
+ * either way.
+ */
+bool bs_render_utf8_tiled(bs_context_t *ctx, const char *s, size_t l,
+  bs_tiled_bitmap_t *b);
+
+//! @}
+
+/*!
+ * @name Frame Scheduling
+ *
+ * The scheduler calls tick functions, e. g. sending the next frame of an
+ * animation to a display, on absolute deadlines of the monotonic clock,
+ * so the frame rate doesn't drift. Several tasks with independent periods
+ * can be driven from a single thread. No signals are involved.
+ * @{
+ */
+
+//! Number of buckets of the timing histograms
+#define BS_SCHEDULE_HISTOGRAM_BUCKETS 24
+
+/*!
+ * @brief Timing statistics of a scheduled task
+ *
+ * All durations are in nanoseconds. Lateness is the time between a
+ * deadline and the tick function actually being called, jitter is the
+ * deviation of the interval between two ticks from the task's period.
+ * Bucket `i` of a histogram counts durations in the range
+ * `[2^(i-1), 2^i)` microseconds, bucket 0 those below 1µs and the last
+ * bucket everything greater, see bs_schedule_histogram_bucket().
+ */
+typedef struct bs_schedule_stats {
+  uint64_t bs_stats_frames;       //!< number of ticks
+  uint64_t bs_stats_missed;       //!< number of periods skipped due to lateness
+  uint64_t bs_stats_last_frame;   //!< time of the last tick
+  uint64_t bs_stats_lateness_sum;
+  uint64_t bs_stats_lateness_max;
+  uint64_t bs_stats_lateness_histogram[BS_SCHEDULE_HISTOGRAM_BUCKETS];
+  uint64_t bs_stats_jitter_sum;
+  uint64_t bs_stats_jitter_max;
+  uint64_t bs_stats_jitter_histogram[BS_SCHEDULE_HISTOGRAM_BUCKETS];
+} bs_schedule_stats_t;
+
+/*!
+ * @brief Return value of a tick function
+ */
+enum bs_tick_result {
+  BS_TICK_CONTINUE,   //!< call again after the next period
+  BS_TICK_FINISHED,   //!< task is done
+  BS_TICK_ERROR,      //!< task failed, abort bs_scheduler_run()
+};
+
+typedef enum bs_tick_result (*bs_schedule_tick_t)(void *user);
+
+typedef struct bs_schedule_task {
+  bs_schedule_tick_t   bs_task_tick;      //!< function called every period
+  void                *bs_task_user;      //!< argument of the tick function
+  uint64_t             bs_task_period;    //!< period in nanoseconds
+  uint64_t             bs_task_deadline;  //!< next absolute deadline
+  bool                 bs_task_finished;
+  bs_schedule_stats_t  bs_task_stats;
+} bs_schedule_task_t;
+
+typedef struct bs_scheduler {
+  bs_schedule_task_t           *bs_scheduler_tasks;
+  size_t                        bs_scheduler_tasks_len;
+  volatile sig_atomic_t        *bs_scheduler_stop;  //!< stops running once nonzero, may be `NULL`
+} bs_scheduler_t;
+
+/*!
+ * @brief Current time of the monotonic clock in nanoseconds
+ */
+uint64_t bs_clock_now(void);
+
+/*!
+ * @brief Histogram bucket for a duration in nanoseconds
+ */
+int bs_schedule_histogram_bucket(uint64_t ns);
+
+/*!
+ * @brief Print the nonempty buckets of a histogram on a single line
+ *
+ * Prints `name` followed by the upper bound of every bucket which isn't
+ * empty, in `unit`, and its count to `out`, e. g. for a histogram of
+ * #BS_SCHEDULE_HISTOGRAM_BUCKETS buckets of bs_schedule_stats_t.
+ */
+void bs_schedule_histogram_print(FILE *out, const char *name,
+  const uint64_t *histogram, const char *unit);
+
+void bs_scheduler_init(bs_scheduler_t *scheduler);
+
+void bs_scheduler_free(bs_scheduler_t *scheduler);
+
+/*!
+ * @brief Add a periodic task
+ *
+ * `tick` is called with `user` every `period` nanoseconds once
+ * bs_scheduler_run() is called, until it returns `BS_TICK_FINISHED`.
+ * Tasks are stored in `bs_scheduler_tasks` in the order they are added.
+ */
+bool bs_scheduler_add(bs_scheduler_t *scheduler, uint64_t period,
+  bs_schedule_tick_t tick, void *user);
+
+/*!
+ * @brief Run all tasks until they are finished
+ *
+ * All tasks are first called immediately, then on the following
+ * deadlines. Tasks with the same period are called in the order they
+ * were added at the same deadline. If a task falls behind by more than
+ * a period, the missed deadlines are skipped. A tick function may change
+ * its task's `bs_task_period`, which then determines its next deadline,
+ * e. g. for frames that are shown for different amounts of time.
+ *
+ * If `bs_scheduler_stop` is set, e. g. to a flag set by a handler for
+ * `SIGINT`, running stops as soon as it is nonzero, even while sleeping
+ * until the next deadline if the signal interrupts the sleep. Tasks
+ * which haven't finished then are left unfinished.
+ *
+ * Returns `false` if a task failed or sleeping failed.
+ */
+bool bs_scheduler_run(bs_scheduler_t *scheduler);
+
+//! @}
+
+/*!
+ * @name Ring Buffer
+ * @{
+ */
+
+/*!
+ * @brief Lock-free single producer, single consumer queue
+ *
+ * Fixed number of equally sized slots, used to hand data from one
+ * thread to another without locking, e. g. from a rendering thread to a
+ * thread sending frames. Slots are written and read in place: the
+ * producer fills the slot returned by bs_ring_write_begin() and publishes
+ * it using bs_ring_write_commit(), the consumer processes the slot
+ * returned by bs_ring_read_begin() and releases it using
+ * bs_ring_read_commit(). Neither side ever blocks.
+ *
+ * The indices are kept on separate cache lines, so producer and
+ * consumer don't slow each other down.
+ */
+typedef struct bs_ring {
+  uint8_t  *bs_ring_slots;      //!< slot memory
+  size_t    bs_ring_capacity;   //!< number of slots, a power of two
+  size_t    bs_ring_slot_size;  //!< size of a single slot in bytes
+  char      bs_ring_pad0[64];
+  size_t    bs_ring_head;       //!< number of slots written, only changed by the producer
+  char      bs_ring_pad1[64];
+  size_t    bs_ring_tail;       //!< number of slots read, only changed by the consumer
+  char      bs_ring_pad2[64];
+} bs_ring_t;
+
+/*!
+ * @brief Allocate a ring of `capacity` slots of `slot_size` bytes
+ *
+ * `capacity` must be a power of two. Returns `false` on error.
+ */
+bool bs_ring_init(bs_ring_t *ring, size_t capacity, size_t slot_size);
+
+void bs_ring_free(bs_ring_t *ring);
+
+/*!
+ * @brief Get the next slot to write or `NULL` if the ring is full
+ *
+ * May only be called by the producer.
+ */
+void *bs_ring_write_begin(bs_ring_t *ring);
+
+/*!
+ * @brief Publish the slot returned by bs_ring_write_begin()
+ */
+void bs_ring_write_commit(bs_ring_t *ring);
+
+/*!
+ * @brief Get the next slot to read or `NULL` if the ring is empty
+ *
+ * May only be called by the consumer.
+ */
+const void *bs_ring_read_begin(bs_ring_t *ring);
+
+/*!
+ * @brief Release the slot returned by bs_ring_read_begin()
+ */
+void bs_ring_read_commit(bs_ring_t *ring);
+
+//! @}
+
+/*!
+ * @name Shared Memory Frame Ring
+ *
+ * Publishes packed frames in a POSIX shared memory object, so local
+ * processes like previews, recorders or health checks can follow what a
+ * display shows without copying frames or rendering anything themselves.
+ * There is a single writer and any number of readers. The writer never
+ * waits: the ring has a fixed number of slots which are overwritten in
+ * order, so readers which fall behind skip frames instead of slowing
+ * down the writer. Readers access frames in place and have to check
+ * with bs_shm_ring_valid() whether a frame has been overwritten while
+ * they were using it.
+ *
+ * @{
+ */
+
+/*!
+ * @brief Either side of a shared memory frame ring
+ */
+typedef struct bs_shm_ring {
+  uint8_t  *bs_shm_map;       //!< mapped shared memory object
+  size_t    bs_shm_map_size;  //!< size of the mapping
+  char     *bs_shm_name;      //!< name of the object, only set for the writer
+  uint64_t  bs_shm_next;      //!< sequence number of the next frame to read
+  uint64_t  bs_shm_dropped;   //!< number of frames a reader missed
+} bs_shm_ring_t;
+
+/*!
+ * @brief Frame read from a shared memory frame ring
+ */
+typedef struct bs_shm_frame {
+  const uint8_t *bs_shm_frame_data;  //!< packed frame, inside the shared memory
+  size_t         bs_shm_frame_size;  //!< size of the frame in bytes
+  uint64_t       bs_shm_frame_seq;   //!< sequence number, counting from 0
+  uint64_t       bs_shm_frame_time;  //!< time it was published, see bs_clock_now()
+  uint32_t       bs_shm_frame_tag;   //!< tag given by the writer, e. g. the panel
+  uint64_t       bs_shm_frame_lock;  //!< used by bs_shm_ring_valid()
+} bs_shm_frame_t;
+
+/*!
+ * @brief Create a frame ring as its writer
+ *
+ * Creates the shared memory object `name` (see `shm_open(3)`), replacing
+ * an existing one, with `slots` slots, which must be a power of two, for
+ * frames of up to `frame_size` bytes. Returns `false` on error.
+ */
+bool bs_shm_ring_create(bs_shm_ring_t *ring, const char *name, size_t slots,
+  size_t frame_size);
+
+/*!
+ * @brief Open an existing frame ring as a reader
+ *
+ * Maps the shared memory object `name` read only. Reading starts with
+ * the frame published last. Returns `false` and sets `errno` if the
+ * object doesn't exist or isn't a frame ring (yet).
+ */
+bool bs_shm_ring_open(bs_shm_ring_t *ring, const char *name);
+
+/*!
+ * @brief Close a frame ring
+ *
+ * Unmaps the ring. If called by the writer, the shared memory object
+ * is removed as well, readers keep their mapping until they close it.
+ */
+void bs_shm_ring_close(bs_shm_ring_t *ring);
+
+/*!
+ * @brief Publish a frame
+ *
+ * Copies `size` bytes of `frame` into the next slot, tagged with `tag`
+ * and `time`. May only be called by the writer. Returns `false` if the
+ * frame is bigger than the size the ring was created for.
+ */
+bool bs_shm_ring_publish(bs_shm_ring_t *ring, const uint8_t *frame,
+  size_t size, uint32_t tag, uint64_t time);
+
+/*!
+ * @brief Get the next frame
+ *
+ * Returns `false` if no new frame has been published yet. If frames have
+ * been overwritten before they could be read, they are skipped and
+ * counted in `bs_shm_dropped`. `frame` points into the shared memory, so
+ * once done with it, bs_shm_ring_valid() must be checked.
+ */
+bool bs_shm_ring_next(bs_shm_ring_t *ring, bs_shm_frame_t *frame);
+
+/*!
+ * @brief Check that a frame hasn't been overwritten
+ *
+ * Returns `true` if the slot of `frame` hasn't been touched by the writer
+ * since bs_shm_ring_next() returned it, i. e. everything read from its
+ * data up to this point is consistent. Otherwise it has to be discarded.
+ */
+bool bs_shm_ring_valid(const bs_shm_ring_t *ring, const bs_shm_frame_t *frame);
+
+//! @}
+
+/*!
+ * @name Frame Streams
+ *
+ * Files of packed frames as they were sent to a display, so expensive
+ * animations can be rendered once and played back later without a font,
+ * HarfBuzz or libschrift. A stream describes the geometry and wire format
+ * of every panel of the display, followed by records which hold the frame
+ * of every panel and how long it is shown. Consecutive identical frames
+ * are merged into a single record.
+ *
+ * Streams are content addressable: their hash only depends on panels
+ * and frames, so they can be stored under their hash and reused, e. g.
+ * by a daemon across restarts.
+ * @{
+ */
+
+/*!
+ * @brief Panel of a recorded display
+ */
+typedef struct bs_stream_panel {
+  int                bs_panel_x;           //!< position within the display
+  int                bs_panel_y;
+  int                bs_panel_width;
+  int                bs_panel_height;
+  bs_frame_format_t  bs_panel_format;      //!< wire format of the panel's frames
+  size_t             bs_panel_frame_size;  //!< set by bs_stream_open()
+} bs_stream_panel_t;
+
+/*!
+ * @brief Stream that is being recorded
+ */
+typedef struct bs_stream_writer {
+  int       bs_writer_fd;
+  size_t    bs_writer_panels_len;
+  size_t   *bs_writer_frame_sizes;
+  size_t    bs_writer_record_size;
+  uint8_t  *bs_writer_pending;           //!< last record, written once it changes
+  uint64_t  bs_writer_pending_duration;
+  uint64_t  bs_writer_records;           //!< number of records written
+  uint64_t  bs_writer_duration;          //!< total duration of records written
+  uint64_t  bs_writer_hash;
+} bs_stream_writer_t;
+
+/*!
+ * @brief Start recording a stream
+ *
+ * Writes the description of `panels` to `fd`, which has to be a newly
+ * created regular file. Returns `false` and sets `errno` on error.
+ */
+bool bs_stream_writer_open(bs_stream_writer_t *writer, int fd,
+  const bs_stream_panel_t *panels, size_t panels_len);
+
+/*!
+ * @brief Record a frame for every panel
+ *
+ * `frames` holds a frame for every panel in order, which is shown for
+ * `duration` nanoseconds. Returns `false` and sets `errno` on error.
+ */
+bool bs_stream_writer_append(bs_stream_writer_t *writer,
+  const uint8_t *const *frames, uint64_t duration);
+
+/*!
+ * @brief Finish recording a stream
+ *
+ * Writes the last record and completes the header, storing the stream's
+ * hash in `hash` unless it is `NULL`. The writer is released in any case,
+ * but the file descriptor isn't closed. Returns `false` on error.
+ */
+bool bs_stream_writer_finish(bs_stream_writer_t *writer, uint64_t *hash);
+
+/*!
+ * @brief Stream mapped for playback
+ */
+typedef struct bs_stream {
+  const uint8_t      *bs_stream_map;
+  size_t              bs_stream_map_size;
+  bs_stream_panel_t  *bs_stream_panels;       //!< format headers point into the map
+  size_t              bs_stream_panels_len;
+  size_t             *bs_stream_offsets;      //!< of every panel's frame in a record
+  const uint8_t      *bs_stream_data;         //!< first record
+  size_t              bs_stream_record_size;
+  uint64_t            bs_stream_records;      //!< number of frames of every panel
+  uint64_t            bs_stream_duration;     //!< total duration in nanoseconds
+  uint64_t            bs_stream_hash;
+} bs_stream_t;
+
+/*!
+ * @brief Map a stream file
+ *
+ * Checks the structure of the file, but not its hash (see
+ * bs_stream_verify()). Returns `false` and sets `errno` on error,
+ * `EINVAL` if the file is no valid stream.
+ */
+bool bs_stream_open(bs_stream_t *stream, const char *path);
+
+void bs_stream_close(bs_stream_t *stream);
+
+/*!
+ * @brief Check a stream's hash
+ *
+ * Reads the whole stream, so afterwards all of it is likely to be in
+ * memory. Returns `false` if the stream has been corrupted.
+ */
+bool bs_stream_verify(const bs_stream_t *stream);
+
+/*!
+ * @brief Number of nanoseconds frame `index` is shown
+ */
+uint64_t bs_stream_frame_duration(const bs_stream_t *stream, uint64_t index);
+
+/*!
+ * @brief Frame `index` of `panel`, inside the mapped file
+ */
+const uint8_t *bs_stream_frame(const bs_stream_t *stream, uint64_t index,
+  size_t panel);
+
+//! @}
+
+/*!
+ * @name Tracing
+ *
+ * buchstabensuppe can record timestamped spans for the different stages
+ * of its rendering pipeline (decoding, segmentation, font fallback,
+ * shaping, rasterization, blitting, packing and sending) and export them
+ * in the [Chrome trace event format](https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU)
+ * which can be inspected using [Perfetto](https://ui.perfetto.dev).
+ *
+ * Tracing is process wide and disabled by default. While disabled,
+ * instrumented code only checks a single pointer.
+ * @{
+ */
+
+/*!
+ * @brief Enable tracing
+ *
+ * Allocates a buffer for `capacity` spans and starts recording. Spans
+ * which don't fit into the buffer anymore are dropped and only counted.
+ * Returns `false` and sets `errno` if tracing is already enabled or
+ * the buffer could not be allocated.
+ */
+bool bs_trace_start(size_t capacity);
+
+/*!
+ * @brief Disable tracing
+ *
+ * Stops recording and frees the trace buffer, discarding all recorded
+ * spans. Must not be called while other threads may still be recording.
+ */
+void bs_trace_stop(void);
+
+/*!
+ * @brief Write recorded spans to a file
+ *
+ * Writes all spans recorded so far as Chrome trace event JSON to the
+ * file at `path`, replacing it if it exists. Spans other threads are
+ * still in the middle of recording are left out.
+ */
+bool bs_trace_write(const char *path);
+
+/*!
+ * @brief Begin a span
+ *
+ * Returns the current timestamp to be passed to bs_trace_end() or
+ * 0 if tracing is disabled.
+ */
+uint64_t bs_trace_begin(void);
+
+/*!
+ * @brief End a span
+ *
+ * Records a span called `name` which started at `start`, as returned by
+ * bs_trace_begin(). `name` and `arg_name` must be string literals or
+ * otherwise outlive the trace buffer. If `arg_name` is not `NULL`, `arg`
+ * is attached to the span under that name. Does nothing if `start` is 0.
+ */
+void bs_trace_end(const char *name, uint64_t start, const char *arg_name, long arg);
+
 //! @}
 
 #endif
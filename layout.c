@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// The layout's frame is kept between calls to bs_layout_pack(), so only
+// regions which changed since the last call are packed again: the
+// region's view is packed on its own into a scratch buffer, whose rows
+// are then shifted into place within the frame's rows. Neither step
+// touches anything outside of the region.
+
+void bs_layout_init(bs_layout_t *layout, int width, int height, unsigned char def) {
+  memset(layout, 0, sizeof(bs_layout_t));
+
+  layout->bs_layout_width = width;
+  layout->bs_layout_height = height;
+  layout->bs_layout_def = def;
+}
+
+void bs_layout_free(bs_layout_t *layout) {
+  for(size_t i = 0; i < layout->bs_layout_regions_len; i++) {
+    bs_retained_text_free(&layout->bs_layout_regions[i].bs_region_text);
+  }
+
+  free(layout->bs_layout_regions);
+  free(layout->bs_layout_scratch);
+
+  bs_layout_init(layout, 0, 0, 0);
+}
+
+static void region_reset_view(bs_region_t *r) {
+  r->bs_region_view.bs_view_bitmap = r->bs_region_text.bs_retained_bitmap;
+  r->bs_region_view.bs_view_offset_x =
+    r->bs_region_mode == BS_REGION_SCROLL ? -r->bs_region_rect.bs_rect_width : 0;
+  r->bs_region_view.bs_view_offset_y = 0;
+  r->bs_region_view.bs_view_width = r->bs_region_rect.bs_rect_width;
+  r->bs_region_view.bs_view_height = r->bs_region_rect.bs_rect_height;
+}
+
+int bs_layout_add_region(bs_layout_t *layout, bs_context_t *ctx, bs_rect_t rect,
+  enum bs_region_mode mode, int step, uint64_t period) {
+  if(rect.bs_rect_x < 0 || rect.bs_rect_y < 0 ||
+      rect.bs_rect_width <= 0 || rect.bs_rect_height <= 0 ||
+      rect.bs_rect_x + rect.bs_rect_width > layout->bs_layout_width ||
+      rect.bs_rect_y + rect.bs_rect_height > layout->bs_layout_height ||
+      (mode != BS_REGION_STATIC && (step <= 0 || period == 0))) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // the scratch buffer has to fit the biggest region's packed view
+  bs_view_t view = { { NULL, 0, 0 }, 0, 0, rect.bs_rect_width, rect.bs_rect_height };
+  size_t scratch_size = bs_view_bitarray_size(view);
+
+  if(scratch_size > layout->bs_layout_scratch_size) {
+    uint8_t *tmp = realloc(layout->bs_layout_scratch, scratch_size);
+
+    if(tmp == NULL) {
+      errno = ENOMEM;
+      return -1;
+    }
+
+    layout->bs_layout_scratch = tmp;
+    layout->bs_layout_scratch_size = scratch_size;
+  }
+
+  bs_region_t *regions = realloc(layout->bs_layout_regions,
+    (layout->bs_layout_regions_len + 1) * sizeof(bs_region_t));
+
+  if(regions == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  layout->bs_layout_regions = regions;
+
+  bs_region_t *r = regions + layout->bs_layout_regions_len;
+  memset(r, 0, sizeof(bs_region_t));
+
+  r->bs_region_ctx = ctx;
+  r->bs_region_rect = rect;
+  r->bs_region_mode = mode;
+  r->bs_region_step = step;
+  r->bs_region_period = period;
+  r->bs_region_dirty = true;
+  bs_retained_text_init(&r->bs_region_text);
+  region_reset_view(r);
+
+  return layout->bs_layout_regions_len++;
+}
+
+bool bs_layout_set_text(bs_layout_t *layout, int region, const char *s, size_t l) {
+  if(region < 0 || (size_t) region >= layout->bs_layout_regions_len) {
+    errno = EINVAL;
+    return false;
+  }
+
+  bs_region_t *r = layout->bs_layout_regions + region;
+  bs_rect_t changed;
+
+  if(!bs_retained_text_update(r->bs_region_ctx, &r->bs_region_text, s, l, &changed)) {
+    return false;
+  }
+
+  if(changed.bs_rect_width > 0) {
+    // animations start over with the new text
+    region_reset_view(r);
+    r->bs_region_next_tick = 0;
+    r->bs_region_dirty = true;
+  }
+
+  return true;
+}
+
+bool bs_layout_tick(bs_layout_t *layout, uint64_t now) {
+  bool changed = false;
+
+  for(size_t i = 0; i < layout->bs_layout_regions_len; i++) {
+    bs_region_t *r = layout->bs_layout_regions + i;
+
+    if(r->bs_region_mode == BS_REGION_STATIC) {
+      changed = changed || r->bs_region_dirty;
+      continue;
+    }
+
+    // the first position is shown for a whole period as well
+    if(r->bs_region_next_tick == 0) {
+      r->bs_region_next_tick = now + r->bs_region_period;
+    } else if(now >= r->bs_region_next_tick) {
+      if(r->bs_region_mode == BS_REGION_SCROLL) {
+        bs_scroll_next_view(&r->bs_region_view, r->bs_region_step, BS_DIMENSION_X);
+      } else {
+        bs_page_next_view(&r->bs_region_view, 1, BS_DIMENSION_X);
+      }
+
+      r->bs_region_next_tick += r->bs_region_period;
+
+      // don't try to catch up after falling behind
+      if(r->bs_region_next_tick <= now) {
+        r->bs_region_next_tick = now + r->bs_region_period;
+      }
+
+      r->bs_region_dirty = true;
+    }
+
+    changed = changed || r->bs_region_dirty;
+  }
+
+  return changed;
+}
+
+// copies width bits of every row of src, packed like bs_view_bitarray_pack(),
+// into frame starting at bit x of row y
+static void blit_rows(uint8_t *frame, size_t frame_row_size, int x, int y,
+  const uint8_t *src, int width, int height) {
+  size_t src_row_size = (width + 7) / 8;
+  int shift = x % 8;
+  uint8_t last_mask = width % 8 == 0 ? 0xff : 0xff << (8 - width % 8);
+
+  for(int row = 0; row < height; row++) {
+    uint8_t *dst = frame + (y + row) * frame_row_size + x / 8;
+    const uint8_t *s = src + row * src_row_size;
+
+    for(size_t i = 0; i < src_row_size; i++) {
+      uint8_t mask = i == src_row_size - 1 ? last_mask : 0xff;
+      uint8_t bits = s[i] & mask;
+
+      dst[i] = (dst[i] & ~(mask >> shift)) | (bits >> shift);
+
+      if(shift > 0) {
+        uint8_t spill = mask << (8 - shift);
+
+        if(spill != 0) {
+          dst[i + 1] = (dst[i + 1] & ~spill) | (uint8_t) (bits << (8 - shift));
+        }
+      }
+    }
+  }
+}
+
+size_t bs_layout_pack(bs_layout_t *layout, uint8_t *frame, size_t size) {
+  bs_view_t whole = {
+    { NULL, 0, 0 }, 0, 0, layout->bs_layout_width, layout->bs_layout_height,
+  };
+  size_t needed = bs_view_bitarray_size(whole);
+
+  if(needed == 0 || size < needed) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  size_t row_size = (layout->bs_layout_width + 7) / 8;
+
+  // everything not covered by a region stays the default
+  if(!layout->bs_layout_packed) {
+    bs_view_bitarray_pack(whole, frame, size, layout->bs_layout_def);
+    layout->bs_layout_packed = true;
+  }
+
+  for(size_t i = 0; i < layout->bs_layout_regions_len; i++) {
+    bs_region_t *r = layout->bs_layout_regions + i;
+
+    if(!r->bs_region_dirty) {
+      continue;
+    }
+
+    bs_view_bitarray_pack(r->bs_region_view, layout->bs_layout_scratch,
+      layout->bs_layout_scratch_size, layout->bs_layout_def);
+
+    blit_rows(frame, row_size, r->bs_region_rect.bs_rect_x,
+      r->bs_region_rect.bs_rect_y, layout->bs_layout_scratch,
+      r->bs_region_rect.bs_rect_width, r->bs_region_rect.bs_rect_height);
+
+    r->bs_region_dirty = false;
+  }
+
+  return needed;
+}
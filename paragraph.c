@@ -0,0 +1,357 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// line break classes, a small subset of UAX #14 which is enough for
+// latin text and ideographs
+
+static bool is_hard_break(uint32_t c) {
+  return c == '\n' || c == '\r' || c == 0x0b || c == 0x0c ||
+    c == 0x85 || c == 0x2028 || c == 0x2029;
+}
+
+// spaces are never the start of a line and hang off its end
+static bool is_space(uint32_t c) {
+  return c == ' ' || c == '\t' || c == 0x1680 ||
+    (c >= 0x2000 && c <= 0x200a && c != 0x2007) || c == 0x205f || c == 0x3000;
+}
+
+// no break on either side, e. g. no-break spaces and the word joiner
+static bool is_glue(uint32_t c) {
+  return c == 0xa0 || c == 0x2007 || c == 0x202f || c == 0x2060 || c == 0xfeff;
+}
+
+static bool is_closing(uint32_t c) {
+  switch(c) {
+    case ')': case ']': case '}': case ',': case '.': case ':': case ';':
+    case '!': case '?': case 0xbb: case 0x2019: case 0x201d:
+    case 0x3001: case 0x3002: case 0x3009: case 0x300b: case 0x300d:
+    case 0x300f: case 0x3011: case 0x3015: case 0xff01: case 0xff09:
+    case 0xff0c: case 0xff0e: case 0xff1a: case 0xff1b: case 0xff1f:
+    case 0xff3d: case 0xff5d:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool is_opening(uint32_t c) {
+  switch(c) {
+    case '(': case '[': case '{': case 0xab: case 0x2018: case 0x201c:
+    case 0x3008: case 0x300a: case 0x300c: case 0x300e: case 0x3010:
+    case 0x3014: case 0xff08: case 0xff3b: case 0xff5b:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// lines may be broken after these, e. g. in "well-known"
+static bool is_break_after(uint32_t c) {
+  return c == '-' || c == 0xad || c == 0x2010 || c == 0x2013 || c == 0x200b;
+}
+
+// ideographs, kana, hangul and emoji may be broken between any two
+static bool is_ideographic(uint32_t c) {
+  return (c >= 0x2e80 && c <= 0x2fff) || (c >= 0x3040 && c <= 0x30ff) ||
+    (c >= 0x3400 && c <= 0x4dbf) || (c >= 0x4e00 && c <= 0x9fff) ||
+    (c >= 0xa000 && c <= 0xa4cf) || (c >= 0xac00 && c <= 0xd7a3) ||
+    (c >= 0xf900 && c <= 0xfaff) || (c >= 0xff01 && c <= 0xff60) ||
+    (c >= 0x1f000 && c <= 0x1faff) || (c >= 0x20000 && c <= 0x3fffd);
+}
+
+enum bs_line_break bs_utf32_line_break(bs_utf32_buffer_t str, size_t offset) {
+  if(offset == 0 || offset > str.bs_utf32_buffer_len) {
+    return BS_BREAK_NONE;
+  } else if(offset == str.bs_utf32_buffer_len) {
+    return BS_BREAK_MANDATORY;
+  }
+
+  uint32_t a = str.bs_utf32_buffer[offset - 1];
+  uint32_t b = str.bs_utf32_buffer[offset];
+
+  // rules are checked in the order of precedence given by UAX #14
+  if(a == '\r' && b == '\n') {
+    return BS_BREAK_NONE;
+  } else if(is_hard_break(a)) {
+    return BS_BREAK_MANDATORY;
+  } else if(is_hard_break(b) || is_space(b)) {
+    return BS_BREAK_NONE;
+  } else if(a == 0x200b) {
+    return BS_BREAK_ALLOWED;
+  } else if(is_glue(a) || is_glue(b) || is_closing(b) || is_opening(a)) {
+    return BS_BREAK_NONE;
+  } else if(is_space(a)) {
+    return BS_BREAK_ALLOWED;
+  } else if(is_break_after(a)) {
+    // keeps negative numbers together
+    return b >= '0' && b <= '9' && a == '-' ? BS_BREAK_NONE : BS_BREAK_ALLOWED;
+  } else if(is_ideographic(a) || is_ideographic(b)) {
+    return BS_BREAK_ALLOWED;
+  }
+
+  return BS_BREAK_NONE;
+}
+
+void bs_paragraph_init(bs_paragraph_t *p) {
+  memset(p, 0, sizeof(bs_paragraph_t));
+}
+
+void bs_paragraph_free(bs_paragraph_t *p) {
+  bs_utf32_buffer_free(&p->bs_paragraph_string);
+  bs_bitmap_free(&p->bs_paragraph_bitmap);
+  free(p->bs_paragraph_graphemes);
+  free(p->bs_paragraph_advances);
+  free(p->bs_paragraph_breaks);
+  free(p->bs_paragraph_lines);
+
+  bs_paragraph_init(p);
+}
+
+// whether grapheme i takes up no space at the end of a line
+static bool grapheme_hangs(const bs_paragraph_t *p, size_t i) {
+  uint32_t c = p->bs_paragraph_string.bs_utf32_buffer[
+    p->bs_paragraph_graphemes[i].bs_layout_offset];
+
+  return is_space(c) || is_hard_break(c);
+}
+
+bool bs_paragraph_set_text(bs_context_t *ctx, bs_paragraph_t *p, const char *s, size_t l) {
+  bs_paragraph_free(p);
+
+  errno = 0;
+  p->bs_paragraph_string = bs_decode_utf8(s, l);
+
+  if(errno != 0) {
+    bs_paragraph_free(p);
+    return false;
+  }
+
+  // there are never more graphemes than codepoints
+  size_t cap = p->bs_paragraph_string.bs_utf32_buffer_len + 1;
+  p->bs_paragraph_graphemes = malloc(cap * sizeof(bs_grapheme_layout_t));
+  p->bs_paragraph_advances = malloc(cap * sizeof(int));
+  p->bs_paragraph_breaks = malloc(cap);
+
+  if(p->bs_paragraph_graphemes == NULL || p->bs_paragraph_advances == NULL ||
+      p->bs_paragraph_breaks == NULL) {
+    bs_paragraph_free(p);
+    errno = ENOMEM;
+    return false;
+  }
+
+  bs_utf32_buffer_t str = p->bs_paragraph_string;
+  size_t n = 0;
+
+  for(size_t offset = 0; offset < str.bs_utf32_buffer_len; n++) {
+    bs_grapheme_layout_t *g = p->bs_paragraph_graphemes + n;
+    g->bs_layout_offset = offset;
+    g->bs_layout_len = bs_utf32_grapheme_length(str, offset);
+    g->bs_layout_x = 0;
+
+    p->bs_paragraph_breaks[n] = bs_utf32_line_break(str, offset);
+    p->bs_paragraph_graphemes_len = n + 1;
+
+    // newlines are never drawn, fonts tend to have no glyph for them
+    if(is_hard_break(str.bs_utf32_buffer[offset])) {
+      p->bs_paragraph_advances[n] = 0;
+    } else if(!bs_grapheme_advance(ctx, str, offset, g->bs_layout_len,
+        p->bs_paragraph_advances + n)) {
+      bs_paragraph_free(p);
+      errno = EIO;
+      return false;
+    }
+
+    offset += g->bs_layout_len;
+  }
+
+  for(size_t i = 0; i < ctx->bs_fonts_len; i++) {
+    int height = ctx->bs_fonts[i].bs_font_pixel_height;
+
+    if(height > p->bs_paragraph_line_height) {
+      p->bs_paragraph_line_height = height;
+    }
+  }
+
+  return true;
+}
+
+// width of the graphemes from start to end as placed by bs_paragraph_wrap()
+static int line_width(const bs_paragraph_t *p, size_t start, size_t end) {
+  return end > start ? p->bs_paragraph_graphemes[end - 1].bs_layout_x +
+    p->bs_paragraph_advances[end - 1] : 0;
+}
+
+// appends the line from start to end, lines grow geometrically
+static bool push_line(bs_paragraph_t *p, size_t *cap, size_t start, size_t end) {
+  if(p->bs_paragraph_lines_len >= *cap) {
+    size_t new_cap = *cap > 0 ? *cap * 2 : 8;
+    bs_line_t *lines = realloc(p->bs_paragraph_lines, new_cap * sizeof(bs_line_t));
+
+    if(lines == NULL) {
+      errno = ENOMEM;
+      return false;
+    }
+
+    p->bs_paragraph_lines = lines;
+    *cap = new_cap;
+  }
+
+  bs_line_t *line = p->bs_paragraph_lines + p->bs_paragraph_lines_len++;
+  line->bs_line_start = start;
+  line->bs_line_end = end;
+  line->bs_line_width = line_width(p, start, end);
+  line->bs_line_rendered = false;
+
+  return true;
+}
+
+bool bs_paragraph_wrap(bs_paragraph_t *p, int width) {
+  bs_grapheme_layout_t *g = p->bs_paragraph_graphemes;
+  size_t n = p->bs_paragraph_graphemes_len;
+  size_t cap = 0;
+
+  free(p->bs_paragraph_lines);
+  p->bs_paragraph_lines = NULL;
+  p->bs_paragraph_lines_len = 0;
+  bs_bitmap_free(&p->bs_paragraph_bitmap);
+  p->bs_paragraph_bitmap.bs_bitmap = NULL;
+  p->bs_paragraph_width = width;
+
+  size_t start = 0;      // first grapheme of the current line
+  size_t end = 0;        // after its last grapheme which isn't a space
+  size_t candidate = 0;  // last break opportunity in it or start if none
+  size_t candidate_end = 0;
+  int x = 0;
+
+  for(size_t i = 0; i < n; i++) {
+    if(i > start && p->bs_paragraph_breaks[i] == BS_BREAK_MANDATORY) {
+      if(!push_line(p, &cap, start, end)) {
+        return false;
+      }
+
+      start = end = candidate = candidate_end = i;
+      x = 0;
+    } else if(i > start && p->bs_paragraph_breaks[i] == BS_BREAK_ALLOWED) {
+      candidate = i;
+      candidate_end = end;
+    }
+
+    g[i].bs_layout_x = x;
+    x += p->bs_paragraph_advances[i];
+
+    if(grapheme_hangs(p, i)) {
+      continue;
+    }
+
+    // move the graphemes after the last opportunity to a new line,
+    // if there was none, break right before the one that doesn't fit
+    while(x > width && end > start) {
+      size_t next = candidate > start ? candidate : i;
+      size_t line_end = candidate > start ? candidate_end : end;
+
+      if(!push_line(p, &cap, start, line_end)) {
+        return false;
+      }
+
+      int shift = g[next].bs_layout_x;
+
+      for(size_t j = next; j <= i; j++) {
+        g[j].bs_layout_x -= shift;
+      }
+
+      x -= shift;
+      start = candidate = next;
+
+      // only spaces may have been in between, which don't count
+      end = next;
+      for(size_t j = next; j < i; j++) {
+        if(!grapheme_hangs(p, j)) {
+          end = j + 1;
+        }
+      }
+    }
+
+    end = i + 1;
+  }
+
+  if(start < n && !push_line(p, &cap, start, end)) {
+    return false;
+  }
+
+  int height = p->bs_paragraph_line_height * (int) p->bs_paragraph_lines_len;
+
+  if(width > 0 && height > 0) {
+    p->bs_paragraph_bitmap = bs_bitmap_new(width, height, 0);
+
+    if(p->bs_paragraph_bitmap.bs_bitmap == NULL) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool bs_paragraph_render_view(bs_context_t *ctx, bs_paragraph_t *p, bs_view_t view) {
+  bs_bitmap_t b = p->bs_paragraph_bitmap;
+  int line_height = p->bs_paragraph_line_height;
+
+  if(b.bs_bitmap == NULL || line_height <= 0 ||
+      view.bs_view_offset_y + view.bs_view_height <= 0) {
+    return true;
+  }
+
+  int first = view.bs_view_offset_y < 0 ? 0 : view.bs_view_offset_y / line_height;
+  int last = (view.bs_view_offset_y + view.bs_view_height - 1) / line_height;
+
+  if(last >= (int) p->bs_paragraph_lines_len) {
+    last = (int) p->bs_paragraph_lines_len - 1;
+  }
+
+  // every line is rendered into its own band of rows, whose clip keeps
+  // glyphs from reaching into the lines next to it
+  int clip_width = ctx->bs_clip_width;
+  int clip_height = ctx->bs_clip_height;
+  ctx->bs_clip_width = b.bs_bitmap_width;
+  ctx->bs_clip_height = line_height;
+
+  bool success = true;
+
+  for(int i = first; success && i <= last; i++) {
+    bs_line_t *line = p->bs_paragraph_lines + i;
+
+    if(line->bs_line_rendered) {
+      continue;
+    }
+
+    bs_bitmap_t band = {
+      b.bs_bitmap + (size_t) i * line_height * b.bs_bitmap_width,
+      line_height, b.bs_bitmap_width
+    };
+
+    for(size_t j = line->bs_line_start; success && j < line->bs_line_end; j++) {
+      const bs_grapheme_layout_t *g = p->bs_paragraph_graphemes + j;
+      bs_cursor_t cursor = { g->bs_layout_x, 0 };
+
+      if(g->bs_layout_x >= band.bs_bitmap_width || grapheme_hangs(p, j)) {
+        continue;
+      }
+
+      success = bs_render_grapheme_append(ctx, &band, &cursor,
+        p->bs_paragraph_string, g->bs_layout_offset, g->bs_layout_len);
+    }
+
+    line->bs_line_rendered = success;
+  }
+
+  ctx->bs_clip_width = clip_width;
+  ctx->bs_clip_height = clip_height;
+
+  if(!success) {
+    errno = EIO;
+  }
+
+  return success;
+}
@@ -0,0 +1,226 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// Updates only re-render the graphemes between the longest common prefix
+// and suffix of the old and new text, extended by one grapheme on each
+// side: HarfBuzz sees the neighbouring codepoints as context, so they may
+// be shaped differently once their neighbour changes. Everything left of
+// the re-rendered range keeps its pixels, everything right of it is moved
+// by the difference in advance instead of being rendered again.
+
+void bs_retained_text_init(bs_retained_text_t *text) {
+  memset(text, 0, sizeof(bs_retained_text_t));
+}
+
+void bs_retained_text_free(bs_retained_text_t *text) {
+  bs_utf32_buffer_free(&text->bs_retained_string);
+  bs_bitmap_free(&text->bs_retained_bitmap);
+  free(text->bs_retained_graphemes);
+
+  bs_retained_text_init(text);
+}
+
+static bool grapheme_equal(bs_utf32_buffer_t a, const bs_grapheme_layout_t *ga,
+  bs_utf32_buffer_t b, const bs_grapheme_layout_t *gb) {
+  return ga->bs_layout_len == gb->bs_layout_len &&
+    memcmp(a.bs_utf32_buffer + ga->bs_layout_offset,
+      b.bs_utf32_buffer + gb->bs_layout_offset,
+      ga->bs_layout_len * sizeof(uint32_t)) == 0;
+}
+
+// copies width columns starting at src_x of src to dst_x of dst,
+// both bitmaps must be at least as high as src
+static void copy_columns(bs_bitmap_t dst, int dst_x, bs_bitmap_t src, int src_x, int width) {
+  if(src_x + width > src.bs_bitmap_width) {
+    width = src.bs_bitmap_width - src_x;
+  }
+
+  if(dst_x + width > dst.bs_bitmap_width) {
+    width = dst.bs_bitmap_width - dst_x;
+  }
+
+  if(width <= 0) {
+    return;
+  }
+
+  for(int y = 0; y < src.bs_bitmap_height; y++) {
+    memmove(dst.bs_bitmap + (size_t) y * dst.bs_bitmap_width + dst_x,
+      src.bs_bitmap + (size_t) y * src.bs_bitmap_width + src_x, width);
+  }
+}
+
+static void clear_columns(bs_bitmap_t b, int x, int width) {
+  if(x + width > b.bs_bitmap_width) {
+    width = b.bs_bitmap_width - x;
+  }
+
+  for(int y = 0; width > 0 && y < b.bs_bitmap_height; y++) {
+    memset(b.bs_bitmap + (size_t) y * b.bs_bitmap_width + x, 0, width);
+  }
+}
+
+bool bs_retained_text_update(bs_context_t *ctx, bs_retained_text_t *text,
+  const char *s, size_t l, bs_rect_t *dirty) {
+  memset(dirty, 0, sizeof(bs_rect_t));
+
+  errno = 0;
+  bs_utf32_buffer_t str = bs_decode_utf8(s, l);
+
+  if(errno != 0) {
+    bs_utf32_buffer_free(&str);
+    return false;
+  }
+
+  // there are never more graphemes than codepoints
+  bs_grapheme_layout_t *graphemes = malloc(
+    (str.bs_utf32_buffer_len + 1) * sizeof(bs_grapheme_layout_t));
+
+  if(graphemes == NULL) {
+    bs_utf32_buffer_free(&str);
+    errno = ENOMEM;
+    return false;
+  }
+
+  size_t n = 0;
+  for(size_t offset = 0; offset < str.bs_utf32_buffer_len; n++) {
+    graphemes[n].bs_layout_offset = offset;
+    graphemes[n].bs_layout_len = bs_utf32_grapheme_length(str, offset);
+    offset += graphemes[n].bs_layout_len;
+  }
+
+  bs_utf32_buffer_t old_str = text->bs_retained_string;
+  const bs_grapheme_layout_t *old = text->bs_retained_graphemes;
+  size_t old_n = text->bs_retained_graphemes_len;
+  size_t min_n = n < old_n ? n : old_n;
+
+  size_t prefix = 0;
+  while(prefix < min_n &&
+      grapheme_equal(str, graphemes + prefix, old_str, old + prefix)) {
+    prefix++;
+  }
+
+  if(prefix == n && prefix == old_n) {
+    bs_utf32_buffer_free(&str);
+    free(graphemes);
+    return true;
+  }
+
+  size_t suffix = 0;
+  while(suffix < min_n - prefix &&
+      grapheme_equal(str, graphemes + n - suffix - 1,
+        old_str, old + old_n - suffix - 1)) {
+    suffix++;
+  }
+
+  // the neighbours of the change are shaped again as well
+  size_t start = prefix > 0 ? prefix - 1 : 0;
+  size_t end = suffix > 0 ? n - suffix + 1 : n;
+  size_t old_end = old_n - (n - end);
+
+  bs_bitmap_t ob = text->bs_retained_bitmap;
+  int x0 = start < old_n ? old[start].bs_layout_x : text->bs_retained_cursor_x;
+  int old_x1 = old_end < old_n ? old[old_end].bs_layout_x : text->bs_retained_cursor_x;
+
+  for(size_t i = 0; i < start; i++) {
+    graphemes[i].bs_layout_x = old[i].bs_layout_x;
+  }
+
+  // the changed graphemes are rendered on their own, starting at x0
+  bs_bitmap_t mid = { NULL, 0, 0 };
+  bs_cursor_t cursor = { 0, 0 };
+
+  for(size_t i = start; i < end; i++) {
+    graphemes[i].bs_layout_x = x0 + cursor.bs_cursor_x;
+
+    if(!bs_render_grapheme_append(ctx, &mid, &cursor, str,
+        graphemes[i].bs_layout_offset, graphemes[i].bs_layout_len)) {
+      bs_utf32_buffer_free(&str);
+      bs_bitmap_free(&mid);
+      free(graphemes);
+      errno = EIO;
+      return false;
+    }
+  }
+
+  int x1 = x0 + cursor.bs_cursor_x;
+  int delta = x1 - old_x1;
+
+  for(size_t i = end; i < n; i++) {
+    graphemes[i].bs_layout_x = old[old_end + i - end].bs_layout_x + delta;
+  }
+
+  // unless it is at the very end, the new part is cut off at the start
+  // of the unchanged suffix, which keeps its own pixels
+  bool has_suffix = end < n;
+  int mid_width = has_suffix ? x1 - x0 : mid.bs_bitmap_width;
+  int kept = x0 < ob.bs_bitmap_width ? x0 : ob.bs_bitmap_width;
+  int width = has_suffix ? ob.bs_bitmap_width + delta : x0 + mid_width;
+  int height = ob.bs_bitmap_height > mid.bs_bitmap_height
+    ? ob.bs_bitmap_height : mid.bs_bitmap_height;
+
+  if(!has_suffix && mid.bs_bitmap_width == 0) {
+    width = kept;
+  }
+
+  if(width < kept) {
+    width = kept;
+  }
+
+  // an empty text has an empty bitmap, like bs_render_utf8_string() returns
+  if(width <= 0) {
+    width = 0;
+    height = 0;
+  }
+
+  if(delta == 0 && width == ob.bs_bitmap_width && height == ob.bs_bitmap_height) {
+    // same layout, only the changed columns are touched
+    clear_columns(ob, x0, mid_width);
+    copy_columns(ob, x0, mid, 0, mid_width);
+
+    dirty->bs_rect_x = x0;
+    dirty->bs_rect_width = mid_width;
+    dirty->bs_rect_height = height;
+  } else {
+    bs_bitmap_t nb = bs_bitmap_new(width, height, 0);
+
+    if(nb.bs_bitmap == NULL && width > 0) {
+      bs_utf32_buffer_free(&str);
+      bs_bitmap_free(&mid);
+      free(graphemes);
+      errno = ENOMEM;
+      return false;
+    }
+
+    copy_columns(nb, 0, ob, 0, kept);
+    copy_columns(nb, x0, mid, 0, mid_width);
+
+    if(has_suffix) {
+      copy_columns(nb, x1, ob, old_x1, ob.bs_bitmap_width - old_x1);
+    }
+
+    // a changed height changes every column
+    dirty->bs_rect_x = height == ob.bs_bitmap_height ? kept : 0;
+    dirty->bs_rect_width = (width > ob.bs_bitmap_width ? width : ob.bs_bitmap_width)
+      - dirty->bs_rect_x;
+    dirty->bs_rect_height = height > ob.bs_bitmap_height
+      ? height : ob.bs_bitmap_height;
+
+    bs_bitmap_free(&text->bs_retained_bitmap);
+    text->bs_retained_bitmap = nb;
+  }
+
+  bs_bitmap_free(&mid);
+  bs_utf32_buffer_free(&text->bs_retained_string);
+  free(text->bs_retained_graphemes);
+
+  text->bs_retained_string = str;
+  text->bs_retained_graphemes = graphemes;
+  text->bs_retained_graphemes_len = n;
+  text->bs_retained_cursor_x = has_suffix
+    ? text->bs_retained_cursor_x + delta : x1;
+
+  return true;
+}
@@ -0,0 +1,73 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include <buchstabensuppe.h>
+
+// Head and tail only ever increase and are reduced modulo the
+// capacity (a power of two) when indexing, so a full ring can be
+// told apart from an empty one without sacrificing a slot. Each
+// index is written by one side only: the release store publishes
+// the slot contents (or frees the slot), the acquire load on the
+// other side makes sure they are seen.
+
+bool bs_ring_init(bs_ring_t *ring, size_t capacity, size_t slot_size) {
+  if(capacity == 0 || (capacity & (capacity - 1)) != 0 || slot_size == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  ring->bs_ring_slots = calloc(capacity, slot_size);
+
+  if(ring->bs_ring_slots == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  ring->bs_ring_capacity = capacity;
+  ring->bs_ring_slot_size = slot_size;
+  ring->bs_ring_head = 0;
+  ring->bs_ring_tail = 0;
+
+  return true;
+}
+
+void bs_ring_free(bs_ring_t *ring) {
+  free(ring->bs_ring_slots);
+
+  ring->bs_ring_slots = NULL;
+  ring->bs_ring_capacity = 0;
+  ring->bs_ring_head = 0;
+  ring->bs_ring_tail = 0;
+}
+
+void *bs_ring_write_begin(bs_ring_t *ring) {
+  size_t head = __atomic_load_n(&ring->bs_ring_head, __ATOMIC_RELAXED);
+  size_t tail = __atomic_load_n(&ring->bs_ring_tail, __ATOMIC_ACQUIRE);
+
+  if(head - tail >= ring->bs_ring_capacity) {
+    return NULL;
+  }
+
+  return ring->bs_ring_slots
+    + (head & (ring->bs_ring_capacity - 1)) * ring->bs_ring_slot_size;
+}
+
+void bs_ring_write_commit(bs_ring_t *ring) {
+  __atomic_add_fetch(&ring->bs_ring_head, 1, __ATOMIC_RELEASE);
+}
+
+const void *bs_ring_read_begin(bs_ring_t *ring) {
+  size_t tail = __atomic_load_n(&ring->bs_ring_tail, __ATOMIC_RELAXED);
+  size_t head = __atomic_load_n(&ring->bs_ring_head, __ATOMIC_ACQUIRE);
+
+  if(head == tail) {
+    return NULL;
+  }
+
+  return ring->bs_ring_slots
+    + (tail & (ring->bs_ring_capacity - 1)) * ring->bs_ring_slot_size;
+}
+
+void bs_ring_read_commit(bs_ring_t *ring) {
+  __atomic_add_fetch(&ring->bs_ring_tail, 1, __ATOMIC_RELEASE);
+}
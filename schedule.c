@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200112L /* clock_nanosleep */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <buchstabensuppe.h>
+
+#define NSEC_PER_SEC 1000000000ull
+
+uint64_t bs_clock_now(void) {
+  struct timespec ts;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+
+  return (uint64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static bool stopped(const bs_scheduler_t *scheduler) {
+  return scheduler->bs_scheduler_stop != NULL && *scheduler->bs_scheduler_stop != 0;
+}
+
+// sleeps until the deadline or until the scheduler is stopped by a signal
+static bool sleep_until(const bs_scheduler_t *scheduler, uint64_t deadline) {
+  struct timespec ts;
+  ts.tv_sec = deadline / NSEC_PER_SEC;
+  ts.tv_nsec = deadline % NSEC_PER_SEC;
+
+  int result;
+
+  do {
+    result = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  } while(result == EINTR && !stopped(scheduler));
+
+  if(result == EINTR) {
+    return true;
+  }
+
+  if(result != 0) {
+    errno = result;
+    return false;
+  }
+
+  return true;
+}
+
+int bs_schedule_histogram_bucket(uint64_t ns) {
+  uint64_t us = ns / 1000;
+  int bucket = 0;
+
+  while(us > 0 && bucket < BS_SCHEDULE_HISTOGRAM_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+
+void bs_schedule_histogram_print(FILE *out, const char *name,
+  const uint64_t *histogram, const char *unit) {
+  fprintf(out, "  %s:", name);
+
+  for(int i = 0; i < BS_SCHEDULE_HISTOGRAM_BUCKETS; i++) {
+    if(histogram[i] != 0) {
+      fprintf(out, " <%llu%s: %llu", 1ull << i, unit, (unsigned long long) histogram[i]);
+    }
+  }
+
+  fputc('\n', out);
+}
+
+static void stats_record(bs_schedule_stats_t *stats, uint64_t period, uint64_t deadline, uint64_t now) {
+  uint64_t lateness = now > deadline ? now - deadline : 0;
+
+  stats->bs_stats_lateness_sum += lateness;
+  if(lateness > stats->bs_stats_lateness_max) {
+    stats->bs_stats_lateness_max = lateness;
+  }
+  stats->bs_stats_lateness_histogram[bs_schedule_histogram_bucket(lateness)]++;
+
+  // jitter is the deviation of the time between two
+  // consecutive frames from the configured period
+  if(stats->bs_stats_frames > 0) {
+    uint64_t interval = now - stats->bs_stats_last_frame;
+    uint64_t jitter = interval > period ? interval - period : period - interval;
+
+    stats->bs_stats_jitter_sum += jitter;
+    if(jitter > stats->bs_stats_jitter_max) {
+      stats->bs_stats_jitter_max = jitter;
+    }
+    stats->bs_stats_jitter_histogram[bs_schedule_histogram_bucket(jitter)]++;
+  }
+
+  stats->bs_stats_last_frame = now;
+  stats->bs_stats_frames++;
+}
+
+void bs_scheduler_init(bs_scheduler_t *scheduler) {
+  scheduler->bs_scheduler_tasks = NULL;
+  scheduler->bs_scheduler_tasks_len = 0;
+  scheduler->bs_scheduler_stop = NULL;
+}
+
+void bs_scheduler_free(bs_scheduler_t *scheduler) {
+  if(scheduler->bs_scheduler_tasks != NULL) {
+    free(scheduler->bs_scheduler_tasks);
+  }
+
+  scheduler->bs_scheduler_tasks = NULL;
+  scheduler->bs_scheduler_tasks_len = 0;
+}
+
+bool bs_scheduler_add(bs_scheduler_t *scheduler, uint64_t period, bs_schedule_tick_t tick, void *user) {
+  if(period == 0 || tick == NULL) {
+    errno = EINVAL;
+    return false;
+  }
+
+  size_t new_index = scheduler->bs_scheduler_tasks_len;
+  bs_schedule_task_t *tmp = realloc(scheduler->bs_scheduler_tasks,
+    sizeof(bs_schedule_task_t) * (new_index + 1));
+
+  if(tmp == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  scheduler->bs_scheduler_tasks = tmp;
+  scheduler->bs_scheduler_tasks_len++;
+
+  bs_schedule_task_t *task = scheduler->bs_scheduler_tasks + new_index;
+  memset(task, 0, sizeof(bs_schedule_task_t));
+
+  task->bs_task_tick = tick;
+  task->bs_task_user = user;
+  task->bs_task_period = period;
+
+  return true;
+}
+
+bool bs_scheduler_run(bs_scheduler_t *scheduler) {
+  uint64_t start = bs_clock_now();
+  size_t running = 0;
+
+  for(size_t i = 0; i < scheduler->bs_scheduler_tasks_len; i++) {
+    bs_schedule_task_t *task = scheduler->bs_scheduler_tasks + i;
+
+    // all tasks start at the same time, so tasks with the
+    // same period stay in lockstep for their whole runtime
+    task->bs_task_deadline = start;
+
+    if(!task->bs_task_finished) {
+      running++;
+    }
+  }
+
+  bool success = true;
+
+  while(running > 0 && success && !stopped(scheduler)) {
+    bs_schedule_task_t *next = NULL;
+
+    for(size_t i = 0; i < scheduler->bs_scheduler_tasks_len; i++) {
+      bs_schedule_task_t *task = scheduler->bs_scheduler_tasks + i;
+
+      if(!task->bs_task_finished && (next == NULL ||
+          task->bs_task_deadline < next->bs_task_deadline)) {
+        next = task;
+      }
+    }
+
+    if(!sleep_until(scheduler, next->bs_task_deadline)) {
+      success = false;
+      break;
+    } else if(stopped(scheduler)) {
+      break;
+    }
+
+    uint64_t now = bs_clock_now();
+    stats_record(&next->bs_task_stats, next->bs_task_period,
+      next->bs_task_deadline, now);
+
+    switch(next->bs_task_tick(next->bs_task_user)) {
+      case BS_TICK_CONTINUE:
+        break;
+      case BS_TICK_FINISHED:
+        next->bs_task_finished = true;
+        running--;
+        break;
+      case BS_TICK_ERROR:
+      default:
+        next->bs_task_finished = true;
+        running--;
+        success = false;
+        break;
+    }
+
+    // Deadlines are absolute, so time spent in the tick function or
+    // oversleeping doesn't accumulate. If a whole period has been missed,
+    // skip it instead of sending a burst of frames to catch up.
+    next->bs_task_deadline += next->bs_task_period;
+    now = bs_clock_now();
+
+    while(next->bs_task_deadline + next->bs_task_period <= now) {
+      next->bs_task_deadline += next->bs_task_period;
+      next->bs_task_stats.bs_stats_missed++;
+    }
+  }
+
+  return success;
+}
@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200112L /* shm_open, ftruncate, ... */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <buchstabensuppe.h>
+
+// The shared memory object starts with a header, followed by the slots.
+// The writer never waits for readers: frame n is always written to slot
+// n modulo the slot count. Every slot is protected by a sequence lock,
+// which is odd while the slot is written, so readers can access frames
+// in place and find out afterwards if the writer has overwritten them
+// in the meantime. Readers only map the object read only, so they can't
+// influence the writer at all.
+
+#define SHM_MAGIC 0x62736672u  /* "bsfr" */
+#define SHM_ALIGN 64
+
+struct shm_header {
+  uint32_t  magic;       // set last, once the header is initialized
+  uint32_t  slot_count;  // power of two
+  uint64_t  slot_size;   // bytes per slot including struct shm_slot
+  uint64_t  frame_size;  // maximum size of a frame
+  uint8_t   pad0[SHM_ALIGN - 24];
+  uint64_t  published;   // number of frames published
+  uint8_t   pad1[SHM_ALIGN - 8];
+};
+
+struct shm_slot {
+  uint64_t  lock;
+  uint64_t  seq;
+  uint64_t  time;
+  uint64_t  size;
+  uint32_t  tag;
+  uint32_t  pad;
+  uint8_t   data[];
+};
+
+static inline struct shm_header *shm_header(const bs_shm_ring_t *ring) {
+  return (struct shm_header *) ring->bs_shm_map;
+}
+
+static inline struct shm_slot *shm_slot(const bs_shm_ring_t *ring, uint64_t seq) {
+  const struct shm_header *h = shm_header(ring);
+
+  return (struct shm_slot *) (ring->bs_shm_map + sizeof(struct shm_header)
+    + (seq & (h->slot_count - 1)) * h->slot_size);
+}
+
+static void shm_ring_reset(bs_shm_ring_t *ring) {
+  memset(ring, 0, sizeof(bs_shm_ring_t));
+}
+
+bool bs_shm_ring_create(bs_shm_ring_t *ring, const char *name,
+  size_t slots, size_t frame_size) {
+  shm_ring_reset(ring);
+
+  if(slots == 0 || slots > UINT32_MAX || (slots & (slots - 1)) != 0 ||
+      frame_size == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  size_t slot_size = (sizeof(struct shm_slot) + frame_size + SHM_ALIGN - 1)
+    / SHM_ALIGN * SHM_ALIGN;
+
+  if(slot_size > (SIZE_MAX - sizeof(struct shm_header)) / slots) {
+    errno = EINVAL;
+    return false;
+  }
+
+  size_t map_size = sizeof(struct shm_header) + slots * slot_size;
+  size_t name_len = strlen(name);
+
+  ring->bs_shm_name = malloc(name_len + 1);
+
+  if(ring->bs_shm_name == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  memcpy(ring->bs_shm_name, name, name_len + 1);
+
+  // readers still following a previous writer keep their old mapping
+  shm_unlink(name);
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  bool success = fd >= 0 && ftruncate(fd, map_size) == 0;
+
+  if(success) {
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    success = map != MAP_FAILED;
+
+    if(success) {
+      ring->bs_shm_map = map;
+      ring->bs_shm_map_size = map_size;
+    }
+  }
+
+  if(fd >= 0) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+  }
+
+  if(!success) {
+    if(fd >= 0) {
+      shm_unlink(name);
+    }
+
+    free(ring->bs_shm_name);
+    shm_ring_reset(ring);
+    return false;
+  }
+
+  // the new object is zeroed, i. e. every slot is unlocked
+  struct shm_header *h = shm_header(ring);
+  h->slot_count = slots;
+  h->slot_size = slot_size;
+  h->frame_size = frame_size;
+  __atomic_store_n(&h->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+bool bs_shm_ring_open(bs_shm_ring_t *ring, const char *name) {
+  shm_ring_reset(ring);
+
+  int fd = shm_open(name, O_RDONLY, 0);
+
+  if(fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  void *map = MAP_FAILED;
+
+  if(fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(struct shm_header)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  } else {
+    errno = EINVAL;
+  }
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+
+  if(map == MAP_FAILED) {
+    return false;
+  }
+
+  ring->bs_shm_map = map;
+  ring->bs_shm_map_size = st.st_size;
+
+  const struct shm_header *h = shm_header(ring);
+  uint32_t slots = h->slot_count;
+
+  // the writer may still be setting the object up
+  bool valid = __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == SHM_MAGIC &&
+    slots != 0 && (slots & (slots - 1)) == 0 &&
+    h->slot_size >= sizeof(struct shm_slot) + h->frame_size &&
+    h->slot_size <= (ring->bs_shm_map_size - sizeof(struct shm_header)) / slots;
+
+  if(!valid) {
+    munmap(ring->bs_shm_map, ring->bs_shm_map_size);
+    shm_ring_reset(ring);
+    errno = EAGAIN;
+    return false;
+  }
+
+  // start with the frame shown right now
+  uint64_t published = __atomic_load_n(&h->published, __ATOMIC_ACQUIRE);
+  ring->bs_shm_next = published > 0 ? published - 1 : 0;
+
+  return true;
+}
+
+void bs_shm_ring_close(bs_shm_ring_t *ring) {
+  if(ring->bs_shm_map != NULL) {
+    munmap(ring->bs_shm_map, ring->bs_shm_map_size);
+  }
+
+  if(ring->bs_shm_name != NULL) {
+    shm_unlink(ring->bs_shm_name);
+    free(ring->bs_shm_name);
+  }
+
+  shm_ring_reset(ring);
+}
+
+bool bs_shm_ring_publish(bs_shm_ring_t *ring, const uint8_t *frame,
+  size_t size, uint32_t tag, uint64_t time) {
+  struct shm_header *h = shm_header(ring);
+
+  if(size > h->frame_size) {
+    errno = EMSGSIZE;
+    return false;
+  }
+
+  uint64_t seq = __atomic_load_n(&h->published, __ATOMIC_RELAXED);
+  struct shm_slot *slot = shm_slot(ring, seq);
+  uint64_t lock = __atomic_load_n(&slot->lock, __ATOMIC_RELAXED);
+
+  __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __atomic_store_n(&slot->seq, seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->time, time, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->size, size, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->tag, tag, __ATOMIC_RELAXED);
+  memcpy(slot->data, frame, size);
+
+  __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&h->published, seq + 1, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+bool bs_shm_ring_next(bs_shm_ring_t *ring, bs_shm_frame_t *frame) {
+  const struct shm_header *h = shm_header(ring);
+
+  for(;;) {
+    uint64_t published = __atomic_load_n(&h->published, __ATOMIC_ACQUIRE);
+
+    if(ring->bs_shm_next >= published) {
+      return false;
+    }
+
+    // frames older than the ring's capacity are gone for sure
+    if(published - ring->bs_shm_next > h->slot_count) {
+      ring->bs_shm_dropped += published - h->slot_count - ring->bs_shm_next;
+      ring->bs_shm_next = published - h->slot_count;
+    }
+
+    const struct shm_slot *slot = shm_slot(ring, ring->bs_shm_next);
+
+    uint64_t lock = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    uint64_t time = __atomic_load_n(&slot->time, __ATOMIC_RELAXED);
+    uint64_t size = __atomic_load_n(&slot->size, __ATOMIC_RELAXED);
+    uint32_t tag = __atomic_load_n(&slot->tag, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // the writer has lapped us while reading, try the next one
+    if((lock & 1) != 0 || seq != ring->bs_shm_next ||
+        __atomic_load_n(&slot->lock, __ATOMIC_RELAXED) != lock) {
+      ring->bs_shm_dropped++;
+      ring->bs_shm_next++;
+      continue;
+    }
+
+    frame->bs_shm_frame_data = slot->data;
+    frame->bs_shm_frame_size = size;
+    frame->bs_shm_frame_seq = seq;
+    frame->bs_shm_frame_time = time;
+    frame->bs_shm_frame_tag = tag;
+    frame->bs_shm_frame_lock = lock;
+
+    ring->bs_shm_next = seq + 1;
+
+    return true;
+  }
+}
+
+bool bs_shm_ring_valid(const bs_shm_ring_t *ring, const bs_shm_frame_t *frame) {
+  const struct shm_slot *slot = shm_slot(ring, frame->bs_shm_frame_seq);
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  return __atomic_load_n(&slot->lock, __ATOMIC_RELAXED) == frame->bs_shm_frame_lock;
+}
@@ -0,0 +1,456 @@
+#define _POSIX_C_SOURCE 200809L /* pwrite, ... */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <buchstabensuppe.h>
+
+// A frame stream file consists of
+//
+//   * a fixed size header,
+//   * a descriptor of every panel, followed by its frame header bytes,
+//   * padding up to a multiple of 8,
+//   * records of equal size: the duration of the record in nanoseconds,
+//     followed by the frame of every panel in order.
+//
+// All integers are little endian. As every record has the same size,
+// frames can be used straight from the mapped file. The hash covers
+// everything after the header, i. e. the stream's content, but none of
+// the fields derived from it.
+
+#define STREAM_MAGIC "BSFS"
+#define STREAM_VERSION 1
+
+#define HEADER_SIZE 64
+#define PANEL_SIZE 48
+#define DURATION_SIZE 8
+
+// header field offsets
+#define HEADER_VERSION 4
+#define HEADER_PANELS 8
+#define HEADER_RECORDS 16
+#define HEADER_DURATION 24
+#define HEADER_HASH 32
+#define HEADER_RECORD_SIZE 40
+#define HEADER_DATA_OFFSET 48
+
+// FNV-1a like bs_frame_hash(), but can be continued
+#define HASH_INIT 0xcbf29ce484222325ull
+
+static uint64_t hash_update(uint64_t hash, const uint8_t *data, size_t size) {
+  for(size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  for(int i = 0; i < 4; i++) {
+    p[i] = v >> (8 * i);
+  }
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+  for(int i = 0; i < 8; i++) {
+    p[i] = v >> (8 * i);
+  }
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+  uint32_t v = 0;
+
+  for(int i = 0; i < 4; i++) {
+    v |= (uint32_t) p[i] << (8 * i);
+  }
+
+  return v;
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+  uint64_t v = 0;
+
+  for(int i = 0; i < 8; i++) {
+    v |= (uint64_t) p[i] << (8 * i);
+  }
+
+  return v;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size) {
+  while(size > 0) {
+    ssize_t written = write(fd, data, size);
+
+    if(written < 0 && errno == EINTR) {
+      continue;
+    } else if(written <= 0) {
+      return false;
+    }
+
+    data += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+static void encode_panel(uint8_t *p, const bs_stream_panel_t *panel, size_t frame_size) {
+  const bs_frame_format_t *f = &panel->bs_panel_format;
+
+  memset(p, 0, PANEL_SIZE);
+  put_u32(p, panel->bs_panel_x);
+  put_u32(p + 4, panel->bs_panel_y);
+  put_u32(p + 8, panel->bs_panel_width);
+  put_u32(p + 12, panel->bs_panel_height);
+  put_u32(p + 16, f->bs_format_scan);
+  put_u32(p + 20, f->bs_format_bit_order);
+  put_u32(p + 24, f->bs_format_depth);
+  put_u32(p + 28, f->bs_format_band_height);
+  put_u32(p + 32, f->bs_format_header_size);
+  put_u32(p + 36, frame_size);
+}
+
+static void decode_panel(const uint8_t *p, bs_stream_panel_t *panel) {
+  bs_frame_format_t *f = &panel->bs_panel_format;
+
+  panel->bs_panel_x = (int32_t) get_u32(p);
+  panel->bs_panel_y = (int32_t) get_u32(p + 4);
+  panel->bs_panel_width = (int32_t) get_u32(p + 8);
+  panel->bs_panel_height = (int32_t) get_u32(p + 12);
+  f->bs_format_scan = get_u32(p + 16);
+  f->bs_format_bit_order = get_u32(p + 20);
+  f->bs_format_depth = (int32_t) get_u32(p + 24);
+  f->bs_format_band_height = (int32_t) get_u32(p + 28);
+  f->bs_format_header_size = get_u32(p + 32);
+  f->bs_format_header = NULL;
+  panel->bs_panel_frame_size = get_u32(p + 36);
+}
+
+bool bs_stream_writer_open(bs_stream_writer_t *w, int fd,
+  const bs_stream_panel_t *panels, size_t panels_len) {
+  memset(w, 0, sizeof(bs_stream_writer_t));
+  w->bs_writer_fd = fd;
+
+  if(panels_len == 0 || panels_len > UINT32_MAX) {
+    errno = EINVAL;
+    return false;
+  }
+
+  w->bs_writer_frame_sizes = calloc(panels_len, sizeof(size_t));
+
+  if(w->bs_writer_frame_sizes == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  w->bs_writer_panels_len = panels_len;
+  w->bs_writer_record_size = DURATION_SIZE;
+  w->bs_writer_hash = HASH_INIT;
+
+  uint8_t header[HEADER_SIZE] = STREAM_MAGIC;
+  size_t table_size = 0;
+
+  for(size_t i = 0; i < panels_len; i++) {
+    const bs_stream_panel_t *p = panels + i;
+    size_t size = bs_frame_format_size(&p->bs_panel_format, p->bs_panel_width,
+      p->bs_panel_height);
+
+    if(size == 0 || size > UINT32_MAX ||
+        w->bs_writer_record_size > SIZE_MAX - size) {
+      bs_stream_writer_finish(w, NULL);
+      errno = EINVAL;
+      return false;
+    }
+
+    w->bs_writer_frame_sizes[i] = size;
+    w->bs_writer_record_size += size;
+    table_size += PANEL_SIZE + p->bs_panel_format.bs_format_header_size;
+  }
+
+  size_t data_offset = (HEADER_SIZE + table_size + 7) / 8 * 8;
+
+  // the record counts and hash are filled in by bs_stream_writer_finish()
+  put_u32(header + HEADER_VERSION, STREAM_VERSION);
+  put_u32(header + HEADER_PANELS, panels_len);
+  put_u64(header + HEADER_RECORD_SIZE, w->bs_writer_record_size);
+  put_u64(header + HEADER_DATA_OFFSET, data_offset);
+
+  w->bs_writer_pending = malloc(w->bs_writer_record_size);
+  bool success = w->bs_writer_pending != NULL && write_all(fd, header, HEADER_SIZE);
+
+  for(size_t i = 0; success && i < panels_len; i++) {
+    const bs_frame_format_t *f = &panels[i].bs_panel_format;
+    uint8_t desc[PANEL_SIZE];
+
+    encode_panel(desc, panels + i, w->bs_writer_frame_sizes[i]);
+    w->bs_writer_hash = hash_update(w->bs_writer_hash, desc, PANEL_SIZE);
+    w->bs_writer_hash = hash_update(w->bs_writer_hash, f->bs_format_header,
+      f->bs_format_header_size);
+
+    success = write_all(fd, desc, PANEL_SIZE) &&
+      write_all(fd, f->bs_format_header, f->bs_format_header_size);
+  }
+
+  if(success) {
+    uint8_t padding[8] = { 0 };
+    size_t padding_size = data_offset - HEADER_SIZE - table_size;
+
+    w->bs_writer_hash = hash_update(w->bs_writer_hash, padding, padding_size);
+    success = write_all(fd, padding, padding_size);
+  }
+
+  if(!success) {
+    int saved_errno = w->bs_writer_pending == NULL ? ENOMEM : errno;
+    bs_stream_writer_finish(w, NULL);
+    errno = saved_errno;
+  }
+
+  return success;
+}
+
+// writes the pending record, whose duration is known now
+static bool writer_flush(bs_stream_writer_t *w) {
+  if(w->bs_writer_pending_duration == 0) {
+    return true;
+  }
+
+  put_u64(w->bs_writer_pending, w->bs_writer_pending_duration);
+
+  w->bs_writer_hash = hash_update(w->bs_writer_hash, w->bs_writer_pending,
+    w->bs_writer_record_size);
+  w->bs_writer_records++;
+  w->bs_writer_duration += w->bs_writer_pending_duration;
+  w->bs_writer_pending_duration = 0;
+
+  return write_all(w->bs_writer_fd, w->bs_writer_pending, w->bs_writer_record_size);
+}
+
+bool bs_stream_writer_append(bs_stream_writer_t *w, const uint8_t *const *frames,
+  uint64_t duration) {
+  if(duration == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  // a frame that is shown for longer only extends its record
+  bool same = w->bs_writer_pending_duration > 0;
+  size_t offset = DURATION_SIZE;
+
+  for(size_t i = 0; same && i < w->bs_writer_panels_len; i++) {
+    same = memcmp(w->bs_writer_pending + offset, frames[i],
+      w->bs_writer_frame_sizes[i]) == 0;
+    offset += w->bs_writer_frame_sizes[i];
+  }
+
+  if(same) {
+    w->bs_writer_pending_duration += duration;
+    return true;
+  }
+
+  if(!writer_flush(w)) {
+    return false;
+  }
+
+  offset = DURATION_SIZE;
+
+  for(size_t i = 0; i < w->bs_writer_panels_len; i++) {
+    memcpy(w->bs_writer_pending + offset, frames[i], w->bs_writer_frame_sizes[i]);
+    offset += w->bs_writer_frame_sizes[i];
+  }
+
+  w->bs_writer_pending_duration = duration;
+
+  return true;
+}
+
+bool bs_stream_writer_finish(bs_stream_writer_t *w, uint64_t *hash) {
+  bool success = w->bs_writer_pending != NULL && writer_flush(w);
+
+  if(success) {
+    uint8_t fields[HEADER_HASH + 8 - HEADER_RECORDS];
+
+    put_u64(fields, w->bs_writer_records);
+    put_u64(fields + HEADER_DURATION - HEADER_RECORDS, w->bs_writer_duration);
+    put_u64(fields + HEADER_HASH - HEADER_RECORDS, w->bs_writer_hash);
+
+    success = pwrite(w->bs_writer_fd, fields, sizeof(fields), HEADER_RECORDS)
+      == (ssize_t) sizeof(fields);
+  }
+
+  if(success && hash != NULL) {
+    *hash = w->bs_writer_hash;
+  }
+
+  int saved_errno = errno;
+
+  free(w->bs_writer_pending);
+  free(w->bs_writer_frame_sizes);
+  memset(w, 0, sizeof(bs_stream_writer_t));
+
+  errno = saved_errno;
+
+  return success;
+}
+
+// checks the mapped file and sets up the panels, doesn't check the hash
+static bool stream_parse(bs_stream_t *s) {
+  const uint8_t *map = s->bs_stream_map;
+  size_t map_size = s->bs_stream_map_size;
+
+  if(map_size < HEADER_SIZE || memcmp(map, STREAM_MAGIC, 4) != 0 ||
+      get_u32(map + HEADER_VERSION) != STREAM_VERSION) {
+    return false;
+  }
+
+  uint32_t panels_len = get_u32(map + HEADER_PANELS);
+  uint64_t records = get_u64(map + HEADER_RECORDS);
+  uint64_t record_size = get_u64(map + HEADER_RECORD_SIZE);
+  uint64_t data_offset = get_u64(map + HEADER_DATA_OFFSET);
+
+  if(panels_len == 0 || panels_len > (map_size - HEADER_SIZE) / PANEL_SIZE ||
+      data_offset > map_size || record_size <= DURATION_SIZE ||
+      records != (map_size - data_offset) / record_size ||
+      (map_size - data_offset) % record_size != 0) {
+    return false;
+  }
+
+  s->bs_stream_panels = calloc(panels_len, sizeof(bs_stream_panel_t));
+  s->bs_stream_offsets = calloc(panels_len, sizeof(size_t));
+
+  if(s->bs_stream_panels == NULL || s->bs_stream_offsets == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  s->bs_stream_panels_len = panels_len;
+
+  size_t pos = HEADER_SIZE;
+  uint64_t offset = DURATION_SIZE;
+
+  for(uint32_t i = 0; i < panels_len; i++) {
+    bs_stream_panel_t *p = s->bs_stream_panels + i;
+    bs_frame_format_t *f = &p->bs_panel_format;
+
+    if(pos > data_offset || data_offset - pos < PANEL_SIZE) {
+      return false;
+    }
+
+    decode_panel(map + pos, p);
+    pos += PANEL_SIZE;
+
+    if(data_offset - pos < f->bs_format_header_size) {
+      return false;
+    }
+
+    f->bs_format_header = f->bs_format_header_size > 0 ? map + pos : NULL;
+    pos += f->bs_format_header_size;
+
+    if(p->bs_panel_frame_size == 0 || p->bs_panel_frame_size != bs_frame_format_size(f,
+        p->bs_panel_width, p->bs_panel_height)) {
+      return false;
+    }
+
+    s->bs_stream_offsets[i] = offset;
+    offset += p->bs_panel_frame_size;
+  }
+
+  if(offset != record_size) {
+    return false;
+  }
+
+  // a frame that is never shown would keep the player from advancing
+  for(uint64_t i = 0; i < records; i++) {
+    if(get_u64(map + data_offset + i * record_size) == 0) {
+      return false;
+    }
+  }
+
+  s->bs_stream_records = records;
+  s->bs_stream_duration = get_u64(map + HEADER_DURATION);
+  s->bs_stream_hash = get_u64(map + HEADER_HASH);
+  s->bs_stream_record_size = record_size;
+  s->bs_stream_data = map + data_offset;
+
+  return true;
+}
+
+bool bs_stream_open(bs_stream_t *s, const char *path) {
+  memset(s, 0, sizeof(bs_stream_t));
+
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  void *map = MAP_FAILED;
+
+  if(fstat(fd, &st) == 0 && st.st_size >= HEADER_SIZE) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  } else {
+    errno = EINVAL;
+  }
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+
+  if(map == MAP_FAILED) {
+    return false;
+  }
+
+  s->bs_stream_map = map;
+  s->bs_stream_map_size = st.st_size;
+
+  if(!stream_parse(s)) {
+    saved_errno = errno == ENOMEM ? ENOMEM : EINVAL;
+    bs_stream_close(s);
+    errno = saved_errno;
+    return false;
+  }
+
+  return true;
+}
+
+void bs_stream_close(bs_stream_t *s) {
+  if(s->bs_stream_map != NULL) {
+    munmap((void *) s->bs_stream_map, s->bs_stream_map_size);
+  }
+
+  free(s->bs_stream_panels);
+  free(s->bs_stream_offsets);
+
+  memset(s, 0, sizeof(bs_stream_t));
+}
+
+bool bs_stream_verify(const bs_stream_t *s) {
+  const uint8_t *content = s->bs_stream_map + HEADER_SIZE;
+  uint64_t hash = hash_update(HASH_INIT, content, s->bs_stream_map_size - HEADER_SIZE);
+  uint64_t duration = 0;
+
+  for(uint64_t i = 0; i < s->bs_stream_records; i++) {
+    duration += bs_stream_frame_duration(s, i);
+  }
+
+  if(hash != s->bs_stream_hash || duration != s->bs_stream_duration) {
+    errno = EINVAL;
+    return false;
+  }
+
+  return true;
+}
+
+uint64_t bs_stream_frame_duration(const bs_stream_t *s, uint64_t index) {
+  return get_u64(s->bs_stream_data + index * s->bs_stream_record_size);
+}
+
+const uint8_t *bs_stream_frame(const bs_stream_t *s, uint64_t index, size_t panel) {
+  return s->bs_stream_data + index * s->bs_stream_record_size
+    + s->bs_stream_offsets[panel];
+}
@@ -1,10 +1,255 @@
+#define _POSIX_C_SOURCE 200809L
 #include "third_party/test.h"
 #include "buchstabensuppe.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <utf8proc.h>
 
 #define FAMILY_EMOJI "👩‍👩‍👧‍👦"
 
+// meson treats this exit code as a skipped test, like in bench.c
+#define EXIT_SKIP 77
+
+static size_t allocations = 0;
+static size_t heap_calls = 0;
+
+// meson links the tests with -Wl,--wrap=malloc,... if the linker can, so
+// the heap calls of the tests and of the library objects are counted too
+#ifdef BS_WRAP_MALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  heap_calls++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  heap_calls++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  heap_calls++;
+  return __real_realloc(ptr, size);
+}
+#endif
+
+void *counting_malloc(void *user, size_t size) {
+  (void) user;
+  allocations++;
+  return malloc(size);
+}
+
+void *counting_realloc(void *user, void *ptr, size_t size) {
+  (void) user;
+  allocations++;
+  return realloc(ptr, size);
+}
+
+void counting_free(void *user, void *ptr) {
+  (void) user;
+  free(ptr);
+}
+
+// straightforward decoder to compare bs_utf8_decode() against
+static enum bs_decode_result reference_decode(const char *s, size_t l, uint32_t *dst, size_t *len) {
+  *len = 0;
+
+  for(size_t i = 0; i < l;) {
+    utf8proc_int32_t c;
+    utf8proc_ssize_t n = utf8proc_iterate((const utf8proc_uint8_t *) s + i, l - i, &c);
+
+    if(n <= 0) {
+      return BS_DECODE_INVALID;
+    }
+
+    dst[(*len)++] = c;
+    i += n;
+  }
+
+  return BS_DECODE_OK;
+}
+
+// wraps s at width like a paragraph whose grapheme clusters are single
+// codepoints one pixel wide, so no font is needed
+static bool wrap_synthetic(bs_paragraph_t *p, const char *s, int width) {
+  bs_paragraph_free(p);
+
+  bs_utf32_buffer_t str = bs_decode_utf8(s, strlen(s));
+  size_t len = str.bs_utf32_buffer_len;
+
+  p->bs_paragraph_string = str;
+  p->bs_paragraph_graphemes = malloc((len + 1) * sizeof(bs_grapheme_layout_t));
+  p->bs_paragraph_advances = malloc((len + 1) * sizeof(int));
+  p->bs_paragraph_breaks = malloc(len + 1);
+
+  if(p->bs_paragraph_graphemes == NULL || p->bs_paragraph_advances == NULL ||
+      p->bs_paragraph_breaks == NULL) {
+    return false;
+  }
+
+  for(size_t i = 0; i < len; i++) {
+    bs_grapheme_layout_t g = { i, 1, 0 };
+    p->bs_paragraph_graphemes[i] = g;
+    p->bs_paragraph_advances[i] = str.bs_utf32_buffer[i] == '\n' ? 0 : 1;
+    p->bs_paragraph_breaks[i] = bs_utf32_line_break(str, i);
+  }
+
+  p->bs_paragraph_graphemes_len = len;
+
+  return bs_paragraph_wrap(p, width);
+}
+
+// the lines of a synthetic paragraph separated by '|', e. g. "ab|cd"
+static const char *wrapped_lines(const bs_paragraph_t *p) {
+  static char lines[64];
+  size_t len = 0;
+
+  for(size_t i = 0; i < p->bs_paragraph_lines_len; i++) {
+    const bs_line_t *line = p->bs_paragraph_lines + i;
+
+    if(i > 0 && len < sizeof(lines) - 1) {
+      lines[len++] = '|';
+    }
+
+    for(size_t j = line->bs_line_start; j < line->bs_line_end && len < sizeof(lines) - 1; j++) {
+      lines[len++] = (char) p->bs_paragraph_string.bs_utf32_buffer[
+        p->bs_paragraph_graphemes[j].bs_layout_offset];
+    }
+  }
+
+  lines[len] = '\0';
+
+  return lines;
+}
+
+enum bs_tick_result countdown_tick(void *user) {
+  int *left = user;
+  return --(*left) > 0 ? BS_TICK_CONTINUE : BS_TICK_FINISHED;
+}
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// never finishes on its own, but stops the scheduler after a few ticks
+enum bs_tick_result stopping_tick(void *user) {
+  int *left = user;
+
+  if(--(*left) == 0) {
+    stop_requested = 1;
+  }
+
+  return BS_TICK_CONTINUE;
+}
+
+// number of spans called name recorded since tracing was started
+static int traced_spans(const char *name) {
+  static char trace[1 << 16];
+  char path[] = "/tmp/bs-trace-XXXXXX";
+  char needle[64];
+  int fd = mkstemp(path);
+  int count = 0;
+
+  if(fd < 0) {
+    return -1;
+  }
+
+  if(bs_trace_write(path)) {
+    ssize_t len = read(fd, trace, sizeof(trace) - 1);
+    trace[len > 0 ? len : 0] = '\0';
+
+    snprintf(needle, sizeof(needle), "\"name\":\"%s\"", name);
+
+    for(const char *s = trace; (s = strstr(s, needle)) != NULL; s++) {
+      count++;
+    }
+  } else {
+    count = -1;
+  }
+
+  close(fd);
+  unlink(path);
+
+  return count;
+}
+
+// Whether updating a retained text from before to after renders the same
+// as rendering after from scratch and marks every changed pixel dirty.
+static bool retained_update_matches(bs_context_t *ctx, const char *before,
+  const char *after) {
+  bs_retained_text_t retained;
+  bs_rect_t dirty;
+
+  bs_retained_text_init(&retained);
+  bool ok = bs_retained_text_update(ctx, &retained, before, strlen(before), &dirty);
+
+  bs_bitmap_t old = retained.bs_retained_bitmap;
+  bs_bitmap_t kept = bs_bitmap_new(old.bs_bitmap_width, old.bs_bitmap_height, 0);
+  bs_bitmap_copy(kept, 0, 0, old);
+
+  ok = ok && bs_retained_text_update(ctx, &retained, after, strlen(after), &dirty);
+
+  bs_bitmap_t updated = retained.bs_retained_bitmap;
+  bs_bitmap_t expected = bs_render_utf8_string(ctx, after, strlen(after));
+
+  ok = ok && updated.bs_bitmap_width == expected.bs_bitmap_width &&
+    updated.bs_bitmap_height == expected.bs_bitmap_height &&
+    memcmp(updated.bs_bitmap, expected.bs_bitmap,
+      (size_t) expected.bs_bitmap_width * expected.bs_bitmap_height) == 0;
+
+  int width = kept.bs_bitmap_width > updated.bs_bitmap_width
+    ? kept.bs_bitmap_width : updated.bs_bitmap_width;
+  int height = kept.bs_bitmap_height > updated.bs_bitmap_height
+    ? kept.bs_bitmap_height : updated.bs_bitmap_height;
+
+  for(int y = 0; ok && y < height; y++) {
+    for(int x = 0; ok && x < width; x++) {
+      bool inside = x >= dirty.bs_rect_x && x < dirty.bs_rect_x + dirty.bs_rect_width &&
+        y >= dirty.bs_rect_y && y < dirty.bs_rect_y + dirty.bs_rect_height;
+
+      ok = inside || bs_bitmap_get(kept, x, y, 0) == bs_bitmap_get(updated, x, y, 0);
+    }
+  }
+
+  bs_bitmap_free(&expected);
+  bs_bitmap_free(&kept);
+  bs_retained_text_free(&retained);
+
+  return ok;
+}
+
+#define RING_ITEMS 100000
+
+// writes the numbers up to RING_ITEMS into the ring, waiting while it is full
+void *ring_producer(void *user) {
+  bs_ring_t *ring = user;
+
+  for(size_t i = 0; i < RING_ITEMS; i++) {
+    size_t *slot;
+
+    while((slot = bs_ring_write_begin(ring)) == NULL) {
+      sched_yield();
+    }
+
+    *slot = i;
+    bs_ring_write_commit(ring);
+  }
+
+  return NULL;
+}
+
 int main(void) {
   bs_utf32_buffer_t family = bs_decode_utf8(FAMILY_EMOJI, sizeof(FAMILY_EMOJI) - 1);
 
@@ -43,4 +288,1094 @@ int main(void) {
       bs_utf32_buffer_free(&unlikely);
     }
   }
+
+  // ASCII runs of every length around the block sizes, mixed with
+  // multibyte sequences and the occasional invalid byte
+  static const char *const pieces[] = {
+    "a", "0123456789abcdef", "ä", "€", FAMILY_EMOJI, "\x80", "\xc3", "\xed\xa0\x80",
+  };
+  bool decoders_agree = true;
+
+  srand(42);
+
+  for(int round = 0; decoders_agree && round < 5000; round++) {
+    char input[256];
+    size_t l = 0;
+
+    while(l < sizeof(input) - 32) {
+      size_t piece = rand() % (sizeof(pieces) / sizeof(pieces[0]));
+
+      // invalid pieces are rarer, so most inputs decode fully
+      if(piece >= 5 && rand() % 8 != 0) {
+        continue;
+      }
+
+      size_t pl = strlen(pieces[piece]);
+      memcpy(input + l, pieces[piece], pl);
+      l += pl;
+
+      if(rand() % 16 == 0) {
+        break;
+      }
+    }
+
+    uint32_t expected[256];
+    uint32_t actual[256];
+    size_t expected_len, actual_len;
+    enum bs_decode_result expected_result = reference_decode(input, l, expected, &expected_len);
+    enum bs_decode_result actual_result = bs_utf8_decode(input, l, actual, &actual_len);
+
+    decoders_agree = expected_result == actual_result &&
+      expected_len == actual_len &&
+      memcmp(expected, actual, actual_len * sizeof(uint32_t)) == 0;
+  }
+
+  test_case("Fast UTF-8 decoding agrees with utf8proc", decoders_agree);
+
+  bs_utf32_buffer_t appended = { NULL, 0, 0 };
+  bool appended_ok = true;
+  int growths = 0;
+
+  // growing by just what is needed would grow on every append
+  for(int i = 0; appended_ok && i < 100; i++) {
+    size_t cap = appended.bs_utf32_buffer_cap;
+    appended_ok = bs_utf32_buffer_append_utf8(&appended, "ab€", 5) == BS_DECODE_OK;
+    growths += appended.bs_utf32_buffer_cap != cap;
+  }
+
+  test_case("Appending UTF-8 grows the buffer geometrically",
+    appended_ok && appended.bs_utf32_buffer_len == 300 && growths <= 8 &&
+    appended.bs_utf32_buffer_cap < 2 * 300 + 5 &&
+    appended.bs_utf32_buffer[299] == 0x20ac);
+
+  bs_utf32_buffer_free(&appended);
+
+  test_case("Tracing is disabled by default", bs_trace_begin() == 0);
+
+  if(bs_trace_start(16)) {
+    uint64_t start = bs_trace_begin();
+    bs_trace_end("test", start, "arg", 42);
+
+    char trace_path[] = "/tmp/bs-trace-XXXXXX";
+    int trace_fd = mkstemp(trace_path);
+    char trace[512] = "";
+
+    if(trace_fd >= 0) {
+      bool trace_written = bs_trace_write(trace_path);
+      ssize_t trace_len = read(trace_fd, trace, sizeof(trace) - 1);
+      trace[trace_len > 0 ? trace_len : 0] = '\0';
+
+      test_case("Trace can be written", trace_written);
+      test_case("Tracing records spans", start != 0 &&
+        strstr(trace, "\"name\":\"test\"") != NULL &&
+        strstr(trace, "\"args\":{\"arg\":42}") != NULL &&
+        strstr(trace, "\"dropped_events\":\"0\"") != NULL);
+
+      close(trace_fd);
+      unlink(trace_path);
+    }
+
+    bs_trace_stop();
+
+    test_case("Stopped tracing is disabled", bs_trace_begin() == 0);
+  }
+
+  bs_allocator_t counting = {
+    counting_malloc, counting_realloc, counting_free, NULL
+  };
+
+  bs_arena_t arena;
+  bs_arena_init(&arena, counting);
+
+  for(int round = 0; round < 2; round++) {
+    allocations = 0;
+
+    for(size_t size = 1; size < 10000; size *= 3) {
+      unsigned char *mem = bs_arena_alloc(&arena, size);
+      if(mem != NULL) {
+        memset(mem, 0xff, size);
+      }
+    }
+
+    bs_arena_reset(&arena);
+  }
+
+  test_case("Arena doesn't allocate after reset", allocations == 0);
+
+  bs_arena_free(&arena);
+
+  // rendering is only tested given a font, e. g. BS_BENCH_FONT=/path/to/unifont.ttf
+  const char *font = getenv("BS_BENCH_FONT");
+  const char *text = FAMILY_EMOJI " Hello World";
+
+  bs_context_t ctx;
+  bs_context_init_allocator(&ctx, counting);
+
+  bool font_added = font != NULL && bs_add_font(&ctx, font, 0, 16);
+
+  if(font == NULL) {
+    puts("Rendering is skipped, BS_BENCH_FONT is not set");
+  } else {
+    test_case("Font from BS_BENCH_FONT can be added", font_added);
+  }
+
+  if(font_added) {
+    bs_utf32_buffer_t str = bs_decode_utf8(text, strlen(text));
+
+    // the first render sizes the scratch memory and the bitmap
+    bs_bitmap_t first = bs_render_utf8_string(&ctx, text, strlen(text));
+    bs_bitmap_t again = bs_bitmap_new(first.bs_bitmap_width, first.bs_bitmap_height, 0);
+    unsigned char *again_pixels = again.bs_bitmap;
+    size_t size = (size_t) first.bs_bitmap_width * first.bs_bitmap_height;
+    bool rendered = size > 0 && again.bs_bitmap != NULL;
+
+    allocations = 0;
+
+    for(int round = 0; rendered && round < 2; round++) {
+      bs_cursor_t cursor = { 0, 0 };
+      memset(again.bs_bitmap, 0, size);
+      rendered = bs_render_utf32_string_append(&ctx, &again, &cursor, str);
+    }
+
+    test_case("Repeated renders don't allocate", rendered && allocations == 0 &&
+      again.bs_bitmap == again_pixels &&
+      again.bs_bitmap_width == first.bs_bitmap_width &&
+      again.bs_bitmap_height == first.bs_bitmap_height &&
+      memcmp(again.bs_bitmap, first.bs_bitmap, size) == 0);
+
+    // Latin-1 text is mostly placed without shaping it, see bench.c
+    const char *latin = "Größenordnung: 12,5 °C, façade, naïve & Ñandú!";
+    bool unshaped_same = true;
+
+    for(int binary = 0; unshaped_same && binary < 2; binary++) {
+      ctx.bs_rendering_flags = binary ? BS_RENDER_BINARY : 0;
+      bs_bitmap_t fast = bs_render_utf8_string(&ctx, latin, strlen(latin));
+      ctx.bs_rendering_flags |= BS_RENDER_ALWAYS_SHAPE;
+      bs_bitmap_t shaped = bs_render_utf8_string(&ctx, latin, strlen(latin));
+
+      unshaped_same = fast.bs_bitmap != NULL && shaped.bs_bitmap != NULL &&
+        fast.bs_bitmap_width == shaped.bs_bitmap_width &&
+        fast.bs_bitmap_height == shaped.bs_bitmap_height &&
+        memcmp(fast.bs_bitmap, shaped.bs_bitmap,
+          (size_t) fast.bs_bitmap_width * fast.bs_bitmap_height) == 0;
+
+      bs_bitmap_free(&fast);
+      bs_bitmap_free(&shaped);
+    }
+
+    ctx.bs_rendering_flags = 0;
+
+    test_case("Rendering without shaping looks the same", unshaped_same);
+
+    // glyphs are counted by the spans traced while rasterizing them
+    int full_glyphs = -1;
+    if(bs_trace_start(1024)) {
+      bs_bitmap_t traced = bs_render_utf8_string(&ctx, text, strlen(text));
+      full_glyphs = traced_spans("rasterize");
+      bs_bitmap_free(&traced);
+      bs_trace_stop();
+    }
+
+    // the left half of the text, as if it was shown on a small display
+    ctx.bs_clip_width = first.bs_bitmap_width / 2;
+    ctx.bs_clip_height = first.bs_bitmap_height - 1;
+
+    bs_bitmap_t cropped = bs_bitmap_new(ctx.bs_clip_width, ctx.bs_clip_height, 0);
+    bs_bitmap_copy(cropped, 0, 0, first);
+
+    int clipped_glyphs = -1;
+    bool traced = bs_trace_start(1024);
+    bs_bitmap_t clipped = bs_render_utf8_string(&ctx, text, strlen(text));
+
+    if(traced) {
+      clipped_glyphs = traced_spans("rasterize");
+      bs_trace_stop();
+    }
+
+    test_case("Clipped rendering matches a cropped render",
+      clipped.bs_bitmap != NULL &&
+      clipped.bs_bitmap_width == cropped.bs_bitmap_width &&
+      clipped.bs_bitmap_height == cropped.bs_bitmap_height &&
+      memcmp(clipped.bs_bitmap, cropped.bs_bitmap,
+        (size_t) cropped.bs_bitmap_width * cropped.bs_bitmap_height) == 0);
+
+    test_case("Glyphs outside of the clip are not rasterized",
+      clipped_glyphs > 0 && full_glyphs > clipped_glyphs);
+
+    ctx.bs_clip_width = 0;
+    ctx.bs_clip_height = 0;
+
+    // at the start, in the middle and at the end of the text
+    test_case("Retained text handles inserts",
+      retained_update_matches(&ctx, "Hello World", ">Hello World") &&
+      retained_update_matches(&ctx, "Hello World", "Hello, World") &&
+      retained_update_matches(&ctx, "Hello World", "Hello World!"));
+
+    test_case("Retained text handles deletes",
+      retained_update_matches(&ctx, "Hello World", "ello World") &&
+      retained_update_matches(&ctx, "Hello World", "Helo World") &&
+      retained_update_matches(&ctx, "Hello World", "Hello Worl") &&
+      retained_update_matches(&ctx, "Hello World", ""));
+
+    test_case("Retained text handles replacements",
+      retained_update_matches(&ctx, "Hello World", "Jello World") &&
+      retained_update_matches(&ctx, "Hello World", "Hello Wxrld") &&
+      retained_update_matches(&ctx, "Hello World", "Hello Worle") &&
+      retained_update_matches(&ctx, "Hello World", text));
+
+    bs_retained_text_t unchanged;
+    bs_rect_t unchanged_dirty;
+    bs_retained_text_init(&unchanged);
+
+    bool unchanged_ok =
+      bs_retained_text_update(&ctx, &unchanged, text, strlen(text), &unchanged_dirty);
+    unsigned char *unchanged_pixels = unchanged.bs_retained_bitmap.bs_bitmap;
+
+    unchanged_ok = unchanged_ok &&
+      bs_retained_text_update(&ctx, &unchanged, text, strlen(text), &unchanged_dirty);
+
+    test_case("Unchanged retained text has nothing dirty", unchanged_ok &&
+      unchanged_dirty.bs_rect_width == 0 && unchanged_dirty.bs_rect_height == 0 &&
+      unchanged.bs_retained_bitmap.bs_bitmap == unchanged_pixels &&
+      retained_update_matches(&ctx, "Hello World", "Hello World"));
+
+    bs_retained_text_free(&unchanged);
+
+    bs_bitmap_free(&clipped);
+    bs_bitmap_free(&cropped);
+    bs_bitmap_free(&again);
+    bs_bitmap_free(&first);
+    bs_utf32_buffer_free(&str);
+  }
+
+  bs_context_free(&ctx);
+
+  unsigned char into_pixels[32 * 16];
+  bs_bitmap_t into = { into_pixels, 32, 16 };
+
+#ifdef BS_STATIC_MEMORY
+  static char long_text[BS_STATIC_SCRATCH_SIZE];
+  bs_context_init_allocator(&ctx, counting);
+#else
+  // what bs_context_init() does in the static memory profile
+  static uint64_t scratch[1024];
+  static char long_text[sizeof(scratch)];
+  bs_context_init_scratch(&ctx, counting, scratch, sizeof(scratch));
+#endif
+
+  memset(into_pixels, 0xff, sizeof(into_pixels));
+  memset(long_text, 'a', sizeof(long_text));
+
+  // adding a font allocates, rendering with it afterwards mustn't
+  if(font != NULL && bs_add_font(&ctx, font, 0, 16)) {
+    allocations = 0;
+    size_t heap_calls_before = heap_calls;
+
+    bool rendered = bs_render_utf8_into(&ctx, "Hello", 5, into);
+    size_t set = 0;
+
+    for(size_t i = 0; i < sizeof(into_pixels); i++) {
+      set += into_pixels[i] != 0;
+    }
+
+    // the text is drawn onto a cleared bitmap
+    test_case("No heap allocations after startup", allocations == 0 &&
+      heap_calls == heap_calls_before && rendered && set > 0 && set < sizeof(into_pixels));
+  }
+
+  allocations = 0;
+  size_t heap_calls_before = heap_calls;
+
+  errno = 0;
+  bool overflowed = !bs_render_utf8_into(&ctx, long_text, sizeof(long_text), into) &&
+    errno == ENOMEM;
+  bool cleared = true;
+
+  for(size_t i = 0; i < sizeof(into_pixels); i++) {
+    cleared = cleared && into_pixels[i] == 0;
+  }
+
+  test_case("Running out of scratch memory fails with ENOMEM",
+    allocations == 0 && heap_calls == heap_calls_before && cleared && overflowed);
+
+  bs_context_free(&ctx);
+
+  bs_bitmap_t pattern = bs_bitmap_new(10, 2, 0);
+  bs_bitmap_set(pattern, 0, 0, 1);
+  bs_bitmap_set(pattern, 9, 0, 1);
+  bs_bitmap_set(pattern, 8, 1, 1);
+
+  bs_view_t pattern_view = { pattern, 0, 0, 10, 2 };
+  uint8_t frame[8];
+  size_t frame_size = bs_view_bitarray_pack(pattern_view, frame, sizeof(frame), 0);
+
+  test_case("Rows are packed MSB first and padded",
+    frame_size == 4 && frame[0] == 0x80 && frame[1] == 0x40 &&
+    frame[2] == 0x00 && frame[3] == 0x80);
+
+  pattern_view.bs_view_offset_x = -4;
+  frame_size = bs_view_bitarray_pack(pattern_view, frame, sizeof(frame), 1);
+
+  test_case("Pixels outside of the bitmap are default",
+    frame_size == 4 && frame[0] == 0xf8 && frame[1] == 0x00 &&
+    frame[2] == 0xf0 && frame[3] == 0x00);
+
+  test_case("Packing fails for small buffers",
+    bs_view_bitarray_pack(pattern_view, frame, 3, 0) == 0);
+
+  bs_bitmap_t unpacked = bs_bitmap_new(10, 2, 0);
+  pattern_view.bs_view_offset_x = 0;
+  frame_size = bs_view_bitarray_pack(pattern_view, frame, sizeof(frame), 0);
+
+  test_case("Unpacking reverses packing",
+    bs_bitarray_unpack(unpacked, frame, frame_size) &&
+    memcmp(unpacked.bs_bitmap, pattern.bs_bitmap, 10 * 2) == 0);
+
+  test_case("Frames of the wrong size are not unpacked",
+    !bs_bitarray_unpack(unpacked, frame, frame_size + 1));
+
+  bs_bitmap_free(&unpacked);
+
+  int export_pipe[2];
+
+  if(pipe(export_pipe) == 0) {
+    char exported[64];
+    ssize_t exported_len;
+    static const char pbm[] = "P4\n10 2\n\x7f\x80\xff\x40";
+    static const char half_blocks[] = "▀       ▄▀\n";
+
+    bool pbm_written = bs_bitmap_export(export_pipe[1], pattern, true,
+      BS_EXPORT_PBM, NULL);
+    exported_len = read(export_pipe[0], exported, sizeof(exported));
+
+    test_case("PBM export has set pixels white",
+      pbm_written && exported_len == sizeof(pbm) - 1 &&
+      memcmp(exported, pbm, sizeof(pbm) - 1) == 0);
+
+    bool half_blocks_written = bs_bitmap_export(export_pipe[1], pattern, true,
+      BS_EXPORT_HALF_BLOCKS, NULL);
+    exported_len = read(export_pipe[0], exported, sizeof(exported));
+
+    test_case("Half block export combines two rows",
+      half_blocks_written && exported_len == sizeof(half_blocks) - 1 &&
+      memcmp(exported, half_blocks, sizeof(half_blocks) - 1) == 0);
+
+    close(export_pipe[0]);
+    close(export_pipe[1]);
+  }
+
+  bs_bitmap_free(&pattern);
+
+  bs_bitmap_t module = bs_bitmap_new(3, 10, 0);
+  bs_bitmap_set(module, 0, 0, 1);
+  bs_bitmap_set(module, 1, 9, 1);
+  bs_bitmap_set(module, 2, 7, 1);
+
+  uint8_t header[1] = { 0xaa };
+  bs_frame_format_t bands = {
+    BS_SCAN_COLUMNS, BS_BIT_ORDER_LSB_FIRST, 1, 8, header, sizeof(header)
+  };
+  bs_view_t module_view = { module, 0, 0, 3, 10 };
+  frame_size = bs_view_pack(module_view, &bands, frame, sizeof(frame), 0);
+
+  test_case("Columns are packed LSB first in bands",
+    frame_size == 7 && bs_frame_format_size(&bands, 3, 10) == 7 &&
+    frame[0] == 0xaa && frame[1] == 0x01 && frame[2] == 0x00 &&
+    frame[3] == 0x80 && frame[4] == 0x00 && frame[5] == 0x02 &&
+    frame[6] == 0x00);
+
+  bs_bitmap_free(&module);
+
+  bs_bitmap_t gray = bs_bitmap_new(5, 1, 0);
+  unsigned char gray_pixels[5] = { 255, 128, 64, 0, 255 };
+  memcpy(gray.bs_bitmap, gray_pixels, sizeof(gray_pixels));
+
+  bs_frame_format_t two_bit = bs_frame_format_flipdot();
+  two_bit.bs_format_depth = 2;
+  bs_view_t gray_view = { gray, 0, 0, 5, 1 };
+  frame_size = bs_view_pack(gray_view, &two_bit, frame, sizeof(frame), 0);
+
+  test_case("Grayscale is reduced to 2 bits per pixel",
+    frame_size == 2 && frame[0] == 0xe4 && frame[1] == 0xc0);
+
+  bs_bitmap_free(&gray);
+
+  // views reaching past every edge, packed once clipped by the packers
+  // and once from a copy of the visible part already filled with def
+  bs_bitmap_t shades = bs_bitmap_new(11, 9, 0);
+  for(int i = 0; i < 11 * 9; i++) {
+    shades.bs_bitmap[i] = (unsigned char) (i * 37 + i / 5);
+  }
+
+  const int clip_offsets[][2] = { { 0, 0 }, { -3, -2 }, { 5, 4 }, { -13, 1 }, { 2, 10 } };
+  bool clipped_packing_matches = true;
+
+  for(int f = 0; f < 2 * 2 * 3; f++) {
+    bs_frame_format_t clip_format = {
+      f / 6 == 0 ? BS_SCAN_ROWS : BS_SCAN_COLUMNS,
+      f / 3 % 2 == 0 ? BS_BIT_ORDER_MSB_FIRST : BS_BIT_ORDER_LSB_FIRST,
+      1 << (f % 3), 0, NULL, 0
+    };
+
+    for(size_t k = 0; k < sizeof(clip_offsets) / sizeof(clip_offsets[0]); k++) {
+      int ox = clip_offsets[k][0];
+      int oy = clip_offsets[k][1];
+      bs_bitmap_t cropped = bs_bitmap_new(10, 7, 200);
+      bs_bitmap_copy(cropped, -ox, -oy, shades);
+
+      bs_view_t clipped_view = { shades, ox, oy, 10, 7 };
+      bs_view_t cropped_view = { cropped, 0, 0, 10, 7 };
+      uint8_t clipped[64];
+      uint8_t expected[64];
+      size_t clipped_size = bs_view_pack(clipped_view, &clip_format,
+        clipped, sizeof(clipped), 200);
+
+      clipped_packing_matches = clipped_packing_matches && clipped_size > 0 &&
+        bs_view_pack(cropped_view, &clip_format, expected, sizeof(expected), 0)
+          == clipped_size &&
+        memcmp(clipped, expected, clipped_size) == 0;
+
+      bs_bitmap_free(&cropped);
+    }
+  }
+
+  test_case("Clipped views pack like cropped bitmaps", clipped_packing_matches);
+
+  bs_frame_format_t banded_rows = bs_frame_format_flipdot();
+  banded_rows.bs_format_band_height = 8;
+
+  test_case("Formats are compared by their fields",
+    bs_frame_format_is_bitarray(&banded_rows) &&
+    !bs_frame_format_is_bitarray(&bands) && !bs_frame_format_is_bitarray(&two_bit));
+
+  bs_bitmap_free(&shades);
+
+  // the same glyph twice, the second one partially outside of the list
+  bs_bitmap_t glyph = bs_bitmap_new(3, 2, 0);
+  bs_bitmap_set(glyph, 0, 0, 1);
+  bs_bitmap_set(glyph, 2, 1, 1);
+
+  bs_placement_t placements[2] = { { 0, 1, 0 }, { 0, 5, 1 } };
+  bs_display_list_t list = {
+    &glyph, 1, 1, NULL, NULL, 0, placements, 2, 2, 7, 3, 3
+  };
+
+  bs_bitmap_t composed = bs_bitmap_new(7, 3, 0);
+  bs_bitmap_copy(composed, 1, 0, glyph);
+  bs_bitmap_copy(composed, 5, 1, glyph);
+
+  uint8_t listed[16];
+  uint8_t blitted[16];
+  bs_bitmap_t empty = { NULL, 0, 0 };
+  bs_view_t list_view = { empty, -2, 0, 8, 3 };
+  bs_view_t composed_view = { composed, -2, 0, 8, 3 };
+
+  frame_size = bs_display_list_pack(&list, list_view, &bands, listed, sizeof(listed), 0);
+
+  test_case("Display lists composite like blitted bitmaps",
+    frame_size > 0 &&
+    bs_view_pack(composed_view, &bands, blitted, sizeof(blitted), 0) == frame_size &&
+    memcmp(blitted, listed, frame_size) == 0);
+
+  bs_bitmap_free(&composed);
+  bs_bitmap_free(&glyph);
+
+  bs_bitmap_t noise = bs_bitmap_new(37, 5, 0);
+  for(int i = 0; i < 37 * 5; i++) {
+    noise.bs_bitmap[i] = (i * 7 + i / 3) % 5 < 2;
+  }
+
+  bool scroll_frames_match = true;
+
+  for(int step = 1; step <= 11; step += 5) {
+    bs_view_t scroll_view = { noise, -13, 0, 13, 5 };
+    bs_frames_t scroll = bs_scroll_frames(scroll_view, step, 0);
+    size_t count = 0;
+    bool finished = false;
+
+    scroll_frames_match = scroll_frames_match && scroll.bs_frames_count > 0;
+
+    while(!finished && count < scroll.bs_frames_count) {
+      uint8_t expected[10];
+      bs_view_bitarray_pack(scroll_view, expected, sizeof(expected), 0);
+
+      scroll_frames_match = scroll_frames_match && memcmp(expected,
+        scroll.bs_frames + count * scroll.bs_frame_size, scroll.bs_frame_size) == 0;
+
+      finished = bs_scroll_next_view(&scroll_view, step, BS_DIMENSION_X);
+      count++;
+    }
+
+    scroll_frames_match = scroll_frames_match && finished &&
+      count == scroll.bs_frames_count;
+
+    bs_frames_free(&scroll);
+  }
+
+  test_case("Incremental scroll frames match packed views", scroll_frames_match);
+
+  // panels of a wall at different offsets, moving by a page or more too
+  const int shift_steps[] = { 1, 3, 8, 13, 20, -2 };
+  bool shifted_frames_match = true;
+
+  for(size_t k = 0; k < sizeof(shift_steps) / sizeof(shift_steps[0]); k++) {
+    for(int panel = 0; panel < 2; panel++) {
+      bs_view_t shift_view = { noise, panel == 0 ? -13 : 0, panel - 1, 13, 5 };
+      bs_frames_t shifted = bs_shift_frames(shift_view, shift_steps[k], 12, 1);
+      uint8_t moving[10];
+
+      shifted_frames_match = shifted_frames_match && shifted.bs_frames_count == 12 &&
+        shifted.bs_frame_size == bs_view_bitarray_size(shift_view);
+
+      for(size_t i = 0; shifted_frames_match && i < shifted.bs_frames_count; i++) {
+        uint8_t expected[10];
+        bs_view_bitarray_pack(shift_view, expected, sizeof(expected), 1);
+
+        shifted_frames_match = memcmp(expected,
+          shifted.bs_frames + i * shifted.bs_frame_size, shifted.bs_frame_size) == 0;
+
+        // the same, one frame at a time
+        if(i == 0) {
+          memcpy(moving, expected, shifted.bs_frame_size);
+        } else {
+          shifted_frames_match = shifted_frames_match &&
+            memcmp(moving, expected, shifted.bs_frame_size) == 0;
+        }
+
+        bs_view_t moved = shift_view;
+        bs_view_shift_frame(&moved, shift_steps[k], moving, sizeof(moving), 1);
+        shift_view.bs_view_offset_x += shift_steps[k];
+
+        shifted_frames_match = shifted_frames_match &&
+          moved.bs_view_offset_x == shift_view.bs_view_offset_x;
+      }
+
+      bs_frames_free(&shifted);
+    }
+  }
+
+  test_case("Shifted frames match packed views", shifted_frames_match);
+
+  // pages through the rows by the height of the view, not its width
+  bs_bitmap_t tall = bs_bitmap_new(8, 10, 0);
+  bs_view_t tall_view = { tall, 0, 0, 8, 4 };
+
+  bool paged = !bs_page_next_view(&tall_view, 1, BS_DIMENSION_Y) &&
+    tall_view.bs_view_offset_y == 4 &&
+    !bs_page_next_view(&tall_view, 1, BS_DIMENSION_Y) &&
+    tall_view.bs_view_offset_y == 8 &&
+    bs_page_next_view(&tall_view, 1, BS_DIMENSION_Y) &&
+    tall_view.bs_view_offset_y == 0;
+
+  test_case("Paging vertically moves by the view's height", paged);
+
+  bs_bitmap_free(&tall);
+
+  // a b-c<LF>d (e) -1
+  bs_utf32_buffer_t breakable = bs_decode_utf8("a b-c\nd (e) -1", 14);
+  const enum bs_line_break expected_breaks[] = {
+    BS_BREAK_NONE, BS_BREAK_NONE, BS_BREAK_ALLOWED, BS_BREAK_NONE,
+    BS_BREAK_ALLOWED, BS_BREAK_NONE, BS_BREAK_MANDATORY, BS_BREAK_NONE,
+    BS_BREAK_ALLOWED, BS_BREAK_NONE, BS_BREAK_NONE, BS_BREAK_NONE,
+    BS_BREAK_ALLOWED, BS_BREAK_NONE, BS_BREAK_MANDATORY,
+  };
+  bool breaks_ok = breakable.bs_utf32_buffer_len == 14;
+
+  for(size_t i = 0; breaks_ok && i <= 14; i++) {
+    breaks_ok = bs_utf32_line_break(breakable, i) == expected_breaks[i];
+  }
+
+  test_case("Lines break after spaces and hyphens only", breaks_ok);
+
+  bs_utf32_buffer_free(&breakable);
+
+  bs_paragraph_t paragraph;
+  bs_paragraph_init(&paragraph);
+
+  test_case("Spaces hang off the end of lines",
+    wrap_synthetic(&paragraph, "ab   cd", 3) &&
+    strcmp(wrapped_lines(&paragraph), "ab|cd") == 0 &&
+    paragraph.bs_paragraph_lines[0].bs_line_width == 2 &&
+    wrap_synthetic(&paragraph, "ab ", 2) &&
+    strcmp(wrapped_lines(&paragraph), "ab") == 0);
+
+  test_case("Words wider than the paragraph are broken anywhere",
+    wrap_synthetic(&paragraph, "abcdefg", 3) &&
+    strcmp(wrapped_lines(&paragraph), "abc|def|g") == 0 &&
+    wrap_synthetic(&paragraph, "ab cdefgh", 3) &&
+    strcmp(wrapped_lines(&paragraph), "ab|cde|fgh") == 0 &&
+    paragraph.bs_paragraph_graphemes[5].bs_layout_x == 2);
+
+  test_case("Lines always end at newlines",
+    wrap_synthetic(&paragraph, "ab\ncd", 10) &&
+    strcmp(wrapped_lines(&paragraph), "ab|cd") == 0 &&
+    wrap_synthetic(&paragraph, "ab\n\ncd\n", 10) &&
+    strcmp(wrapped_lines(&paragraph), "ab||cd") == 0);
+
+  // wrapping again places every grapheme from scratch
+  bool rewrapped = wrap_synthetic(&paragraph, "ab cd ef", 2) &&
+    strcmp(wrapped_lines(&paragraph), "ab|cd|ef") == 0 &&
+    bs_paragraph_wrap(&paragraph, 5) &&
+    strcmp(wrapped_lines(&paragraph), "ab cd|ef") == 0 &&
+    paragraph.bs_paragraph_lines[0].bs_line_width == 5 &&
+    bs_paragraph_wrap(&paragraph, 10) &&
+    strcmp(wrapped_lines(&paragraph), "ab cd ef") == 0 &&
+    paragraph.bs_paragraph_graphemes[6].bs_layout_x == 6 &&
+    paragraph.bs_paragraph_lines[0].bs_line_width == 8;
+
+  test_case("Paragraphs can be wrapped again at another width", rewrapped);
+
+  bs_paragraph_free(&paragraph);
+
+  bs_scheduler_t scheduler;
+  bs_scheduler_init(&scheduler);
+
+  int fast_left = 10;
+  int slow_left = 3;
+  bool scheduled = bs_scheduler_add(&scheduler, 1000000, countdown_tick, &fast_left)
+    && bs_scheduler_add(&scheduler, 4000000, countdown_tick, &slow_left);
+
+  uint64_t run_start = bs_clock_now();
+  bool ran = scheduled && bs_scheduler_run(&scheduler);
+  uint64_t run_time = bs_clock_now() - run_start;
+
+  test_case("Scheduler runs all tasks to completion", ran &&
+    fast_left == 0 && slow_left == 0 &&
+    scheduler.bs_scheduler_tasks[0].bs_task_stats.bs_stats_frames == 10 &&
+    scheduler.bs_scheduler_tasks[1].bs_task_stats.bs_stats_frames == 3);
+  test_case("Scheduler keeps to its deadlines", run_time >= 9000000);
+
+  bs_scheduler_free(&scheduler);
+
+  int stop_left = 3;
+  bs_scheduler_init(&scheduler);
+  scheduler.bs_scheduler_stop = &stop_requested;
+
+  test_case("Scheduler stops once the stop flag is set",
+    bs_scheduler_add(&scheduler, 1000000, stopping_tick, &stop_left) &&
+    bs_scheduler_run(&scheduler) && stop_left == 0 &&
+    !scheduler.bs_scheduler_tasks[0].bs_task_finished);
+
+  bs_scheduler_free(&scheduler);
+
+  bs_bitmap_free(&noise);
+
+  int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in receiver_addr;
+  socklen_t receiver_addrlen = sizeof(receiver_addr);
+  memset(&receiver_addr, 0, sizeof(receiver_addr));
+  receiver_addr.sin_family = AF_INET;
+  receiver_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if(receiver >= 0 &&
+      bind(receiver, (struct sockaddr *) &receiver_addr, receiver_addrlen) == 0 &&
+      getsockname(receiver, (struct sockaddr *) &receiver_addr, &receiver_addrlen) == 0) {
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    uint8_t frames[3][2] = { { 1, 2 }, { 3, 4 }, { 5, 6 } };
+    bs_flipdot_frame_t batch[3];
+
+    for(int i = 0; i < 3; i++) {
+      batch[i].bs_frame_data = frames[i];
+      batch[i].bs_frame_size = sizeof(frames[i]);
+      batch[i].bs_frame_addr = (struct sockaddr *) &receiver_addr;
+      batch[i].bs_frame_addrlen = receiver_addrlen;
+    }
+
+    test_case("Batch of frames is sent",
+      bs_flipdot_send_frames(sender, batch, 3) == 3);
+
+    bool received = true;
+    for(int i = 0; i < 3; i++) {
+      uint8_t buf[4];
+      received = received && recv(receiver, buf, sizeof(buf), MSG_DONTWAIT) == 2
+        && buf[0] == frames[i][0] && buf[1] == frames[i][1];
+    }
+
+    test_case("Batch of frames is received in order", received);
+
+    close(sender);
+  }
+
+  if(receiver >= 0) {
+    close(receiver);
+  }
+
+  bs_frame_filter_t filter;
+  bs_frame_filter_init(&filter);
+  uint8_t frame_a[2] = { 0xf0, 0x0f };
+  uint8_t frame_b[2] = { 0xf0, 0x0e };
+
+  bool filtered = bs_frame_filter_check(&filter, frame_a, 2, 0, 0)
+    && !bs_frame_filter_check(&filter, frame_a, 2, 1, 0)
+    && bs_frame_filter_check(&filter, frame_b, 2, 2, 0)
+    && !bs_frame_filter_check(&filter, frame_b, 2, 3, 10)
+    && bs_frame_filter_check(&filter, frame_b, 2, 12, 10);
+
+  test_case("Unchanged frames are skipped until keep-alive",
+    filtered && filter.bs_filter_sent == 3 && filter.bs_filter_skipped == 2);
+
+  // 16x2 frame, everything has to flip
+  uint8_t shown[4] = { 0x00, 0x00, 0x00, 0x00 };
+  uint8_t target[4] = { 0xff, 0xff, 0xff, 0xff };
+
+  size_t first = bs_frame_flip_step(shown, target, 4, 2, 12, BS_FLIP_ORDER_ROWS);
+  test_case("Flip step stays within budget",
+    first == 12 && shown[0] == 0xff && shown[1] == 0xf0 && shown[2] == 0x00
+    && bs_frame_flip_count(shown, target, 4) == 20);
+
+  memset(shown, 0, sizeof(shown));
+  bs_frame_flip_step(shown, target, 4, 2, 16, BS_FLIP_ORDER_CHECKERBOARD);
+  test_case("Checkerboard flips every other dot first",
+    shown[0] == 0xaa && shown[1] == 0xaa && shown[2] == 0x55 && shown[3] == 0x55);
+
+  size_t rest = bs_frame_flip_step(shown, target, 4, 2, 0, BS_FLIP_ORDER_CHECKERBOARD);
+  test_case("Flip steps converge to the target",
+    rest == 16 && memcmp(shown, target, sizeof(target)) == 0);
+
+  // the same 16x2 checkerboard, but packed in columns of LSB first bytes
+  bs_frame_format_t column_format = {
+    BS_SCAN_COLUMNS, BS_BIT_ORDER_LSB_FIRST, 1, 0, NULL, 0
+  };
+  uint8_t board[16];
+  uint8_t column_shown[16] = { 0 };
+  uint8_t column_target[16];
+  memset(column_target, 0x03, sizeof(column_target));
+
+  bool board_ok = bs_frame_checkerboard(&column_format, 16, 2, board, sizeof(board)) == 16;
+
+  for(int x = 0; board_ok && x < 16; x++) {
+    board_ok = board[x] == (x % 2 == 0 ? 0x01 : 0x02);
+  }
+
+  size_t column_flips = bs_frame_flip_step_masked(column_shown, column_target, board,
+    sizeof(board), 16);
+
+  test_case("Checkerboards follow the frame format",
+    board_ok && column_flips == 16 && memcmp(column_shown, board, sizeof(board)) == 0);
+
+  // 16x2 frames again, from all black to all white
+  uint8_t black[4] = { 0x00, 0x00, 0x00, 0x00 };
+  uint8_t between[4];
+
+  bool wiped = bs_frame_transition(BS_TRANSITION_WIPE, 3, 8, NULL, 16, 2,
+    black, target, between);
+  test_case("Wipe reveals the new frame from the left",
+    wiped && between[0] == 0xfc && between[1] == 0x00 &&
+    between[2] == 0xfc && between[3] == 0x00);
+
+  bool transitions_end = true;
+
+  for(int t = BS_TRANSITION_WIPE; t <= BS_TRANSITION_BLINDS; t++) {
+    transitions_end = transitions_end &&
+      bs_frame_transition(t, 0, 5, NULL, 16, 2, black, target, between) &&
+      memcmp(between, black, sizeof(black)) == 0 &&
+      bs_frame_transition(t, 5, 5, NULL, 16, 2, black, target, between) &&
+      memcmp(between, target, sizeof(target)) == 0;
+  }
+
+  test_case("Transitions start and end with the given frames", transitions_end);
+
+  bs_context_t layout_ctx;
+  bs_context_init(&layout_ctx);
+
+  bs_layout_t layout;
+  bs_layout_init(&layout, 16, 1, 0);
+
+  bs_rect_t label_rect = { 0, 0, 8, 1 };
+  bs_rect_t scroll_rect = { 8, 0, 8, 1 };
+  int label = bs_layout_add_region(&layout, &layout_ctx, label_rect,
+    BS_REGION_STATIC, 0, 0);
+  int scroller = bs_layout_add_region(&layout, &layout_ctx, scroll_rect,
+    BS_REGION_SCROLL, 1, 10);
+
+  uint8_t layout_frame[2] = { 0xaa, 0xaa };
+  size_t layout_size = bs_layout_pack(&layout, layout_frame, sizeof(layout_frame));
+  bool packed_once = label == 0 && scroller == 1 && layout_size == 2 &&
+    layout_frame[0] == 0x00 && layout_frame[1] == 0x00;
+
+  // a region which is packed again overwrites this, a static one doesn't
+  memset(layout_frame, 0xff, sizeof(layout_frame));
+
+  bool ticked = !bs_layout_tick(&layout, 1) && bs_layout_tick(&layout, 11);
+  bs_layout_pack(&layout, layout_frame, sizeof(layout_frame));
+
+  test_case("Layouts only pack regions that changed",
+    packed_once && ticked && layout_frame[0] == 0xff && layout_frame[1] == 0x00);
+
+  bs_layout_free(&layout);
+
+  // regions that neither start nor end on a byte boundary
+  bs_layout_init(&layout, 24, 2, 0);
+
+  bs_rect_t wide_rect = { 3, 0, 13, 2 };
+  bs_rect_t narrow_rect = { 18, 1, 4, 1 };
+  bool unaligned_added =
+    bs_layout_add_region(&layout, &layout_ctx, wide_rect, BS_REGION_SCROLL, 1, 10) == 0 &&
+    bs_layout_add_region(&layout, &layout_ctx, narrow_rect, BS_REGION_SCROLL, 1, 10) == 1;
+
+  uint8_t unaligned_frame[6];
+  bs_layout_pack(&layout, unaligned_frame, sizeof(unaligned_frame));
+  memset(unaligned_frame, 0xff, sizeof(unaligned_frame));
+
+  bs_layout_tick(&layout, 1);
+  bs_layout_tick(&layout, 11);
+  bs_layout_pack(&layout, unaligned_frame, sizeof(unaligned_frame));
+
+  const uint8_t unaligned_expected[6] = { 0xe0, 0x00, 0xff, 0xe0, 0x00, 0xc3 };
+
+  test_case("Layouts pack unaligned regions without touching their neighbours",
+    unaligned_added &&
+    memcmp(unaligned_frame, unaligned_expected, sizeof(unaligned_expected)) == 0);
+
+  bs_layout_free(&layout);
+  bs_context_free(&layout_ctx);
+
+  // three spans of which the middle one is empty
+  bs_bitmap_t sparse = bs_bitmap_new(20, 3, 0);
+
+  for(int y = 0; y < 3; y++) {
+    sparse.bs_bitmap[y * 20 + y + 2] = 1;
+    sparse.bs_bitmap[y * 20 + 19 - y] = 1;
+  }
+
+  bs_compact_bitmap_t compact;
+  bool compact_ok = bs_compact_bitmap_encode(sparse, &compact) &&
+    compact.bs_compact_spans_len == 2;
+
+  for(int x = -9; compact_ok && x < 22; x += 3) {
+    for(unsigned char def = 0; compact_ok && def < 2; def++) {
+      uint8_t expected[8];
+      uint8_t actual[8];
+      bs_view_t sparse_view = { sparse, x, -1, 13, 4 };
+      bs_rect_t sparse_rect = { x, -1, 13, 4 };
+
+      size_t expected_size = bs_view_bitarray_pack(sparse_view, expected, sizeof(expected), def);
+      compact_ok = expected_size > 0 &&
+        bs_compact_view_pack(&compact, sparse_rect, actual, sizeof(actual), def) == expected_size &&
+        memcmp(expected, actual, expected_size) == 0;
+    }
+  }
+
+  test_case("Compact bitmaps pack like the original", compact_ok);
+
+  // views entirely above and below the bitmap only contain the default
+  bool compact_outside_ok = true;
+  int outside_ys[] = { -10, -4, 3, 10 };
+
+  for(size_t k = 0; compact_outside_ok && k < sizeof(outside_ys) / sizeof(int); k++) {
+    for(unsigned char def = 0; compact_outside_ok && def < 2; def++) {
+      uint8_t expected[8];
+      uint8_t actual[8];
+      bs_view_t outside_view = { sparse, 2, outside_ys[k], 13, 4 };
+      bs_rect_t outside_rect = { 2, outside_ys[k], 13, 4 };
+
+      size_t expected_size = bs_view_bitarray_pack(outside_view, expected, sizeof(expected), def);
+      compact_outside_ok = expected_size == sizeof(actual) &&
+        bs_compact_view_pack(&compact, outside_rect, actual, sizeof(actual), def) == expected_size &&
+        memcmp(expected, actual, expected_size) == 0;
+    }
+  }
+
+  test_case("Compact views outside of the bitmap pack the default", compact_outside_ok);
+
+  bs_compact_bitmap_free(&compact);
+  bs_bitmap_free(&sparse);
+
+  // the middle tile is blank and must not be allocated
+  int wide_width = 2 * BS_TILE_WIDTH + 20;
+  bs_bitmap_t wide = bs_bitmap_new(wide_width, 3, 0);
+
+  for(int y = 0; y < 3; y++) {
+    wide.bs_bitmap[y * wide_width + BS_TILE_WIDTH - 1 - y] = 1;
+    wide.bs_bitmap[y * wide_width + 2 * BS_TILE_WIDTH + y] = 1;
+  }
+
+  bs_tiled_bitmap_t tiled;
+  bs_tiled_bitmap_init(&tiled, 0);
+
+  bool tiled_ok = bs_tiled_bitmap_extend(&tiled, wide_width, 3) &&
+    bs_tiled_bitmap_copy(&tiled, 0, 0, wide) && tiled.bs_tiled_tiles[1] == NULL;
+
+  for(int x = -7; tiled_ok && x < wide_width; x += 11) {
+    uint8_t expected[12];
+    uint8_t actual[12];
+    bs_view_t wide_view = { wide, x, -1, 20, 4 };
+
+    size_t expected_size = bs_view_bitarray_pack(wide_view, expected, sizeof(expected), 1);
+    tiled_ok = expected_size > 0 &&
+      bs_tiled_view_pack(&tiled, x, -1, 20, 4, actual, sizeof(actual), 1) == expected_size &&
+      memcmp(expected, actual, expected_size) == 0;
+  }
+
+  errno = 0;
+  tiled_ok = tiled_ok && !bs_tiled_bitmap_extend(&tiled, SIZE_MAX, 3) && errno == EOVERFLOW;
+
+  test_case("Tiled bitmaps pack like the original", tiled_ok);
+
+  bs_tiled_bitmap_free(&tiled);
+  bs_bitmap_free(&wide);
+
+  // indices have to keep working after wrapping around the slots
+  bs_ring_t ring;
+  bool ring_ok = bs_ring_init(&ring, 4, sizeof(int));
+
+  for(int i = 0; ring_ok && i < 10; i++) {
+    int *slot = bs_ring_write_begin(&ring);
+    ring_ok = slot != NULL;
+
+    if(ring_ok) {
+      *slot = i;
+      bs_ring_write_commit(&ring);
+
+      const int *read = bs_ring_read_begin(&ring);
+      ring_ok = read != NULL && *read == i;
+      bs_ring_read_commit(&ring);
+    }
+  }
+
+  for(int i = 0; ring_ok && i < 4; i++) {
+    if((ring_ok = bs_ring_write_begin(&ring) != NULL)) {
+      bs_ring_write_commit(&ring);
+    }
+  }
+
+  test_case("Ring buffer wraps around and reports full",
+    ring_ok && bs_ring_write_begin(&ring) == NULL);
+
+  bs_ring_free(&ring);
+
+  // a small ring, so both sides keep running into each other
+  pthread_t producer;
+  bool ordered = bs_ring_init(&ring, 8, sizeof(size_t))
+    && pthread_create(&producer, NULL, ring_producer, &ring) == 0;
+
+  if(ordered) {
+    for(size_t i = 0; i < RING_ITEMS; i++) {
+      const size_t *slot;
+
+      while((slot = bs_ring_read_begin(&ring)) == NULL) {
+        sched_yield();
+      }
+
+      ordered = ordered && *slot == i;
+      bs_ring_read_commit(&ring);
+    }
+
+    pthread_join(producer, NULL);
+  }
+
+  test_case("Ring buffer passes items between threads in order",
+    ordered && bs_ring_read_begin(&ring) == NULL);
+
+  bs_ring_free(&ring);
+
+  char shm_name[32];
+  snprintf(shm_name, sizeof(shm_name), "/bs-test-%ld", (long) getpid());
+
+  bs_shm_ring_t shm_writer;
+  bs_shm_ring_t shm_reader;
+
+  if(bs_shm_ring_create(&shm_writer, shm_name, 4, 8)) {
+    uint8_t shm_frame[8] = { 0 };
+    bs_shm_frame_t shared;
+    bool shm_ok = bs_shm_ring_open(&shm_reader, shm_name) &&
+      !bs_shm_ring_next(&shm_reader, &shared);
+
+    for(uint8_t i = 0; shm_ok && i < 3; i++) {
+      shm_frame[0] = i;
+      shm_ok = bs_shm_ring_publish(&shm_writer, shm_frame, sizeof(shm_frame), i, 0) &&
+        bs_shm_ring_next(&shm_reader, &shared) &&
+        shared.bs_shm_frame_seq == i && shared.bs_shm_frame_tag == i &&
+        shared.bs_shm_frame_size == sizeof(shm_frame) &&
+        shared.bs_shm_frame_data[0] == i &&
+        bs_shm_ring_valid(&shm_reader, &shared);
+    }
+
+    test_case("Shared memory readers follow the writer", shm_ok);
+
+    // the reader falls behind by more than the ring's capacity
+    for(uint8_t i = 3; i < 9; i++) {
+      shm_frame[0] = i;
+      bs_shm_ring_publish(&shm_writer, shm_frame, sizeof(shm_frame), 0, 0);
+    }
+
+    test_case("Lagging readers skip overwritten frames",
+      shm_ok && bs_shm_ring_next(&shm_reader, &shared) &&
+      shared.bs_shm_frame_seq == 5 && shared.bs_shm_frame_data[0] == 5 &&
+      shm_reader.bs_shm_dropped == 2 &&
+      !bs_shm_ring_publish(&shm_writer, shm_frame, sizeof(shm_frame) + 1, 0, 0));
+
+    bs_shm_ring_close(&shm_reader);
+    bs_shm_ring_close(&shm_writer);
+  }
+
+  char stream_path[] = "/tmp/bs-test-XXXXXX";
+
+  uint8_t stream_header[2] = { 0xa5, 0x5a };
+  bs_stream_panel_t stream_panels[2] = {
+    { 0, 0, 8, 2, bs_frame_format_flipdot(), 0 },
+    { 8, 0, 8, 2, bs_frame_format_flipdot(), 0 },
+  };
+  stream_panels[1].bs_panel_format.bs_format_header = stream_header;
+  stream_panels[1].bs_panel_format.bs_format_header_size = sizeof(stream_header);
+
+  uint8_t left[2] = { 0x0f, 0xf0 };
+  uint8_t right[4] = { 0xa5, 0x5a, 0x01, 0x02 };
+  const uint8_t *record[2] = { left, right };
+
+  bs_stream_writer_t stream_writer;
+  uint64_t stream_hash = 0;
+  int stream_fd = mkstemp(stream_path);
+  bool stream_ok = stream_fd >= 0 &&
+    bs_stream_writer_open(&stream_writer, stream_fd, stream_panels, 2);
+
+  // the first frame is shown twice, so both end up in one record
+  for(int i = 0; stream_ok && i < 3; i++) {
+    stream_ok = bs_stream_writer_append(&stream_writer, record, 10);
+    right[3] = i == 1 ? 0x03 : right[3];
+  }
+
+  stream_ok = stream_ok && bs_stream_writer_finish(&stream_writer, &stream_hash);
+
+  bs_stream_t stream;
+  off_t stream_data_offset = 0;
+
+  if(stream_ok && bs_stream_open(&stream, stream_path)) {
+    test_case("Streams merge identical frames",
+      bs_stream_verify(&stream) && stream.bs_stream_hash == stream_hash &&
+      stream.bs_stream_records == 2 && stream.bs_stream_duration == 30 &&
+      bs_stream_frame_duration(&stream, 0) == 20 &&
+      memcmp(bs_stream_frame(&stream, 0, 0), left, sizeof(left)) == 0 &&
+      bs_stream_frame(&stream, 1, 1)[3] == 0x03 &&
+      stream.bs_stream_panels[1].bs_panel_x == 8 &&
+      stream.bs_stream_panels[1].bs_panel_frame_size == sizeof(right) &&
+      stream.bs_stream_panels[1].bs_panel_format.bs_format_header[0] == 0xa5);
+
+    stream_data_offset = stream.bs_stream_data - stream.bs_stream_map;
+    bs_stream_close(&stream);
+  } else {
+    test_case("Streams merge identical frames", false);
+  }
+
+  // a record that is never shown is rejected instead of being played forever
+  uint8_t no_duration[8] = { 0 };
+  bool zero_rejected = stream_ok && stream_data_offset > 0 &&
+    pwrite(stream_fd, no_duration, sizeof(no_duration), stream_data_offset)
+      == (ssize_t) sizeof(no_duration) &&
+    !bs_stream_open(&stream, stream_path) && errno == EINVAL;
+
+  test_case("Streams with zero duration records are rejected", zero_rejected);
+
+  if(stream_fd >= 0) {
+    close(stream_fd);
+  }
+
+  unlink(stream_path);
+
+  // a run without a font can't pass as a success
+  if(!test_result) {
+    return EXIT_FAILURE;
+  }
+
+  return font != NULL ? EXIT_SUCCESS : EXIT_SKIP;
 }
@@ -0,0 +1,317 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// A tiled bitmap is a row of tiles of BS_TILE_WIDTH columns, each of
+// which stores its pixels row by row like a bs_bitmap_t. Tiles are only
+// allocated once a pixel different from the initial value is written,
+// so growing the bitmap's width only grows the table of tile pointers.
+// All of a tile's columns are initialized, including the ones beyond
+// the bitmap's width, so extending the width never touches the tiles.
+
+static inline size_t tile_count(size_t width) {
+  return width / BS_TILE_WIDTH + (width % BS_TILE_WIDTH != 0);
+}
+
+static inline unsigned char *tile_pixel(const bs_tiled_bitmap_t *b, size_t x, size_t y) {
+  unsigned char *tile = b->bs_tiled_tiles[x / BS_TILE_WIDTH];
+
+  return tile == NULL ? NULL : tile + y * BS_TILE_WIDTH + x % BS_TILE_WIDTH;
+}
+
+// allocates tile t if necessary, returns NULL if that fails
+static unsigned char *tile_get(bs_tiled_bitmap_t *b, size_t t) {
+  if(b->bs_tiled_tiles[t] == NULL) {
+    // bs_tiled_bitmap_extend() made sure this doesn't overflow
+    size_t size = b->bs_tiled_height * BS_TILE_WIDTH;
+    unsigned char *tile = malloc(size);
+
+    if(tile == NULL) {
+      errno = ENOMEM;
+      return NULL;
+    }
+
+    memset(tile, b->bs_tiled_init, size);
+    b->bs_tiled_tiles[t] = tile;
+  }
+
+  return b->bs_tiled_tiles[t];
+}
+
+void bs_tiled_bitmap_init(bs_tiled_bitmap_t *b, unsigned char init) {
+  memset(b, 0, sizeof(bs_tiled_bitmap_t));
+  b->bs_tiled_init = init;
+}
+
+void bs_tiled_bitmap_free(bs_tiled_bitmap_t *b) {
+  for(size_t t = 0; t < tile_count(b->bs_tiled_width); t++) {
+    free(b->bs_tiled_tiles[t]);
+  }
+
+  free(b->bs_tiled_tiles);
+
+  bs_tiled_bitmap_init(b, b->bs_tiled_init);
+}
+
+bool bs_tiled_bitmap_extend(bs_tiled_bitmap_t *b, size_t width, size_t height) {
+  width = width > b->bs_tiled_width ? width : b->bs_tiled_width;
+  height = height > b->bs_tiled_height ? height : b->bs_tiled_height;
+
+  // keeps tile sizes below SIZE_MAX and coordinates plus offsets below INT64_MAX
+  if(height > SIZE_MAX / BS_TILE_WIDTH || height > INT64_MAX / 2
+     || width > INT64_MAX / 2) {
+    errno = EOVERFLOW;
+    return false;
+  }
+
+  size_t tiles = tile_count(width);
+  size_t old_tiles = tile_count(b->bs_tiled_width);
+
+  if(tiles > b->bs_tiled_tiles_cap) {
+    // grows geometrically, so appending columns takes amortized constant time
+    size_t cap = b->bs_tiled_tiles_cap * 2 > tiles ? b->bs_tiled_tiles_cap * 2 : tiles;
+
+    if(cap > SIZE_MAX / sizeof(unsigned char *)) {
+      errno = EOVERFLOW;
+      return false;
+    }
+
+    unsigned char **table = realloc(b->bs_tiled_tiles, cap * sizeof(unsigned char *));
+
+    if(table == NULL) {
+      errno = ENOMEM;
+      return false;
+    }
+
+    b->bs_tiled_tiles = table;
+    b->bs_tiled_tiles_cap = cap;
+  }
+
+  for(size_t t = old_tiles; t < tiles; t++) {
+    b->bs_tiled_tiles[t] = NULL;
+  }
+
+  if(height > b->bs_tiled_height) {
+    size_t old_size = b->bs_tiled_height * BS_TILE_WIDTH;
+    size_t size = height * BS_TILE_WIDTH;
+
+    // rows are appended to every tile, like bs_bitmap_extend() does
+    for(size_t t = 0; t < old_tiles; t++) {
+      if(b->bs_tiled_tiles[t] == NULL) {
+        continue;
+      }
+
+      unsigned char *tile = realloc(b->bs_tiled_tiles[t], size);
+
+      if(tile == NULL) {
+        errno = ENOMEM;
+        return false;
+      }
+
+      memset(tile + old_size, b->bs_tiled_init, size - old_size);
+      b->bs_tiled_tiles[t] = tile;
+    }
+  }
+
+  b->bs_tiled_width = width;
+  b->bs_tiled_height = height;
+
+  return true;
+}
+
+unsigned char bs_tiled_bitmap_get(const bs_tiled_bitmap_t *b, size_t x, size_t y,
+  unsigned char def) {
+  if(x >= b->bs_tiled_width || y >= b->bs_tiled_height) {
+    errno = EINVAL;
+    return def;
+  }
+
+  const unsigned char *pixel = tile_pixel(b, x, y);
+
+  return pixel == NULL ? b->bs_tiled_init : *pixel;
+}
+
+bool bs_tiled_bitmap_set(bs_tiled_bitmap_t *b, size_t x, size_t y, unsigned char p) {
+  if(x >= b->bs_tiled_width || y >= b->bs_tiled_height) {
+    return true;
+  }
+
+  size_t t = x / BS_TILE_WIDTH;
+
+  if(b->bs_tiled_tiles[t] == NULL && p == b->bs_tiled_init) {
+    return true;
+  }
+
+  unsigned char *tile = tile_get(b, t);
+
+  if(tile == NULL) {
+    return false;
+  }
+
+  tile[y * BS_TILE_WIDTH + x % BS_TILE_WIDTH] = p;
+
+  return true;
+}
+
+// whether len pixels are all p
+static bool all_equal(const unsigned char *pixels, size_t len, unsigned char p) {
+  for(size_t i = 0; i < len; i++) {
+    if(pixels[i] != p) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool bs_tiled_bitmap_copy(bs_tiled_bitmap_t *dst, int64_t offset_x, int64_t offset_y,
+  bs_bitmap_t src) {
+  // part of src that lies within dst
+  int64_t min_x = offset_x < 0 ? -offset_x : 0;
+  int64_t min_y = offset_y < 0 ? -offset_y : 0;
+  int64_t max_x = src.bs_bitmap_width;
+  int64_t max_y = src.bs_bitmap_height;
+
+  if(offset_x >= 0 && (uint64_t) offset_x >= dst->bs_tiled_width) {
+    return true;
+  } else if(offset_x + max_x > (int64_t) dst->bs_tiled_width) {
+    max_x = dst->bs_tiled_width - offset_x;
+  }
+
+  if(offset_y >= 0 && (uint64_t) offset_y >= dst->bs_tiled_height) {
+    return true;
+  } else if(offset_y + max_y > (int64_t) dst->bs_tiled_height) {
+    max_y = dst->bs_tiled_height - offset_y;
+  }
+
+  // tile by tile, so each tile is looked up once
+  for(int64_t x = min_x; x < max_x;) {
+    size_t dst_x = offset_x + x;
+    size_t t = dst_x / BS_TILE_WIDTH;
+    size_t tile_x = dst_x % BS_TILE_WIDTH;
+    int64_t len = BS_TILE_WIDTH - tile_x < (size_t) (max_x - x)
+      ? (int64_t) (BS_TILE_WIDTH - tile_x) : max_x - x;
+
+    unsigned char *tile = dst->bs_tiled_tiles[t];
+
+    for(int64_t y = min_y; y < max_y; y++) {
+      const unsigned char *pixels = src.bs_bitmap + (size_t) y * src.bs_bitmap_width + x;
+
+      // blank parts of src don't need a tile, e. g. spaces
+      if(tile == NULL && all_equal(pixels, len, dst->bs_tiled_init)) {
+        continue;
+      }
+
+      if(tile == NULL && (tile = tile_get(dst, t)) == NULL) {
+        return false;
+      }
+
+      memcpy(tile + (size_t) (offset_y + y) * BS_TILE_WIDTH + tile_x, pixels, len);
+    }
+
+    x += len;
+  }
+
+  return true;
+}
+
+void bs_tiled_bitmap_crop(const bs_tiled_bitmap_t *b, int64_t offset_x,
+  int64_t offset_y, bs_bitmap_t window, unsigned char def) {
+  for(int i = 0; i < window.bs_bitmap_height; i++) {
+    unsigned char *row = window.bs_bitmap + (size_t) i * window.bs_bitmap_width;
+    int64_t y = offset_y + i;
+
+    memset(row, def, window.bs_bitmap_width);
+
+    if(y < 0 || (uint64_t) y >= b->bs_tiled_height) {
+      continue;
+    }
+
+    int64_t min_j = offset_x < 0 ? -offset_x : 0;
+    int64_t max_j = window.bs_bitmap_width;
+
+    if(offset_x > 0 && (uint64_t) offset_x >= b->bs_tiled_width) {
+      continue;
+    } else if(offset_x + max_j > (int64_t) b->bs_tiled_width) {
+      max_j = b->bs_tiled_width - offset_x;
+    }
+
+    for(int64_t j = min_j; j < max_j;) {
+      size_t x = offset_x + j;
+      size_t tile_x = x % BS_TILE_WIDTH;
+      int64_t len = BS_TILE_WIDTH - tile_x < (size_t) (max_j - j)
+        ? (int64_t) (BS_TILE_WIDTH - tile_x) : max_j - j;
+      const unsigned char *pixels = tile_pixel(b, x, y);
+
+      if(pixels == NULL) {
+        memset(row + j, b->bs_tiled_init, len);
+      } else {
+        memcpy(row + j, pixels, len);
+      }
+
+      j += len;
+    }
+  }
+}
+
+size_t bs_tiled_view_pack(const bs_tiled_bitmap_t *b, int64_t offset_x,
+  int64_t offset_y, int width, int height, uint8_t *array, size_t size,
+  unsigned char def) {
+  bs_view_t shape = { { NULL, 0, 0 }, 0, 0, width, height };
+  size_t needed = bs_view_bitarray_size(shape);
+
+  if(needed == 0 || size < needed) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  size_t row_bytes = ((size_t) width + 7) / 8;
+  uint8_t def_byte = def > 0 ? 0xff : 0x00;
+
+  // part of the view's columns that is covered by the bitmap
+  int64_t min_j = offset_x < 0 ? -offset_x : 0;
+  int64_t max_j = width;
+
+  if(offset_x > 0 && (uint64_t) offset_x >= b->bs_tiled_width) {
+    max_j = min_j;
+  } else if(offset_x + max_j > (int64_t) b->bs_tiled_width) {
+    max_j = b->bs_tiled_width - offset_x;
+  }
+
+  for(int i = 0; i < height; i++) {
+    int64_t y = offset_y + i;
+    uint8_t *row = array + i * row_bytes;
+
+    memset(row, def_byte, row_bytes);
+
+    for(int64_t j = min_j; y >= 0 && (uint64_t) y < b->bs_tiled_height && j < max_j;) {
+      size_t x = offset_x + j;
+      size_t tile_x = x % BS_TILE_WIDTH;
+      int64_t len = BS_TILE_WIDTH - tile_x < (size_t) (max_j - j)
+        ? (int64_t) (BS_TILE_WIDTH - tile_x) : max_j - j;
+      const unsigned char *pixels = tile_pixel(b, x, y);
+
+      for(int64_t k = j; k < j + len; k++) {
+        uint8_t mask = 0x80 >> (k & 7);
+        unsigned char p = pixels == NULL ? b->bs_tiled_init : pixels[k - j];
+
+        if(p > 0) {
+          row[k >> 3] |= mask;
+        } else {
+          row[k >> 3] &= ~mask;
+        }
+      }
+
+      j += len;
+    }
+
+    // keep the padding bits of each row zero
+    if(width % 8 != 0) {
+      row[row_bytes - 1] &= 0xff << (8 - width % 8);
+    }
+  }
+
+  return needed;
+}
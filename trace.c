@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200112L /* clock_gettime */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <buchstabensuppe.h>
+
+typedef struct bs_trace_event {
+  const char *name;
+  const char *arg_name;
+  long        arg;
+  uint64_t    start;
+  uint64_t    duration;
+  unsigned    tid;
+  bool        done;
+} bs_trace_event_t;
+
+// The trace buffer is allocated once in bs_trace_start() and filled
+// lock-free: every span reserves its slot by atomically incrementing
+// trace_len and marks it done once it is filled in, so slots which are
+// reserved but not yet written are skipped. When tracing is disabled
+// trace_events is NULL, so all instrumentation boils down to a single
+// load and branch.
+static bs_trace_event_t *trace_events = NULL;
+static size_t trace_cap = 0;
+static size_t trace_len = 0;
+static size_t trace_dropped = 0;
+static unsigned trace_next_tid = 0;
+
+static __thread unsigned trace_tid = 0;
+
+static uint64_t trace_now(void) {
+  struct timespec ts;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool bs_trace_start(size_t capacity) {
+  if(trace_events != NULL || capacity == 0) {
+    errno = EINVAL;
+    return false;
+  }
+
+  bs_trace_event_t *events = calloc(capacity, sizeof(bs_trace_event_t));
+
+  if(events == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  trace_cap = capacity;
+  trace_len = 0;
+  trace_dropped = 0;
+
+  __atomic_store_n(&trace_events, events, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+void bs_trace_stop(void) {
+  bs_trace_event_t *events =
+    __atomic_exchange_n(&trace_events, NULL, __ATOMIC_ACQ_REL);
+
+  free(events);
+
+  trace_cap = 0;
+  trace_len = 0;
+}
+
+uint64_t bs_trace_begin(void) {
+  if(__atomic_load_n(&trace_events, __ATOMIC_RELAXED) == NULL) {
+    return 0;
+  }
+
+  return trace_now();
+}
+
+void bs_trace_end(const char *name, uint64_t start, const char *arg_name, long arg) {
+  if(start == 0) {
+    return;
+  }
+
+  bs_trace_event_t *events = __atomic_load_n(&trace_events, __ATOMIC_ACQUIRE);
+
+  if(events == NULL) {
+    return;
+  }
+
+  uint64_t end = trace_now();
+
+  if(trace_tid == 0) {
+    trace_tid = __atomic_add_fetch(&trace_next_tid, 1, __ATOMIC_RELAXED);
+  }
+
+  size_t i = __atomic_fetch_add(&trace_len, 1, __ATOMIC_RELAXED);
+
+  if(i >= trace_cap) {
+    __atomic_fetch_add(&trace_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  events[i].name = name;
+  events[i].arg_name = arg_name;
+  events[i].arg = arg;
+  events[i].start = start;
+  events[i].duration = end > start ? end - start : 0;
+  events[i].tid = trace_tid;
+
+  __atomic_store_n(&events[i].done, true, __ATOMIC_RELEASE);
+}
+
+bool bs_trace_write(const char *path) {
+  bs_trace_event_t *events = __atomic_load_n(&trace_events, __ATOMIC_ACQUIRE);
+
+  if(events == NULL) {
+    errno = EINVAL;
+    return false;
+  }
+
+  FILE *out = fopen(path, "w");
+
+  if(out == NULL) {
+    return false;
+  }
+
+  size_t len = __atomic_load_n(&trace_len, __ATOMIC_ACQUIRE);
+  if(len > trace_cap) {
+    len = trace_cap;
+  }
+
+  long pid = (long) getpid();
+
+  // Chrome trace event format, complete events (ph X) with timestamps
+  // in microseconds, which can be loaded into Perfetto or chrome://tracing
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+
+  size_t written = 0;
+
+  for(size_t i = 0; i < len; i++) {
+    if(!__atomic_load_n(&events[i].done, __ATOMIC_ACQUIRE)) {
+      continue;
+    }
+
+    fprintf(out, "%s\n{\"name\":\"%s\",\"cat\":\"buchstabensuppe\",\"ph\":\"X\","
+      "\"pid\":%ld,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u",
+      written++ == 0 ? "" : ",", events[i].name, pid, events[i].tid,
+      (unsigned long long) (events[i].start / 1000),
+      (unsigned) (events[i].start % 1000),
+      (unsigned long long) (events[i].duration / 1000),
+      (unsigned) (events[i].duration % 1000));
+
+    if(events[i].arg_name != NULL) {
+      fprintf(out, ",\"args\":{\"%s\":%ld}", events[i].arg_name, events[i].arg);
+    }
+
+    fputc('}', out);
+  }
+
+  fprintf(out, "\n],\"otherData\":{\"dropped_events\":\"%zu\"}}\n",
+    __atomic_load_n(&trace_dropped, __ATOMIC_RELAXED));
+
+  bool success = !ferror(out);
+
+  if(fclose(out) != 0) {
+    success = false;
+  }
+
+  return success;
+}
@@ -0,0 +1,207 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <buchstabensuppe.h>
+
+// Transitions only ever pick whole rows or, for every row, the same
+// bytes out of either frame, so intermediate frames are assembled from
+// memcpy and bitwise operations on the packed data without looking at
+// individual pixels. This works for every format that packs rows of
+// single bit pixels: bands of rows are just rows one after another.
+
+// frames up to this size are packed on the stack by bs_view_transition()
+#define FRAME_STACK_SIZE 1024
+
+// height of the slats of BS_TRANSITION_BLINDS, i. e. of a common module
+#define BLINDS_HEIGHT 8
+
+// ordered dithering matrix, the order pixels of a cell are dissolved in
+static const uint8_t bayer[8][8] = {
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+static inline uint8_t pixel_bit(int x, enum bs_bit_order order) {
+  return order == BS_BIT_ORDER_MSB_FIRST ? 0x80 >> x : 1 << x;
+}
+
+// out = from where mask is 0, to where mask is 1, a word at a time
+static void blend_row(uint8_t *out, const uint8_t *from, const uint8_t *to,
+  size_t len, uint8_t mask) {
+  uint64_t wide_mask = mask * 0x0101010101010101ull;
+  size_t i = 0;
+
+  for(; i + 8 <= len; i += 8) {
+    uint64_t f, t;
+    memcpy(&f, from + i, 8);
+    memcpy(&t, to + i, 8);
+
+    f = (f & ~wide_mask) | (t & wide_mask);
+    memcpy(out + i, &f, 8);
+  }
+
+  for(; i < len; i++) {
+    out[i] = (from[i] & ~mask) | (to[i] & mask);
+  }
+}
+
+static void transition_wipe(uint8_t *out, const uint8_t *from, const uint8_t *to,
+  int width, int height, size_t row_size, enum bs_bit_order order, int step, int steps) {
+  // columns left of x come from the new frame
+  int x = (long) width * step / steps;
+  size_t full = x / 8;
+  uint8_t partial = 0;
+
+  for(int i = 0; i < x % 8; i++) {
+    partial |= pixel_bit(i, order);
+  }
+
+  for(int y = 0; y < height; y++) {
+    size_t row = y * row_size;
+
+    memcpy(out + row, to + row, full);
+
+    if(full < row_size) {
+      out[row + full] = (from[row + full] & ~partial) | (to[row + full] & partial);
+      memmove(out + row + full + 1, from + row + full + 1, row_size - full - 1);
+    }
+  }
+}
+
+static void transition_push(uint8_t *out, const uint8_t *from, const uint8_t *to,
+  int height, size_t row_size, int step, int steps) {
+  // the new frame moves in from the bottom, pushing the old one out
+  int shift = (long) height * step / steps;
+
+  memmove(out, from + shift * row_size, (height - shift) * row_size);
+  memcpy(out + (height - shift) * row_size, to, shift * row_size);
+}
+
+static void transition_dissolve(uint8_t *out, const uint8_t *from, const uint8_t *to,
+  int height, size_t row_size, enum bs_bit_order order, int step, int steps) {
+  int threshold = 64 * step / steps;
+  uint8_t masks[8];
+
+  // a byte covers 8 columns, so all bytes of a row share their mask
+  for(int y = 0; y < 8; y++) {
+    masks[y] = 0;
+
+    for(int x = 0; x < 8; x++) {
+      if(bayer[y][x] < threshold) {
+        masks[y] |= pixel_bit(x, order);
+      }
+    }
+  }
+
+  for(int y = 0; y < height; y++) {
+    size_t row = y * row_size;
+    blend_row(out + row, from + row, to + row, row_size, masks[y % 8]);
+  }
+}
+
+static void transition_blinds(uint8_t *out, const uint8_t *from, const uint8_t *to,
+  int height, size_t row_size, int step, int steps) {
+  // the top rows of every slat already show the new frame
+  int closed = BLINDS_HEIGHT * step / steps;
+
+  for(int y = 0; y < height; y++) {
+    const uint8_t *src = y % BLINDS_HEIGHT < closed ? to : from;
+    memmove(out + y * row_size, src + y * row_size, row_size);
+  }
+}
+
+bool bs_frame_transition(enum bs_transition transition, int step, int steps,
+  const bs_frame_format_t *format, int width, int height,
+  const uint8_t *from, const uint8_t *to, uint8_t *frame) {
+  bs_frame_format_t flipdot = bs_frame_format_flipdot();
+
+  if(format == NULL) {
+    format = &flipdot;
+  }
+
+  if(bs_frame_format_size(format, width, height) == 0 ||
+      format->bs_format_scan != BS_SCAN_ROWS || format->bs_format_depth != 1 ||
+      steps <= 0 || step < 0 || step > steps) {
+    errno = EINVAL;
+    return false;
+  }
+
+  size_t header_size = format->bs_format_header_size;
+  size_t row_size = (width + 7) / 8;
+  enum bs_bit_order order = format->bs_format_bit_order;
+
+  memmove(frame, to, header_size);
+
+  from += header_size;
+  to += header_size;
+  frame += header_size;
+
+  switch(transition) {
+    case BS_TRANSITION_WIPE:
+      transition_wipe(frame, from, to, width, height, row_size, order, step, steps);
+      break;
+    case BS_TRANSITION_PUSH:
+      transition_push(frame, from, to, height, row_size, step, steps);
+      break;
+    case BS_TRANSITION_DISSOLVE:
+      transition_dissolve(frame, from, to, height, row_size, order, step, steps);
+      break;
+    case BS_TRANSITION_BLINDS:
+      transition_blinds(frame, from, to, height, row_size, step, steps);
+      break;
+    default:
+      errno = EINVAL;
+      return false;
+  }
+
+  return true;
+}
+
+size_t bs_view_transition(enum bs_transition transition, int step, int steps,
+  const bs_frame_format_t *format, bs_view_t from, bs_view_t to,
+  uint8_t *frame, size_t size, unsigned char def) {
+  bs_frame_format_t flipdot = bs_frame_format_flipdot();
+
+  if(format == NULL) {
+    format = &flipdot;
+  }
+
+  if(from.bs_view_width != to.bs_view_width ||
+      from.bs_view_height != to.bs_view_height) {
+    errno = EINVAL;
+    return 0;
+  }
+
+  uint8_t stack_frame[FRAME_STACK_SIZE];
+  uint8_t *to_frame = stack_frame;
+
+  if(size > sizeof(stack_frame)) {
+    to_frame = malloc(size);
+
+    if(to_frame == NULL) {
+      errno = ENOMEM;
+      return 0;
+    }
+  }
+
+  size_t packed = bs_view_pack(from, format, frame, size, def);
+
+  if(packed == 0 || bs_view_pack(to, format, to_frame, size, def) != packed ||
+      !bs_frame_transition(transition, step, steps, format, to.bs_view_width,
+        to.bs_view_height, frame, to_frame, frame)) {
+    packed = 0;
+  }
+
+  if(to_frame != stack_frame) {
+    free(to_frame);
+  }
+
+  return packed;
+}
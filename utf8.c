@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <utf8proc.h>
+
+#include <buchstabensuppe.h>
+
+// Text is mostly ASCII, so blocks of ASCII bytes are widened to
+// codepoints in bulk: 16 bytes at a time using SSE2 where available,
+// otherwise 8 at a time checking a whole word for set high bits. Only
+// multibyte sequences are decoded one at a time by utf8proc, which also
+// takes care of rejecting overlong forms, surrogates and the like.
+
+#define HIGH_BITS 0x8080808080808080ull
+
+// Widens the ASCII bytes at the start of s into dst,
+// returns how many there were, at most l.
+static size_t widen_ascii(const uint8_t *s, size_t l, uint32_t *dst) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+
+  for(; i + 16 <= l; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *) (s + i));
+    int non_ascii = _mm_movemask_epi8(bytes);
+    __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+
+    _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *) (dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i *) (dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i *) (dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+
+    // the whole block is stored regardless, dst has room for it and
+    // whatever follows the ASCII prefix is overwritten by the caller
+    if(non_ascii != 0) {
+      return i + __builtin_ctz(non_ascii);
+    }
+  }
+#endif
+
+  for(; i + 8 <= l; i += 8) {
+    uint64_t word;
+    memcpy(&word, s + i, sizeof(word));
+
+    if(word & HIGH_BITS) {
+      break;
+    }
+
+    for(size_t j = 0; j < 8; j++) {
+      dst[i + j] = s[i + j];
+    }
+  }
+
+  for(; i < l && s[i] < 0x80; i++) {
+    dst[i] = s[i];
+  }
+
+  return i;
+}
+
+enum bs_decode_result bs_utf8_decode(const char *s, size_t l, uint32_t *dst, size_t *len) {
+  const uint8_t *bytes = (const uint8_t *) s;
+  size_t read = 0;
+
+  *len = 0;
+
+  while(read < l) {
+    size_t ascii = widen_ascii(bytes + read, l - read, dst + *len);
+    read += ascii;
+    *len += ascii;
+
+    if(read >= l) {
+      break;
+    }
+
+    utf8proc_int32_t codepoint;
+    utf8proc_ssize_t n = utf8proc_iterate(bytes + read, l - read, &codepoint);
+
+    if(n <= 0) {
+      return BS_DECODE_INVALID;
+    }
+
+    read += n;
+    dst[(*len)++] = codepoint;
+  }
+
+  return BS_DECODE_OK;
+}
+
+enum bs_decode_result bs_utf32_buffer_append_utf8(bs_utf32_buffer_t *buf, const char *s, size_t l) {
+  // a byte never decodes to more than one codepoint
+  if(!bs_utf32_buffer_reserve(buf, l)) {
+    return BS_DECODE_NOMEM;
+  }
+
+  size_t len;
+  enum bs_decode_result result = bs_utf8_decode(s, l,
+    buf->bs_utf32_buffer + buf->bs_utf32_buffer_len, &len);
+
+  buf->bs_utf32_buffer_len += len;
+
+  return result;
+}